@@ -1,11 +1,15 @@
 #include <vector>
 #include <map>
+#include <stdio.h>
+#include <chrono>
 
 #include <glm/glm.hpp>
 
 #include "vboindexer.hpp"
+#include "parallel.hpp"
 
 #include <string.h> // for memcmp
+#include <math.h>
 
 
 // Returns true iif v1 can be considered equal to v2
@@ -132,46 +136,449 @@ void indexVBO(
 	}
 }
 
+// Hash of the exact bits of a vertex : indexVBO_hash welds the same vertices indexVBO does
+static inline unsigned int hashVertex(const glm::vec3 & position, const glm::vec2 & uv, const glm::vec3 & normal){
+	unsigned int words[8];
+	memcpy(&words[0], &position, sizeof(position));
+	memcpy(&words[3], &uv, sizeof(uv));
+	memcpy(&words[5], &normal, sizeof(normal));
+	unsigned int hash = 2166136261u;
+	for (int i = 0; i < 8; i++){
+		hash = (hash ^ words[i]) * 0x9E3779B1u;
+		hash ^= hash >> 16;
+	}
+	return hash;
+}
 
+static inline bool sameVertex(
+	const std::vector<glm::vec3> & vertices, const std::vector<glm::vec2> & uvs, const std::vector<glm::vec3> & normals,
+	unsigned int a, unsigned int b
+){
+	return memcmp(&vertices[a], &vertices[b], sizeof(glm::vec3)) == 0
+		&& memcmp(&uvs[a], &uvs[b], sizeof(glm::vec2)) == 0
+		&& memcmp(&normals[a], &normals[b], sizeof(glm::vec3)) == 0;
+}
 
+static const unsigned int EMPTY_SLOT = 0xFFFFFFFFu;
 
+// Fills first[i] with the first input vertex equal to vertex i, for every i in `order`.
+// Open addressing with linear probing; the slots hold input indices.
+static void findFirstOccurrences(
+	const std::vector<glm::vec3> & vertices, const std::vector<glm::vec2> & uvs, const std::vector<glm::vec3> & normals,
+	const std::vector<unsigned int> & hashes,
+	const unsigned int * order, size_t count,
+	std::vector<unsigned int> & first
+){
+	size_t capacity = 16;
+	while (capacity < count * 2)
+		capacity *= 2;
+	std::vector<unsigned int> slots(capacity, EMPTY_SLOT);
+	size_t mask = capacity - 1;
 
+	for (size_t k = 0; k < count; k++){
+		unsigned int i = order ? order[k] : (unsigned int)k;
+		size_t slot = hashes[i] & mask;
+		while (slots[slot] != EMPTY_SLOT && (hashes[slots[slot]] != hashes[i] || !sameVertex(vertices, uvs, normals, slots[slot], i)))
+			slot = (slot + 1) & mask;
+		if (slots[slot] == EMPTY_SLOT)
+			slots[slot] = i;
+		first[i] = slots[slot];
+	}
+}
 
+// Makes room for count more indices at the end of buffer, switching it to 32 bits if it has
+// to address vertexCount vertices. Returns where the new indices go.
+static size_t growIndexBuffer(IndexBuffer & buffer, size_t count, size_t vertexCount){
+	size_t first = buffer.count();
+	if (!buffer.wide && vertexCount > 65536){
+		buffer.indices32.assign(buffer.indices16.begin(), buffer.indices16.end());
+		std::vector<unsigned short>().swap(buffer.indices16);
+		buffer.wide = true;
+	}
+	if (buffer.wide)
+		buffer.indices32.resize(first + count);
+	else
+		buffer.indices16.resize(first + count);
+	return first;
+}
 
-void indexVBO_TBN(
+// Below this many vertices per thread, starting the threads costs more than it saves
+static const size_t MIN_VERTICES_PER_THREAD = 1 << 15;
+
+void indexVBO_hash(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	size_t count = in_vertices.size();
+	unsigned int threads = workerCount(count, MIN_VERTICES_PER_THREAD, threadCount);
+	std::vector<size_t> bounds(threads + 1);
+	for (unsigned int t = 0; t <= threads; t++)
+		bounds[t] = count / threads * t + (t == threads ? count % threads : 0);
+
+	std::vector<unsigned int> hashes(count);
+	std::vector<unsigned int> first(count);
+
+	if (threads == 1){
+		for (size_t i = 0; i < count; i++)
+			hashes[i] = hashVertex(in_vertices[i], in_uvs[i], in_normals[i]);
+		findFirstOccurrences(in_vertices, in_uvs, in_normals, hashes, NULL, count, first);
+	}else{
+		// Sharded : the top bits of the hash pick a shard, so equal vertices always meet in the same one.
+		// Every thread hashes and counts its slice of the input...
+		unsigned int shards = threads;
+		std::vector<size_t> shardCounts((size_t)threads * shards, 0);
+		runParallel(threads, [&](unsigned int t){
+			size_t * counts = &shardCounts[(size_t)t * shards];
+			for (size_t i = bounds[t]; i < bounds[t+1]; i++){
+				hashes[i] = hashVertex(in_vertices[i], in_uvs[i], in_normals[i]);
+				counts[ (unsigned long long)hashes[i] * shards >> 32 ]++;
+			}
+		});
+
+		// ... then scatters it to the shards, keeping the input order inside each shard
+		std::vector<size_t> shardBase(shards + 1, 0);
+		std::vector<size_t> offsets((size_t)threads * shards);
+		for (unsigned int s = 0; s < shards; s++){
+			size_t offset = shardBase[s];
+			for (unsigned int t = 0; t < threads; t++){
+				offsets[(size_t)t * shards + s] = offset;
+				offset += shardCounts[(size_t)t * shards + s];
+			}
+			shardBase[s+1] = offset;
+		}
+		std::vector<unsigned int> order(count);
+		runParallel(threads, [&](unsigned int t){
+			size_t * offset = &offsets[(size_t)t * shards];
+			for (size_t i = bounds[t]; i < bounds[t+1]; i++)
+				order[ offset[ (unsigned long long)hashes[i] * shards >> 32 ]++ ] = (unsigned int)i;
+		});
+
+		// Each shard has its own table, no locking needed
+		runParallel(shards, [&](unsigned int s){
+			findFirstOccurrences(in_vertices, in_uvs, in_normals, hashes, &order[shardBase[s]], shardBase[s+1] - shardBase[s], first);
+		});
+	}
+
+	// Number the vertices in order of first use, like indexVBO does
+	std::vector<unsigned int> uniqueBase(threads + 1, 0);
+	runParallel(threads, [&](unsigned int t){
+		unsigned int unique = 0;
+		for (size_t i = bounds[t]; i < bounds[t+1]; i++)
+			unique += first[i] == i;
+		uniqueBase[t+1] = unique;
+	});
+	for (unsigned int t = 0; t < threads; t++)
+		uniqueBase[t+1] += uniqueBase[t];
+
+	size_t base = out_vertices.size();
+	unsigned int uniqueCount = uniqueBase[threads];
+	out_vertices.resize(base + uniqueCount);
+	out_uvs     .resize(base + uniqueCount);
+	out_normals .resize(base + uniqueCount);
+	std::vector<unsigned int> & outIndex = hashes; // Not needed anymore
+	runParallel(threads, [&](unsigned int t){
+		unsigned int next = uniqueBase[t];
+		for (size_t i = bounds[t]; i < bounds[t+1]; i++){
+			if (first[i] != i)
+				continue;
+			out_vertices[base + next] = in_vertices[i];
+			out_uvs     [base + next] = in_uvs[i];
+			out_normals [base + next] = in_normals[i];
+			outIndex[i] = (unsigned int)base + next++;
+		}
+	});
+
+	// 16-bit indices as long as they can address all the vertices
+	size_t firstIndex = growIndexBuffer(out_indices, count, base + uniqueCount);
+	runParallel(threads, [&](unsigned int t){
+		for (size_t i = bounds[t]; i < bounds[t+1]; i++){
+			if (out_indices.wide)
+				out_indices.indices32[firstIndex + i] = outIndex[ first[i] ];
+			else
+				out_indices.indices16[firstIndex + i] = (unsigned short)outIndex[ first[i] ];
+		}
+	});
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// indexVBO_slow is quadratic : past this many input vertices it would take minutes
+static const size_t SLOW_BENCHMARK_LIMIT = 200000;
+
+void benchmarkIndexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals
+){
+	printf("Indexing %u vertices :\n", (unsigned int)in_vertices.size());
+
+	if (in_vertices.size() <= SLOW_BENCHMARK_LIMIT){
+		std::vector<unsigned short> indices;
+		std::vector<glm::vec3> vertices, normals;
+		std::vector<glm::vec2> uvs;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		indexVBO_slow(in_vertices, in_uvs, in_normals, indices, vertices, uvs, normals);
+		printf("  %-26s %9.2f ms, %u vertices (welded within 0.01)\n", "indexVBO_slow", millisecondsSince(start), (unsigned int)vertices.size());
+	}else{
+		printf("  %-26s skipped, more than %u vertices\n", "indexVBO_slow", (unsigned int)SLOW_BENCHMARK_LIMIT);
+	}
+
+	std::vector<unsigned short> mapIndices;
+	std::vector<glm::vec3> mapVertices, mapNormals;
+	std::vector<glm::vec2> mapUVs;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	indexVBO(in_vertices, in_uvs, in_normals, mapIndices, mapVertices, mapUVs, mapNormals);
+	printf("  %-26s %9.2f ms, %u vertices\n", "indexVBO", millisecondsSince(start), (unsigned int)mapVertices.size());
+
+	IndexBuffer hashIndices[2];
+	std::vector<glm::vec3> hashVertices[2], hashNormals[2];
+	std::vector<glm::vec2> hashUVs[2];
+	for (int parallel = 0; parallel < 2; parallel++){
+		start = std::chrono::steady_clock::now();
+		indexVBO_hash(in_vertices, in_uvs, in_normals, hashIndices[parallel], hashVertices[parallel], hashUVs[parallel], hashNormals[parallel],
+			parallel ? 0 : 1);
+		printf("  %-26s %9.2f ms, %u vertices, %u-bit indices\n", parallel ? "indexVBO_hash, all cores" : "indexVBO_hash, 1 thread",
+			millisecondsSince(start), (unsigned int)hashVertices[parallel].size(), hashIndices[parallel].indexSize() * 8);
+	}
+
+	// The threads must not change the output, and below 65536 vertices indexVBO must give the same one
+	bool sameAsThreads = hashIndices[0].wide == hashIndices[1].wide && hashIndices[0].indices16 == hashIndices[1].indices16
+		&& hashIndices[0].indices32 == hashIndices[1].indices32 && hashVertices[0] == hashVertices[1]
+		&& hashUVs[0] == hashUVs[1] && hashNormals[0] == hashNormals[1];
+	printf("  threaded output %s", sameAsThreads ? "identical" : "DIFFERENT");
+	if (!hashIndices[0].wide){
+		bool sameAsMap = hashIndices[0].indices16 == mapIndices && hashVertices[0] == mapVertices
+			&& hashUVs[0] == mapUVs && hashNormals[0] == mapNormals;
+		printf(", indexVBO output %s", sameAsMap ? "identical" : "DIFFERENT");
+	}
+	printf("\n");
+}
+
+// Cell of the welding grid. A bit larger than the is_near epsilon, so that rounding can't put
+// two near vertices more than one cell apart.
+static const float WELD_CELL_SIZE = 0.01f * 1.01f;
+
+struct WeldCell{
+	int x, y, z;
+	unsigned int head, tail; // Output vertices in this cell, linked through next[] in increasing order
+};
+
+static inline unsigned int hashCell(int x, int y, int z){
+	unsigned int hash = (unsigned int)x * 0x8DA6B343u ^ (unsigned int)y * 0xD8163841u ^ (unsigned int)z * 0xCB1AB31Fu;
+	return hash ^ (hash >> 16);
+}
+
+// Spatial hash over the positions of the output vertices, so getSimilarVertexIndex
+// only has to look at the 27 cells around a vertex instead of all of them.
+struct WeldGrid{
+	std::vector<WeldCell> cells;
+	std::vector<unsigned int> slots;
+	std::vector<unsigned int> next;
+
+	WeldGrid(size_t expected){
+		size_t capacity = 16;
+		while (capacity < expected * 2)
+			capacity *= 2;
+		slots.assign(capacity, EMPTY_SLOT);
+		cells.reserve(expected);
+		next.reserve(expected);
+	}
+
+	unsigned int find(int x, int y, int z) const {
+		size_t mask = slots.size() - 1;
+		for (size_t slot = hashCell(x, y, z) & mask; slots[slot] != EMPTY_SLOT; slot = (slot + 1) & mask){
+			const WeldCell & cell = cells[slots[slot]];
+			if (cell.x == x && cell.y == y && cell.z == z)
+				return slots[slot];
+		}
+		return EMPTY_SLOT;
+	}
+
+	void place(unsigned int c){
+		size_t mask = slots.size() - 1;
+		size_t slot = hashCell(cells[c].x, cells[c].y, cells[c].z) & mask;
+		while (slots[slot] != EMPTY_SLOT)
+			slot = (slot + 1) & mask;
+		slots[slot] = c;
+	}
+
+	// vertex must be larger than every vertex already in the grid
+	void insert(int x, int y, int z, unsigned int vertex){
+		next.push_back(EMPTY_SLOT);
+		unsigned int c = find(x, y, z);
+		if (c != EMPTY_SLOT){
+			next[ cells[c].tail ] = vertex;
+			cells[c].tail = vertex;
+			return;
+		}
+		WeldCell cell = { x, y, z, vertex, vertex };
+		cells.push_back(cell);
+		if (cells.size() * 2 <= slots.size()){
+			place((unsigned int)cells.size() - 1);
+			return;
+		}
+		// Keep the table at most half full
+		slots.assign(slots.size() * 2, EMPTY_SLOT);
+		for (size_t i = 0; i < cells.size(); i++)
+			place((unsigned int)i);
+	}
+};
+
+// Far enough from INT_MIN / INT_MAX that the cells around one (x - 1, x + 1) still fit in an int
+static const float WELD_CELL_LIMIT = 1e9f;
+
+static inline int weldCell(float v){
+	float cell = floorf(v / WELD_CELL_SIZE);
+	// Huge coordinates share the cells at the limit, and NaN (never near anything) goes to the lowest
+	if (!(cell > -WELD_CELL_LIMIT))
+		return -(int)WELD_CELL_LIMIT;
+	if (cell > WELD_CELL_LIMIT)
+		return (int)WELD_CELL_LIMIT;
+	return (int)cell;
+}
+
+// Same answer as the linear getSimilarVertexIndex : the first output vertex that is near in_vertex.
+// Every cell lists its vertices in increasing order, so the first match of each cell is enough.
+static bool getSimilarVertexIndex_grid(
+	const glm::vec3 & in_vertex, const glm::vec2 & in_uv, const glm::vec3 & in_normal,
+	const std::vector<glm::vec3> & out_vertices, const std::vector<glm::vec2> & out_uvs, const std::vector<glm::vec3> & out_normals,
+	const WeldGrid & grid, size_t firstVertex,
+	unsigned int & result
+){
+	int x = weldCell(in_vertex.x), y = weldCell(in_vertex.y), z = weldCell(in_vertex.z);
+	unsigned int best = EMPTY_SLOT;
+	for (int dz = -1; dz <= 1; dz++)
+	for (int dy = -1; dy <= 1; dy++)
+	for (int dx = -1; dx <= 1; dx++){
+		unsigned int c = grid.find(x + dx, y + dy, z + dz);
+		if (c == EMPTY_SLOT)
+			continue;
+		for (unsigned int v = grid.cells[c].head; v != EMPTY_SLOT && v < best; v = grid.next[v]){
+			size_t i = firstVertex + v;
+			if (
+				is_near( in_vertex.x , out_vertices[i].x ) &&
+				is_near( in_vertex.y , out_vertices[i].y ) &&
+				is_near( in_vertex.z , out_vertices[i].z ) &&
+				is_near( in_uv.x     , out_uvs     [i].x ) &&
+				is_near( in_uv.y     , out_uvs     [i].y ) &&
+				is_near( in_normal.x , out_normals [i].x ) &&
+				is_near( in_normal.y , out_normals [i].y ) &&
+				is_near( in_normal.z , out_normals [i].z )
+			){
+				best = v;
+				break;
+			}
+		}
+	}
+	result = best;
+	return best != EMPTY_SLOT;
+}
+
+// indexVBO_TBN for both index widths : out_indices gets indices relative to firstVertex
+static void indexVBO_TBN_grid(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
 	std::vector<glm::vec3> & in_normals,
 	std::vector<glm::vec3> & in_tangents,
 	std::vector<glm::vec3> & in_bitangents,
 
-	std::vector<unsigned short> & out_indices,
+	std::vector<unsigned int> & out_indices,
 	std::vector<glm::vec3> & out_vertices,
 	std::vector<glm::vec2> & out_uvs,
 	std::vector<glm::vec3> & out_normals,
 	std::vector<glm::vec3> & out_tangents,
 	std::vector<glm::vec3> & out_bitangents
 ){
+	size_t firstVertex = out_vertices.size();
+	WeldGrid grid(in_vertices.size());
+	out_indices.resize(in_vertices.size());
+
 	// For each input vertex
 	for ( unsigned int i=0; i<in_vertices.size(); i++ ){
 
 		// Try to find a similar vertex in out_XXXX
-		unsigned short index;
-		bool found = getSimilarVertexIndex(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, index);
+		unsigned int index;
+		bool found = getSimilarVertexIndex_grid(in_vertices[i], in_uvs[i], in_normals[i],     out_vertices, out_uvs, out_normals, grid, firstVertex, index);
 
 		if ( found ){ // A similar vertex is already in the VBO, use it instead !
-			out_indices.push_back( index );
+			out_indices[i] = index;
 
 			// Average the tangents and the bitangents
-			out_tangents[index] += in_tangents[i];
-			out_bitangents[index] += in_bitangents[i];
+			out_tangents[firstVertex + index] += in_tangents[i];
+			out_bitangents[firstVertex + index] += in_bitangents[i];
 		}else{ // If not, it needs to be added in the output data.
 			out_vertices.push_back( in_vertices[i]);
 			out_uvs     .push_back( in_uvs[i]);
 			out_normals .push_back( in_normals[i]);
 			out_tangents .push_back( in_tangents[i]);
 			out_bitangents .push_back( in_bitangents[i]);
-			out_indices .push_back( (unsigned short)out_vertices.size() - 1 );
+			index = (unsigned int)(out_vertices.size() - 1 - firstVertex);
+			out_indices[i] = index;
+			grid.insert(weldCell(in_vertices[i].x), weldCell(in_vertices[i].y), weldCell(in_vertices[i].z), index);
 		}
 	}
 }
+
+void indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	std::vector<unsigned short> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+){
+	size_t firstVertex = out_vertices.size();
+	std::vector<unsigned int> indices;
+	indexVBO_TBN_grid(in_vertices, in_uvs, in_normals, in_tangents, in_bitangents,
+		indices, out_vertices, out_uvs, out_normals, out_tangents, out_bitangents);
+
+	// Past 65535 vertices these wrap around, like they always did : use the IndexBuffer version
+	for ( unsigned int i=0; i<indices.size(); i++ )
+		out_indices.push_back( (unsigned short)(firstVertex + indices[i]) );
+}
+
+void indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+){
+	size_t firstVertex = out_vertices.size();
+	std::vector<unsigned int> indices;
+	indexVBO_TBN_grid(in_vertices, in_uvs, in_normals, in_tangents, in_bitangents,
+		indices, out_vertices, out_uvs, out_normals, out_tangents, out_bitangents);
+
+	size_t firstIndex = growIndexBuffer(out_indices, indices.size(), out_vertices.size());
+	if (out_indices.wide){
+		out_indices.indices32.resize(firstIndex + indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+			out_indices.indices32[firstIndex + i] = (unsigned int)firstVertex + indices[i];
+	}else{
+		out_indices.indices16.resize(firstIndex + indices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+			out_indices.indices16[firstIndex + i] = (unsigned short)(firstVertex + indices[i]);
+	}
+}
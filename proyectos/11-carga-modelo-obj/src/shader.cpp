@@ -5,18 +5,392 @@
 #include <fstream>
 #include <algorithm>
 #include <sstream>
+#include <map>
+#include <unordered_map>
 using namespace std;
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <chrono>
 
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
 
 // #include "shader.hpp"
 #include <../include/common/shader.hpp>
 
+// What's at the start of every .programcache file, the binary from glGetProgramBinary follows
+struct ProgramCacheHeader{
+	char magic[8];                  // "PROGBIN" and PROGRAM_CACHE_VERSION
+	uint64_t key;                   // programKey of what the binary was linked from
+	uint32_t format;                // binaryFormat for glProgramBinary
+	uint32_t length;
+};
+
+static const char PROGRAM_CACHE_MAGIC[8] = { 'P','R','O','G','B','I','N', PROGRAM_CACHE_VERSION };
+
+static bool programBinarySupported(){
+	static int supported = -1;
+	if (supported < 0){
+		GLint formats = 0;
+		if (glGetProgramBinary != NULL && glProgramBinary != NULL && glProgramParameteri != NULL)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0 ? 1 : 0;
+		if (!supported)
+			printf("No program binary support, shaders are compiled on every run\n");
+	}
+	return supported == 1;
+}
+
+// FNV-1a, terminating zero included so "ab" + "c" and "a" + "bc" don't hash the same
+static uint64_t hashString(uint64_t hash, const char * text){
+	do {
+		hash = (hash ^ (unsigned char)*text) * 1099511628211ULL;
+	} while (*text++ != 0);
+	return hash;
+}
+
+// Sources, defines and driver : a binary is only good for the driver that made it
+static uint64_t programKey(const char * const * sources, int count, const char * defines){
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < count; i++)
+		hash = hashString(hash, sources[i]);
+	hash = hashString(hash, defines);
+	const GLenum driver[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (int i = 0; i < 3; i++){
+		const char * name = (const char *)glGetString(driver[i]);
+		hash = hashString(hash, name != NULL ? name : "");
+	}
+	return hash;
+}
+
+// "<last shader path>.<hash of every path and the defines>.programcache" : programs that share a
+// shader, or the same shaders with other defines, each get their file instead of overwriting one
+static std::string programCachePath(const char * const * paths, int count, const char * defines){
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < count; i++)
+		hash = hashString(hash, paths[i]);
+	hash = hashString(hash, defines);
+	char suffix[40];
+	snprintf(suffix, sizeof(suffix), ".%016llx.programcache", (unsigned long long)hash);
+	return std::string(paths[count - 1]) + suffix;
+}
+
+// The program linked from the cache, or 0 if the cache is missing, stale, or rejected by the driver
+static GLuint loadProgramBinary(const std::string & cachePath, uint64_t key){
+	if (!programBinarySupported())
+		return 0;
+	FILE * file = fopen(cachePath.c_str(), "rb");
+	if (file == NULL)
+		return 0;
+	ProgramCacheHeader header;
+	std::vector<char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) == 0
+		&& header.key == key && header.length > 0;
+	if (valid){
+		binary.resize(header.length);
+		valid = fread(&binary[0], 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+	if (!valid)
+		return 0;
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header.format, &binary[0], header.length);
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE){
+		printf("%s was rejected by the driver, compiling again\n", cachePath.c_str());
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	return ProgramID;
+}
+
+static void saveProgramBinary(GLuint ProgramID, const std::string & cachePath, uint64_t key){
+	GLint Result = GL_FALSE, length = 0;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (!programBinarySupported() || Result != GL_TRUE)
+		return;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+	header.key = key;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(ProgramID, length, &length, &format, &binary[0]);
+	header.format = format;
+	header.length = (uint32_t)length;
+
+	// The header goes in last, so an interrupted write never looks like a valid cache
+	FILE * file = fopen(cachePath.c_str(), "wb");
+	bool written = false;
+	if (file){
+		ProgramCacheHeader blank;
+		memset(&blank, 0, sizeof(blank));
+		written = fwrite(&blank, sizeof(blank), 1, file) == 1
+			&& fwrite(&binary[0], 1, header.length, file) == header.length
+			&& fseek(file, 0, SEEK_SET) == 0
+			&& fwrite(&header, sizeof(header), 1, file) == 1;
+		written = (fclose(file) == 0) && written;
+	}
+	if (!written)
+		printf("Could not write %s, the program will be compiled again next run\n", cachePath.c_str());
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Locations of the active uniforms of each program, read once when it's linked
+static std::map<GLuint, std::unordered_map<std::string, GLint> > programUniforms;
+
+// Fills the uniform table of a linked program and binds its CameraBlock and DrawBlock, if it has them
+static void reflectProgram(GLuint ProgramID){
+	std::unordered_map<std::string, GLint> & Uniforms = programUniforms[ProgramID];
+	Uniforms.clear();
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE)
+		return;
+
+	GLint Count = 0, MaxLength = 0;
+	glGetProgramiv(ProgramID, GL_ACTIVE_UNIFORMS, &Count);
+	glGetProgramiv(ProgramID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &MaxLength);
+	std::vector<char> Name(MaxLength + 1);
+	for (GLint i = 0; i < Count; i++){
+		GLint Size;
+		GLenum Type;
+		glGetActiveUniform(ProgramID, i, (GLsizei)Name.size(), NULL, &Size, &Type, &Name[0]);
+		GLint Location = glGetUniformLocation(ProgramID, &Name[0]);
+		if (Location < 0)
+			continue; // In a uniform block
+		std::string Uniform(&Name[0]);
+		Uniforms[Uniform] = Location;
+		// Arrays are listed as "name[0]" ; they're also asked for as "name"
+		if (Uniform.size() > 3 && Uniform.compare(Uniform.size() - 3, 3, "[0]") == 0)
+			Uniforms[Uniform.substr(0, Uniform.size() - 3)] = Location;
+	}
+
+	GLuint Block = glGetUniformBlockIndex(ProgramID, "CameraBlock");
+	if (Block != GL_INVALID_INDEX)
+		glUniformBlockBinding(ProgramID, Block, CAMERA_BLOCK_BINDING);
+	Block = glGetUniformBlockIndex(ProgramID, "DrawBlock");
+	if (Block != GL_INVALID_INDEX)
+		glUniformBlockBinding(ProgramID, Block, DRAW_BLOCK_BINDING);
+}
+
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// A program handed to the driver by QueueShaders whose status hasn't been asked for yet
+struct PendingProgram{
+	GLuint ProgramID;
+	std::vector<GLuint> ShaderIDs;
+	std::string Name;
+	std::string CachePath;
+	uint64_t Key;
+	std::chrono::steady_clock::time_point start;
+};
+
+static std::vector<PendingProgram> pendingPrograms;
+
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+// KHR_parallel_shader_compile (or its ARB twin), not part of the glad we're generated with.
+// Some drivers only compile in the background once told how many threads they may use.
+static bool parallelCompileSupported(){
+	static int supported = -1;
+	if (supported < 0){
+		supported = 0;
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count && !supported; i++){
+			const char * name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+			if (name != NULL && (strcmp(name, "GL_KHR_parallel_shader_compile") == 0 || strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+				supported = 1;
+		}
+		MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+		if (maxThreads == NULL)
+			maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+		if (supported && maxThreads != NULL)
+			maxThreads(0xFFFFFFFF); // As many as the driver likes
+	}
+	return supported == 1;
+}
+
+// "A B=2" (names split by spaces, commas or semicolons) as #define lines, and the names back as "A B=2"
+static void parseDefines(const char * defines, std::string & lines, std::string & names){
+	std::string name;
+	for (const char * c = defines; ; c++){
+		if (*c != 0 && *c != ' ' && *c != ',' && *c != ';' && *c != '\t' && *c != '\n'){
+			name += *c;
+			continue;
+		}
+		if (!name.empty()){
+			size_t equals = name.find('=');
+			lines += "#define " + (equals == std::string::npos ? name : name.substr(0, equals) + " " + name.substr(equals + 1)) + "\n";
+			names += (names.empty() ? "" : " ") + name;
+			name.clear();
+		}
+		if (*c == 0)
+			break;
+	}
+}
+
+// The source of path with each #include "file" (relative to the file that includes it) replaced
+// by that file, once, and the define lines right after #version (at the very top if there's none).
+// #line directives keep the line numbers of the logs, files being numbered in the order they're
+// met, 0 the one that was asked for.
+static bool preprocessShader(const std::string & path, const std::string & defineLines, std::string & out, std::vector<std::string> & files){
+
+	std::ifstream Stream(path.c_str(), std::ios::in);
+	if (!Stream.is_open()){
+		printf("Impossible to open %s. Are you in the right directory ?\n", path.c_str());
+		return false;
+	}
+	int Index = (int)files.size();
+	files.push_back(path);
+	std::string Directory = path.substr(0, path.find_last_of("/\\") + 1);
+	if (Index > 0)
+		out += "#line 1 " + std::to_string(Index) + "\n";
+	size_t Start = out.size();
+	bool DefinesPlaced = defineLines.empty();
+
+	std::string Line;
+	int Number = 0;
+	while (std::getline(Stream, Line)){
+		Number++;
+		size_t First = Line.find_first_not_of(" \t");
+		if (First != std::string::npos && Line.compare(First, 8, "#include") == 0){
+			size_t Open = Line.find('"', First + 8);
+			size_t Close = Open != std::string::npos ? Line.find('"', Open + 1) : std::string::npos;
+			if (Close == std::string::npos){
+				printf("%s:%d : #include wants a \"file\"\n", path.c_str(), Number);
+				return false;
+			}
+			std::string Included = Directory + Line.substr(Open + 1, Close - Open - 1);
+			if (std::find(files.begin(), files.end(), Included) == files.end()
+				&& !preprocessShader(Included, std::string(), out, files))
+				return false;
+			out += "#line " + std::to_string(Number + 1) + " " + std::to_string(Index) + "\n";
+			continue;
+		}
+		out += Line + "\n";
+		if (Index == 0 && !DefinesPlaced && First != std::string::npos && Line.compare(First, 8, "#version") == 0){
+			out += defineLines + "#line " + std::to_string(Number + 1) + " 0\n";
+			DefinesPlaced = true;
+		}
+	}
+	// No #version (GLSL 1.10) : nothing has to come before them
+	if (Index == 0 && !DefinesPlaced)
+		out.insert(Start, defineLines + "#line 1 0\n");
+	return true;
+}
+
+static GLuint queueProgram(const char * const * paths, const GLenum * types, int count, const char * defines){
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::string DefineLines, DefineNames;
+	parseDefines(defines, DefineLines, DefineNames);
+
+	std::vector<std::string> Codes(count);
+	std::vector<const char *> Sources(count);
+	std::string Name;
+	for (int i = 0; i < count; i++){
+		std::vector<std::string> Files;
+		if (!preprocessShader(paths[i], DefineLines, Codes[i], Files))
+			return 0;
+		Sources[i] = Codes[i].c_str();
+		Name += (i > 0 ? std::string(" + ") : std::string()) + paths[i];
+	}
+
+	uint64_t Key = programKey(&Sources[0], count, DefineNames.c_str());
+	std::string CachePath = programCachePath(paths, count, DefineNames.c_str());
+	if (!DefineNames.empty())
+		Name += " [" + DefineNames + "]";
+	GLuint ProgramID = loadProgramBinary(CachePath, Key);
+	if (ProgramID != 0){
+		reflectProgram(ProgramID);
+		printf("Loaded program %s from its binary in %.2f ms\n", Name.c_str(), millisecondsSince(start));
+		return ProgramID;
+	}
+
+	// Compile and link without asking how it went, so the driver can work on it (and on the
+	// programs queued after it) while the caller does something else
+	PendingProgram Pending;
+	parallelCompileSupported();
+	ProgramID = glCreateProgram();
+	for (int i = 0; i < count; i++){
+		GLuint ShaderID = glCreateShader(types[i]);
+		glShaderSource(ShaderID, 1, &Sources[i], NULL);
+		glCompileShader(ShaderID);
+		glAttachShader(ProgramID, ShaderID);
+		Pending.ShaderIDs.push_back(ShaderID);
+	}
+	if (programBinarySupported())
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(ProgramID);
+
+	Pending.ProgramID = ProgramID;
+	Pending.Name = Name;
+	Pending.CachePath = CachePath;
+	Pending.Key = Key;
+	Pending.start = start;
+	pendingPrograms.push_back(Pending);
+	return ProgramID;
+}
+
+// The logs and the binary cache of a queued program ; this is where the driver gets waited for
+static void finishProgram(size_t index){
+	PendingProgram Pending = pendingPrograms[index];
+	pendingPrograms.erase(pendingPrograms.begin() + index);
+
+	int InfoLogLength;
+	for (size_t i = 0; i < Pending.ShaderIDs.size(); i++){
+		glGetShaderiv(Pending.ShaderIDs[i], GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if ( InfoLogLength > 0 ){
+			std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+			glGetShaderInfoLog(Pending.ShaderIDs[i], InfoLogLength, NULL, &ShaderErrorMessage[0]);
+			printf("%s\n", &ShaderErrorMessage[0]);
+		}
+	}
+	glGetProgramiv(Pending.ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+		glGetProgramInfoLog(Pending.ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+	}
+
+	for (size_t i = 0; i < Pending.ShaderIDs.size(); i++){
+		glDetachShader(Pending.ProgramID, Pending.ShaderIDs[i]);
+		glDeleteShader(Pending.ShaderIDs[i]);
+	}
+
+	GLint Result = GL_FALSE;
+	glGetProgramiv(Pending.ProgramID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE){
+		printf("Could not link program %s\n", Pending.Name.c_str());
+		return;
+	}
+	reflectProgram(Pending.ProgramID);
+	saveProgramBinary(Pending.ProgramID, Pending.CachePath, Pending.Key);
+	printf("Compiled program %s, ready %.2f ms after it was queued\n", Pending.Name.c_str(), millisecondsSince(Pending.start));
+}
+
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
 
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
@@ -45,6 +419,20 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 		FragmentShaderStream.close();
 	}
 
+	// Skip compiling if this exact program was linked on an earlier run
+	const char * Sources[2] = { VertexShaderCode.c_str(), FragmentShaderCode.c_str() };
+	uint64_t Key = programKey(Sources, 2, "");
+	const char * Paths[2] = { vertex_file_path, fragment_file_path };
+	std::string CachePath = programCachePath(Paths, 2, "");
+	GLuint CachedProgramID = loadProgramBinary(CachePath, Key);
+	if (CachedProgramID != 0){
+		glDeleteShader(VertexShaderID);
+		glDeleteShader(FragmentShaderID);
+		reflectProgram(CachedProgramID);
+		printf("Loaded program %s + %s from its binary in %.2f ms\n", vertex_file_path, fragment_file_path, millisecondsSince(start));
+		return CachedProgramID;
+	}
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -88,6 +476,8 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (programBinarySupported())
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -106,7 +496,124 @@ GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	reflectProgram(ProgramID);
+	saveProgramBinary(ProgramID, CachePath, Key);
+	printf("Compiled program %s + %s in %.2f ms\n", vertex_file_path, fragment_file_path, millisecondsSince(start));
+
+	return ProgramID;
+}
+
+GLuint QueueShaders(const char * vertex_file_path, const char * fragment_file_path){
+	const char * Paths[2] = { vertex_file_path, fragment_file_path };
+	const GLenum Types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	return queueProgram(Paths, Types, 2, "");
+}
+
+// Variants already asked for, by shaders and defines
+static std::map<std::string, GLuint> shaderVariants;
+
+GLuint QueueShaderVariant(const char * vertex_file_path, const char * fragment_file_path, const char * defines){
+	std::string DefineLines, DefineNames;
+	parseDefines(defines, DefineLines, DefineNames);
+	std::string VariantKey = std::string(vertex_file_path) + "\n" + fragment_file_path + "\n" + DefineNames;
+	std::map<std::string, GLuint>::iterator Found = shaderVariants.find(VariantKey);
+	if (Found != shaderVariants.end() && glIsProgram(Found->second))
+		return Found->second;
+
+	const char * Paths[2] = { vertex_file_path, fragment_file_path };
+	const GLenum Types[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	GLuint ProgramID = queueProgram(Paths, Types, 2, defines);
+	if (ProgramID != 0)
+		shaderVariants[VariantKey] = ProgramID;
 	return ProgramID;
 }
 
+bool ProgramReady(GLuint ProgramID){
+	for (size_t i = 0; i < pendingPrograms.size(); i++){
+		if (pendingPrograms[i].ProgramID != ProgramID)
+			continue;
+		// Without the extension there's no asking without waiting
+		if (!parallelCompileSupported())
+			return true;
+		GLint Done = GL_FALSE;
+		glGetProgramiv(ProgramID, GL_COMPLETION_STATUS_KHR, &Done);
+		return Done == GL_TRUE;
+	}
+	return true;
+}
+
+void UseProgram(GLuint ProgramID){
+	for (size_t i = 0; i < pendingPrograms.size(); i++){
+		if (pendingPrograms[i].ProgramID == ProgramID){
+			finishProgram(i);
+			break;
+		}
+	}
+	glUseProgram(ProgramID);
+}
+
+GLint UniformLocation(GLuint ProgramID, const char * name){
+	std::map<GLuint, std::unordered_map<std::string, GLint> >::iterator Program = programUniforms.find(ProgramID);
+	if (Program == programUniforms.end()){
+		// Still queued, or linked somewhere else
+		for (size_t i = 0; i < pendingPrograms.size(); i++){
+			if (pendingPrograms[i].ProgramID == ProgramID){
+				finishProgram(i);
+				break;
+			}
+		}
+		if (programUniforms.find(ProgramID) == programUniforms.end())
+			reflectProgram(ProgramID);
+		Program = programUniforms.find(ProgramID);
+	}
+	std::unordered_map<std::string, GLint>::const_iterator Uniform = Program->second.find(name);
+	return Uniform != Program->second.end() ? Uniform->second : -1;
+}
+
+void DeleteProgram(GLuint ProgramID){
+	for (size_t i = 0; i < pendingPrograms.size(); i++){
+		if (pendingPrograms[i].ProgramID == ProgramID){
+			for (size_t j = 0; j < pendingPrograms[i].ShaderIDs.size(); j++)
+				glDeleteShader(pendingPrograms[i].ShaderIDs[j]);
+			pendingPrograms.erase(pendingPrograms.begin() + i);
+			break;
+		}
+	}
+	programUniforms.erase(ProgramID);
+	for (std::map<std::string, GLuint>::iterator Variant = shaderVariants.begin(); Variant != shaderVariants.end(); ){
+		if (Variant->second == ProgramID)
+			Variant = shaderVariants.erase(Variant);
+		else
+			++Variant;
+	}
+	glDeleteProgram(ProgramID);
+}
+
+// What CameraBlock holds, in std140 : each mat4 is 4 vec4 columns, the same as glm's
+struct CameraBlockData{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+};
+
+static GLuint cameraBuffer = 0;
 
+void UpdateCameraBlock(const glm::mat4 & view, const glm::mat4 & projection){
+	CameraBlockData Data;
+	Data.view = view;
+	Data.projection = projection;
+	Data.viewProjection = projection * view;
+	if (cameraBuffer == 0){
+		glGenBuffers(1, &cameraBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Data), NULL, GL_DYNAMIC_DRAW);
+	} else
+		glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Data), &Data);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, cameraBuffer);
+}
+
+void DeleteCameraBlock(){
+	glDeleteBuffers(1, &cameraBuffer);
+	cameraBuffer = 0;
+}
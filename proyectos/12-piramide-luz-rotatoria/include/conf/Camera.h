@@ -19,6 +19,8 @@ public:
 	glm::vec3 Orientation = glm::vec3(0.0f, 0.0f, -1.0f);
 	glm::vec3 Up = glm::vec3(0.0f, 1.0f, 0.0f);
 	glm::mat4 cameraMatrix = glm::mat4(1.0f);
+	// Uniform buffer with the CameraBlock (camera matrix and position) that all shaders share
+	GLuint block;
 
 	// Prevents the camera from jumping around when first clicking left click
 	bool firstClick = true;
@@ -34,10 +36,12 @@ public:
 	// Camera constructor to set up initial values
 	Camera(int width, int height, glm::vec3 position);
 
-	// Updates the camera matrix to the Vertex Shader
+	// Updates the camera matrix and uploads it, with the position, to the CameraBlock of every shader
 	void updateMatrix(float FOVdeg, float nearPlane, float farPlane);
-	// Exports the camera matrix to a shader
+	// Exports the camera matrix to a shader that doesn't use the CameraBlock
 	void Matrix(Shader& shader, const char* uniform);
+	// Deletes the uniform buffer
+	void Delete();
 	// Handles camera inputs
 	void Inputs(GLFWwindow* window);
 };
@@ -3,6 +3,7 @@
 
 #include<glad/glad.h>
 #include"VBO.h"
+#include"VertexLayout.h"
 
 class VAO
 {
@@ -14,6 +15,14 @@ public:
 
 	// Links a VBO Attribute such as a position or color to the VAO
 	void LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset);
+	// Links every attribute of a VertexLayout at once, with the stride and offsets it worked out
+	template<typename Layout>
+	void LinkLayout(VBO& VBO)
+	{
+		VBO.Bind();
+		Layout::Link();
+		VBO.Unbind();
+	}
 	// Binds the VAO
 	void Bind();
 	// Unbinds the VAO
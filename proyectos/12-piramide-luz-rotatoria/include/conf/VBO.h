@@ -9,7 +9,8 @@ public:
 	// Reference ID of the Vertex Buffer Object
 	GLuint ID;
 	// Constructor that generates a Vertex Buffer Object and links it to vertices
-	VBO(GLfloat* vertices, GLsizeiptr size);
+	// (floats, or an array of the vertex struct of a VertexLayout)
+	VBO(const void* vertices, GLsizeiptr size);
 
 	// Binds the VBO
 	void Bind();
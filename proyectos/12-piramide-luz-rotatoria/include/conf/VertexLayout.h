@@ -0,0 +1,150 @@
+#ifndef VERTEX_LAYOUT_CLASS_H
+#define VERTEX_LAYOUT_CLASS_H
+
+#include<cstddef>
+#include<type_traits>
+#include<glad/glad.h>
+#include<glm/glm.hpp>
+#include<glm/gtc/type_precision.hpp>
+
+// Vertex layouts worked out by the compiler: the vertex is a struct, each attribute names one of
+// its fields and a shader location, and the stride, offsets, GL types and normalization all come
+// from the types of the fields. A field type with no GL format, two attributes on one location or
+// a struct the offsets can't be taken from doesn't compile.
+//
+//   struct Vertex { glm::vec3 position; glm::u8vec4 color; };
+//   typedef VertexLayout<Vertex, VERTEX_ATTRIB(Vertex, position, 0), VERTEX_ATTRIB(Vertex, color, 1)> Layout;
+//   VAO1.LinkLayout<Layout>(VBO1);
+
+
+// Two 16 bit floats, read as a vec2 by the shader
+struct Half2
+{
+	GLushort x, y;
+	Half2() = default;
+	Half2(glm::vec2 value);
+};
+
+// Four 16 bit floats, read as a vec4 by the shader
+struct Half4
+{
+	GLushort x, y, z, w;
+	Half4() = default;
+	Half4(glm::vec4 value);
+};
+
+// A direction in 32 bits: x, y and z get 10 bits each as [-1, 1] and w the last 2,
+// read as a vec4 by the shader (GL_INT_2_10_10_10_REV, normalized)
+struct Packed1010102
+{
+	GLuint bits;
+	Packed1010102() = default;
+	Packed1010102(glm::vec3 value, float w = 0.0f);
+};
+static_assert(sizeof(Packed1010102) == 4, "Packed1010102 must be a single 32 bit word");
+
+// Turns a float into the bits of a 16 bit float (rounding to nearest)
+GLushort FloatToHalf(float value);
+
+
+// How OpenGL reads each type a vertex field can have. Integers that aren't normalized
+// stay integers in the shader (ivec / uvec), through glVertexAttribIPointer
+template<typename T>
+struct AttribFormat
+{
+	// Fails whenever a vertex field has a type with no format below
+	static_assert(sizeof(T) == 0, "This type has no vertex attribute format, add an AttribFormat for it");
+};
+
+template<GLint Components, GLenum Type, GLboolean Normalized, bool Integer = false>
+struct AttribFormatOf
+{
+	static constexpr GLint components = Components;
+	static constexpr GLenum type = Type;
+	static constexpr GLboolean normalized = Normalized;
+	static constexpr bool integer = Integer;
+};
+
+template<> struct AttribFormat<float>         : AttribFormatOf<1, GL_FLOAT, GL_FALSE> {};
+template<> struct AttribFormat<glm::vec2>     : AttribFormatOf<2, GL_FLOAT, GL_FALSE> {};
+template<> struct AttribFormat<glm::vec3>     : AttribFormatOf<3, GL_FLOAT, GL_FALSE> {};
+template<> struct AttribFormat<glm::vec4>     : AttribFormatOf<4, GL_FLOAT, GL_FALSE> {};
+template<> struct AttribFormat<Half2>         : AttribFormatOf<2, GL_HALF_FLOAT, GL_FALSE> {};
+template<> struct AttribFormat<Half4>         : AttribFormatOf<4, GL_HALF_FLOAT, GL_FALSE> {};
+template<> struct AttribFormat<glm::u8vec4>   : AttribFormatOf<4, GL_UNSIGNED_BYTE, GL_TRUE> {};  // Colors, 0 to 255 read as [0, 1]
+template<> struct AttribFormat<glm::i8vec4>   : AttribFormatOf<4, GL_BYTE, GL_TRUE> {};           // Directions, read as [-1, 1]
+template<> struct AttribFormat<glm::i16vec2>  : AttribFormatOf<2, GL_SHORT, GL_TRUE> {};
+template<> struct AttribFormat<glm::i16vec4>  : AttribFormatOf<4, GL_SHORT, GL_TRUE> {};
+template<> struct AttribFormat<glm::u16vec2>  : AttribFormatOf<2, GL_UNSIGNED_SHORT, GL_TRUE> {};
+template<> struct AttribFormat<Packed1010102> : AttribFormatOf<4, GL_INT_2_10_10_10_REV, GL_TRUE> {};
+template<> struct AttribFormat<GLint>         : AttribFormatOf<1, GL_INT, GL_FALSE, true> {};
+template<> struct AttribFormat<GLuint>        : AttribFormatOf<1, GL_UNSIGNED_INT, GL_FALSE, true> {};
+template<> struct AttribFormat<glm::ivec4>    : AttribFormatOf<4, GL_INT, GL_FALSE, true> {};
+
+// Bytes of one component of a GL type, 0 for the packed ones
+constexpr size_t ComponentSize(GLenum type)
+{
+	return type == GL_FLOAT || type == GL_INT || type == GL_UNSIGNED_INT ? 4
+		: type == GL_HALF_FLOAT || type == GL_SHORT || type == GL_UNSIGNED_SHORT ? 2
+		: type == GL_BYTE || type == GL_UNSIGNED_BYTE ? 1
+		: 0;
+}
+
+
+// One field of the vertex at a shader location. Use VERTEX_ATTRIB rather than spelling it out
+template<typename T, size_t Offset, GLuint Location>
+struct VertexAttrib
+{
+	typedef AttribFormat<typename std::remove_cv<T>::type> Format;
+	static constexpr size_t offset = Offset;
+	static constexpr GLuint location = Location;
+
+	// A format that doesn't cover the whole field (e.g. a glm type with padding) would read the wrong bytes
+	static_assert(ComponentSize(Format::type) == 0 || ComponentSize(Format::type) * Format::components == sizeof(T),
+		"The attribute format doesn't match the size of the field");
+	static_assert(Location < 16, "OpenGL only promises 16 attribute locations");
+
+	// Points the location to the field, in the VBO bound to GL_ARRAY_BUFFER
+	static void Link(GLsizei stride)
+	{
+		if (Format::integer)
+			glVertexAttribIPointer(Location, Format::components, Format::type, stride, (void*)Offset);
+		else
+			glVertexAttribPointer(Location, Format::components, Format::type, Format::normalized, stride, (void*)Offset);
+		glEnableVertexAttribArray(Location);
+	}
+};
+
+// field of Vertex, at the shader's layout (location = location)
+#define VERTEX_ATTRIB(Vertex, field, location) VertexAttrib<decltype(Vertex::field), offsetof(Vertex, field), location>
+
+
+// Whether a location shows up in the attributes after it
+template<typename... Attribs>
+struct UniqueLocations : std::true_type {};
+
+template<typename First, typename... Rest>
+struct UniqueLocations<First, Rest...> : std::integral_constant<bool,
+	((First::location != Rest::location) && ... && true) && UniqueLocations<Rest...>::value> {};
+
+
+// The whole vertex: a VBO of Vertex structs, one attribute per listed field
+template<typename Vertex, typename... Attribs>
+struct VertexLayout
+{
+	static constexpr GLsizei stride = sizeof(Vertex);
+	static constexpr size_t attribCount = sizeof...(Attribs);
+
+	// offsetof is only reliable on standard layout structs (no virtuals, no mixed access)
+	static_assert(std::is_standard_layout<Vertex>::value, "The vertex struct must be standard layout");
+	static_assert(sizeof...(Attribs) > 0, "A vertex layout needs at least one attribute");
+	static_assert(UniqueLocations<Attribs...>::value, "Two attributes use the same location");
+
+	// Sets up every attribute of the VAO that is bound, reading the VBO bound to GL_ARRAY_BUFFER
+	static void Link()
+	{
+		(Attribs::Link(stride), ...);
+	}
+};
+
+#endif
@@ -7,6 +7,14 @@
 #include<sstream>
 #include<iostream>
 #include<cerrno>
+#include<vector>
+#include<chrono>
+#include<cstdint>
+#include<cstring>
+#include<unordered_map>
+
+// Binding point of the CameraBlock uniform block, which the Camera keeps in a uniform buffer
+#define CAMERA_BLOCK_BINDING 0
 
 std::string get_file_contents(const char* filename);
 
@@ -15,16 +23,26 @@ class Shader
 public:
 	// Reference ID of the Shader Program
 	GLuint ID;
-	// Constructor that build the Shader Program from 2 different shaders
+	// Constructor that build the Shader Program from 2 different shaders.
+	// The linked program is kept in "<fragmentFile>.<hash of both paths>.programcache" and reused by later runs
+	// as long as both sources and the driver are the same.
 	Shader(const char* vertexFile, const char* fragmentFile);
 
+	// Location of a uniform, from the table made when the program was linked (-1 if it isn't used)
+	GLint Uniform(const char* name);
+
 	// Activates the Shader Program
 	void Activate();
 	// Deletes the Shader Program
 	void Delete();
 private:
+	// Locations of the active uniforms, by name
+	std::unordered_map<std::string, GLint> uniforms;
+
 	// Checks if the different Shaders have compiled properly
 	void compileErrors(unsigned int shader, const char* type);
+	// Fills the uniforms table and binds the CameraBlock, if the program has one
+	void reflect();
 };
 
 
@@ -19,8 +19,12 @@ uniform sampler2D tex0;
 uniform vec4 lightColor;
 // Gets the position of the light from the main function
 uniform vec3 lightPos;
-// Gets the position of the camera from the main function
-uniform vec3 camPos;
+// Imports the camera matrix and position from the Camera, shared by all the shaders
+layout (std140) uniform CameraBlock
+{
+	mat4 camMatrix;
+	vec3 camPos;
+};
 
 void main()
 {
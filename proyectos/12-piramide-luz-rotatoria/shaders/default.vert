@@ -19,8 +19,12 @@ out vec3 Normal;
 // Outputs the current position for the Fragment Shader
 out vec3 crntPos;
 
-// Imports the camera matrix from the main function
-uniform mat4 camMatrix;
+// Imports the camera matrix and position from the Camera, shared by all the shaders
+layout (std140) uniform CameraBlock
+{
+	mat4 camMatrix;
+	vec3 camPos;
+};
 // Imports the model matrix from the main function
 uniform mat4 model;
 
@@ -3,7 +3,13 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 camMatrix;
+
+// Imports the camera matrix and position from the Camera, shared by all the shaders
+layout (std140) uniform CameraBlock
+{
+	mat4 camMatrix;
+	vec3 camPos;
+};
 
 void main()
 {
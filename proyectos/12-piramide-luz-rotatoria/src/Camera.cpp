@@ -7,6 +7,12 @@ Camera::Camera(int width, int height, glm::vec3 position)
 	Camera::width = width;
 	Camera::height = height;
 	Position = position;
+
+	// Creates the uniform buffer of the CameraBlock : mat4 camMatrix, then vec3 camPos padded to a vec4 (std140)
+	glGenBuffers(1, &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, block);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(glm::mat4) + sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 }
 
 void Camera::updateMatrix(float FOVdeg, float nearPlane, float farPlane)
@@ -22,12 +28,24 @@ void Camera::updateMatrix(float FOVdeg, float nearPlane, float farPlane)
 
 	// Sets new camera matrix
 	cameraMatrix = projection * view;
+
+	// Uploads the matrix and the position once for all the shaders, and binds the buffer for this frame
+	glm::vec4 position = glm::vec4(Position, 1.0f);
+	glBindBuffer(GL_UNIFORM_BUFFER, block);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(cameraMatrix));
+	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::vec4), glm::value_ptr(position));
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, block);
 }
 
 void Camera::Matrix(Shader& shader, const char* uniform)
 {
 	// Exports camera matrix
-	glUniformMatrix4fv(glGetUniformLocation(shader.ID, uniform), 1, GL_FALSE, glm::value_ptr(cameraMatrix));
+	glUniformMatrix4fv(shader.Uniform(uniform), 1, GL_FALSE, glm::value_ptr(cameraMatrix));
+}
+
+void Camera::Delete()
+{
+	glDeleteBuffers(1, &block);
 }
 
 
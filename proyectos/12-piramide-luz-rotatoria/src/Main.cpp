@@ -6,6 +6,7 @@ namespace fs = std::filesystem;
 //------------------------------
 
 #include<iostream>
+#include<vector>
 #include<glad/glad.h>
 #include<GLFW/glfw3.h>
 #include<stb/stb_image.h>
@@ -16,6 +17,7 @@ namespace fs = std::filesystem;
 #include<../include/conf/Texture.h>
 #include<../include/conf/shaderClass.h>
 #include<../include/conf/VAO.h>
+#include<../include/conf/VertexLayout.h>
 #include<../include/conf/VBO.h>
 #include<../include/conf/EBO.h>
 #include<../include/conf/Camera.h>
@@ -26,29 +28,65 @@ const unsigned int height = 800;
 
 
 
+// Lo que lleva cada vertice : el VertexLayout saca de aqui el stride, los offsets y los tipos
+struct Vertex
+{
+	glm::vec3 position;
+	glm::vec3 color;
+	glm::vec2 texUV;
+	glm::vec3 normal;  // Not necessarily normalized
+};
+typedef VertexLayout<Vertex,
+	VERTEX_ATTRIB(Vertex, position, 0),
+	VERTEX_ATTRIB(Vertex, color, 1),
+	VERTEX_ATTRIB(Vertex, texUV, 2),
+	VERTEX_ATTRIB(Vertex, normal, 3)> VertexLayoutPiramide;
+
+// El mismo vertice en 24 bytes en vez de 44 : color en bytes, UV en half floats y la normal en 10:10:10:2.
+// El shader no cambia, OpenGL los lee como floats
+struct PackedVertex
+{
+	glm::vec3 position;
+	glm::u8vec4 color;
+	Half2 texUV;
+	Packed1010102 normal;
+
+	PackedVertex(const Vertex& vertex)
+		: position(vertex.position), color(glm::round(glm::vec4(vertex.color, 1.0f) * 255.0f)),
+		  texUV(vertex.texUV), normal(glm::normalize(vertex.normal)) {}
+};
+typedef VertexLayout<PackedVertex,
+	VERTEX_ATTRIB(PackedVertex, position, 0),
+	VERTEX_ATTRIB(PackedVertex, color, 1),
+	VERTEX_ATTRIB(PackedVertex, texUV, 2),
+	VERTEX_ATTRIB(PackedVertex, normal, 3)> PackedVertexLayoutPiramide;
+
+// true : la piramide va a la GPU con PackedVertex
+const bool usarVerticesCompactos = true;
+
 // Vertices coordinates
-GLfloat vertices[] =
-{ //     COORDINATES     /        COLORS          /    TexCoord   /        NORMALS       //
-	-0.5f, 0.0f,  0.5f,     0.83f, 0.70f, 0.44f, 	 0.0f, 0.0f,      0.0f, -1.0f, 0.0f, // Bottom side
-	-0.5f, 0.0f, -0.5f,     0.83f, 0.70f, 0.44f,	 0.0f, 5.0f,      0.0f, -1.0f, 0.0f, // Bottom side
-	 0.5f, 0.0f, -0.5f,     0.83f, 0.70f, 0.44f,	 5.0f, 5.0f,      0.0f, -1.0f, 0.0f, // Bottom side
-	 0.5f, 0.0f,  0.5f,     0.83f, 0.70f, 0.44f,	 5.0f, 0.0f,      0.0f, -1.0f, 0.0f, // Bottom side
-
-	-0.5f, 0.0f,  0.5f,     0.83f, 0.70f, 0.44f, 	 0.0f, 0.0f,     -0.8f, 0.5f,  0.0f, // Left Side
-	-0.5f, 0.0f, -0.5f,     0.83f, 0.70f, 0.44f,	 5.0f, 0.0f,     -0.8f, 0.5f,  0.0f, // Left Side
-	 0.0f, 0.8f,  0.0f,     0.92f, 0.86f, 0.76f,	 2.5f, 5.0f,     -0.8f, 0.5f,  0.0f, // Left Side
-
-	-0.5f, 0.0f, -0.5f,     0.83f, 0.70f, 0.44f,	 5.0f, 0.0f,      0.0f, 0.5f, -0.8f, // Non-facing side
-	 0.5f, 0.0f, -0.5f,     0.83f, 0.70f, 0.44f,	 0.0f, 0.0f,      0.0f, 0.5f, -0.8f, // Non-facing side
-	 0.0f, 0.8f,  0.0f,     0.92f, 0.86f, 0.76f,	 2.5f, 5.0f,      0.0f, 0.5f, -0.8f, // Non-facing side
-
-	 0.5f, 0.0f, -0.5f,     0.83f, 0.70f, 0.44f,	 0.0f, 0.0f,      0.8f, 0.5f,  0.0f, // Right side
-	 0.5f, 0.0f,  0.5f,     0.83f, 0.70f, 0.44f,	 5.0f, 0.0f,      0.8f, 0.5f,  0.0f, // Right side
-	 0.0f, 0.8f,  0.0f,     0.92f, 0.86f, 0.76f,	 2.5f, 5.0f,      0.8f, 0.5f,  0.0f, // Right side
-
-	 0.5f, 0.0f,  0.5f,     0.83f, 0.70f, 0.44f,	 5.0f, 0.0f,      0.0f, 0.5f,  0.8f, // Facing side
-	-0.5f, 0.0f,  0.5f,     0.83f, 0.70f, 0.44f, 	 0.0f, 0.0f,      0.0f, 0.5f,  0.8f, // Facing side
-	 0.0f, 0.8f,  0.0f,     0.92f, 0.86f, 0.76f,	 2.5f, 5.0f,      0.0f, 0.5f,  0.8f  // Facing side
+Vertex vertices[] =
+{ //       COORDINATES       /             COLORS            /       TexCoord       /           NORMALS          //
+	{ glm::vec3(-0.5f, 0.0f,  0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(0.0f, 0.0f), glm::vec3( 0.0f, -1.0f,  0.0f) }, // Bottom side
+	{ glm::vec3(-0.5f, 0.0f, -0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(0.0f, 5.0f), glm::vec3( 0.0f, -1.0f,  0.0f) }, // Bottom side
+	{ glm::vec3( 0.5f, 0.0f, -0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(5.0f, 5.0f), glm::vec3( 0.0f, -1.0f,  0.0f) }, // Bottom side
+	{ glm::vec3( 0.5f, 0.0f,  0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(5.0f, 0.0f), glm::vec3( 0.0f, -1.0f,  0.0f) }, // Bottom side
+
+	{ glm::vec3(-0.5f, 0.0f,  0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(0.0f, 0.0f), glm::vec3(-0.8f,  0.5f,  0.0f) }, // Left Side
+	{ glm::vec3(-0.5f, 0.0f, -0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(5.0f, 0.0f), glm::vec3(-0.8f,  0.5f,  0.0f) }, // Left Side
+	{ glm::vec3( 0.0f, 0.8f,  0.0f), glm::vec3(0.92f, 0.86f, 0.76f), glm::vec2(2.5f, 5.0f), glm::vec3(-0.8f,  0.5f,  0.0f) }, // Left Side
+
+	{ glm::vec3(-0.5f, 0.0f, -0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(5.0f, 0.0f), glm::vec3( 0.0f,  0.5f, -0.8f) }, // Non-facing side
+	{ glm::vec3( 0.5f, 0.0f, -0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(0.0f, 0.0f), glm::vec3( 0.0f,  0.5f, -0.8f) }, // Non-facing side
+	{ glm::vec3( 0.0f, 0.8f,  0.0f), glm::vec3(0.92f, 0.86f, 0.76f), glm::vec2(2.5f, 5.0f), glm::vec3( 0.0f,  0.5f, -0.8f) }, // Non-facing side
+
+	{ glm::vec3( 0.5f, 0.0f, -0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(0.0f, 0.0f), glm::vec3( 0.8f,  0.5f,  0.0f) }, // Right side
+	{ glm::vec3( 0.5f, 0.0f,  0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(5.0f, 0.0f), glm::vec3( 0.8f,  0.5f,  0.0f) }, // Right side
+	{ glm::vec3( 0.0f, 0.8f,  0.0f), glm::vec3(0.92f, 0.86f, 0.76f), glm::vec2(2.5f, 5.0f), glm::vec3( 0.8f,  0.5f,  0.0f) }, // Right side
+
+	{ glm::vec3( 0.5f, 0.0f,  0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(5.0f, 0.0f), glm::vec3( 0.0f,  0.5f,  0.8f) }, // Facing side
+	{ glm::vec3(-0.5f, 0.0f,  0.5f), glm::vec3(0.83f, 0.70f, 0.44f), glm::vec2(0.0f, 0.0f), glm::vec3( 0.0f,  0.5f,  0.8f) }, // Facing side
+	{ glm::vec3( 0.0f, 0.8f,  0.0f), glm::vec3(0.92f, 0.86f, 0.76f), glm::vec2(2.5f, 5.0f), glm::vec3( 0.0f,  0.5f,  0.8f) }  // Facing side
 };
 
 // Indices for vertices order
@@ -62,16 +100,23 @@ GLuint indices[] =
 	13, 15, 14 // Facing side
 };
 
-GLfloat lightVertices[] =
+// El cubo de luz solo tiene posiciones
+struct LightVertex
+{
+	glm::vec3 position;
+};
+typedef VertexLayout<LightVertex, VERTEX_ATTRIB(LightVertex, position, 0)> VertexLayoutLuz;
+
+LightVertex lightVertices[] =
 { //     COORDINATES     //
-	-0.1f, -0.1f,  0.1f,
-	-0.1f, -0.1f, -0.1f,
-	 0.1f, -0.1f, -0.1f,
-	 0.1f, -0.1f,  0.1f,
-	-0.1f,  0.1f,  0.1f,
-	-0.1f,  0.1f, -0.1f,
-	 0.1f,  0.1f, -0.1f,
-	 0.1f,  0.1f,  0.1f
+	{ glm::vec3(-0.1f, -0.1f,  0.1f) },
+	{ glm::vec3(-0.1f, -0.1f, -0.1f) },
+	{ glm::vec3( 0.1f, -0.1f, -0.1f) },
+	{ glm::vec3( 0.1f, -0.1f,  0.1f) },
+	{ glm::vec3(-0.1f,  0.1f,  0.1f) },
+	{ glm::vec3(-0.1f,  0.1f, -0.1f) },
+	{ glm::vec3( 0.1f,  0.1f, -0.1f) },
+	{ glm::vec3( 0.1f,  0.1f,  0.1f) }
 };
 
 GLuint lightIndices[] =
@@ -127,15 +172,17 @@ int main()
 	// Generates Vertex Array Object and binds it
 	VAO VAO1;
 	VAO1.Bind();
+	// Compacta los vertices si se pidio
+	std::vector<PackedVertex> packedVertices(vertices, vertices + sizeof(vertices) / sizeof(Vertex));
 	// Generates Vertex Buffer Object and links it to vertices
-	VBO VBO1(vertices, sizeof(vertices));
+	VBO VBO1 = usarVerticesCompactos ? VBO(packedVertices.data(), packedVertices.size() * sizeof(PackedVertex)) : VBO(vertices, sizeof(vertices));
 	// Generates Element Buffer Object and links it to indices
 	EBO EBO1(indices, sizeof(indices));
-	// Links VBO attributes such as coordinates and colors to VAO
-	VAO1.LinkAttrib(VBO1, 0, 3, GL_FLOAT, 11 * sizeof(float), (void*)0);
-	VAO1.LinkAttrib(VBO1, 1, 3, GL_FLOAT, 11 * sizeof(float), (void*)(3 * sizeof(float)));
-	VAO1.LinkAttrib(VBO1, 2, 2, GL_FLOAT, 11 * sizeof(float), (void*)(6 * sizeof(float)));
-	VAO1.LinkAttrib(VBO1, 3, 3, GL_FLOAT, 11 * sizeof(float), (void*)(8 * sizeof(float)));
+	// Links VBO attributes such as coordinates and colors to VAO, as the layout says
+	if (usarVerticesCompactos)
+		VAO1.LinkLayout<PackedVertexLayoutPiramide>(VBO1);
+	else
+		VAO1.LinkLayout<VertexLayoutPiramide>(VBO1);
 	// Unbind all to prevent accidentally modifying them
 	VAO1.Unbind();
 	VBO1.Unbind();
@@ -152,7 +199,7 @@ int main()
 	// Generates Element Buffer Object and links it to indices
 	EBO lightEBO(lightIndices, sizeof(lightIndices));
 	// Links VBO attributes such as coordinates and colors to VAO
-	lightVAO.LinkAttrib(lightVBO, 0, 3, GL_FLOAT, 3 * sizeof(float), (void*)0);
+	lightVAO.LinkLayout<VertexLayoutLuz>(lightVBO);
 	// Unbind all to prevent accidentally modifying them
 	lightVAO.Unbind();
 	lightVBO.Unbind();
@@ -169,13 +216,16 @@ int main()
 	pyramidModel = glm::translate(pyramidModel, pyramidPos);
 
 
+	// Ubicacion del unico uniform que cambia cada frame ; la camara va en el CameraBlock
+	GLint lightModelID = lightShader.Uniform("model");
+
 	lightShader.Activate();
-	glUniformMatrix4fv(glGetUniformLocation(lightShader.ID, "model"), 1, GL_FALSE, glm::value_ptr(lightModel));
-	glUniform4f(glGetUniformLocation(lightShader.ID, "lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
+	glUniformMatrix4fv(lightModelID, 1, GL_FALSE, glm::value_ptr(lightModel));
+	glUniform4f(lightShader.Uniform("lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
 	shaderProgram.Activate();
-	glUniformMatrix4fv(glGetUniformLocation(shaderProgram.ID, "model"), 1, GL_FALSE, glm::value_ptr(pyramidModel));
-	glUniform4f(glGetUniformLocation(shaderProgram.ID, "lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
-	glUniform3f(glGetUniformLocation(shaderProgram.ID, "lightPos"), lightPos.x, lightPos.y, lightPos.z);
+	glUniformMatrix4fv(shaderProgram.Uniform("model"), 1, GL_FALSE, glm::value_ptr(pyramidModel));
+	glUniform4f(shaderProgram.Uniform("lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
+	glUniform3f(shaderProgram.Uniform("lightPos"), lightPos.x, lightPos.y, lightPos.z);
 
 	std::string parentDir = (fs::current_path().fs::path::parent_path()).string();
 	std::string texPath = "../shaders/";
@@ -201,15 +251,12 @@ int main()
 
 		// Handles camera inputs
 		camera.Inputs(window);
-		// Updates and exports the camera matrix to the Vertex Shader
+		// Updates the camera matrix and exports it, with the camera Position for specular lighting,
+		// to the CameraBlock that both shaders read
 		camera.updateMatrix(45.0f, 0.1f, 100.0f);
 
 		// Tells OpenGL which Shader Program we want to use
 		shaderProgram.Activate();
-		// Exports the camera Position to the Fragment Shader for specular lighting
-		glUniform3f(glGetUniformLocation(shaderProgram.ID, "camPos"), camera.Position.x, camera.Position.y, camera.Position.z);
-		// Export the camMatrix to the Vertex Shader of the pyramid
-		camera.Matrix(shaderProgram, "camMatrix");
 		// Binds texture so that is appears in rendering
 		brickTex.Bind();
 		// Bind the VAO so OpenGL knows to use it
@@ -232,9 +279,7 @@ int main()
         lightModel = glm::translate(lightModel, lightPos - pyramidPos);
 
         lightShader.Activate();
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.ID, "model"), 1, GL_FALSE, glm::value_ptr(lightModel));
-        glUniform4f(glGetUniformLocation(lightShader.ID, "lightColor"), lightColor.x, lightColor.y, lightColor.z, lightColor.w);
-        camera.Matrix(lightShader, "camMatrix");
+        glUniformMatrix4fv(lightModelID, 1, GL_FALSE, glm::value_ptr(lightModel));
         lightVAO.Bind();
         glDrawElements(GL_TRIANGLES, sizeof(lightIndices) / sizeof(int), GL_UNSIGNED_INT, 0);
 
@@ -255,6 +300,7 @@ int main()
 	lightVBO.Delete();
 	lightEBO.Delete();
 	lightShader.Delete();
+	camera.Delete();
 	// Delete window before ending the program
 	glfwDestroyWindow(window);
 	// Terminate GLFW before ending the program
@@ -46,7 +46,7 @@ Texture::Texture(const char* image, GLenum texType, GLenum slot, GLenum format,
 void Texture::texUnit(Shader& shader, const char* uniform, GLuint unit)
 {
 	// Gets the location of the uniform
-	GLuint texUni = glGetUniformLocation(shader.ID, uniform);
+	GLint texUni = shader.Uniform(uniform);
 	// Shader needs to be activated before changing the value of a uniform
 	shader.Activate();
 	// Sets the value of the uniform
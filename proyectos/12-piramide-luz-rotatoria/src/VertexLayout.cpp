@@ -0,0 +1,72 @@
+#include<cstring>
+#include<cmath>
+#include<../include/conf/VertexLayout.h>
+
+// Turns a float into the bits of a 16 bit float (rounding to nearest)
+GLushort FloatToHalf(float value)
+{
+	// Works on the bits of the float: 1 sign, 8 exponent and 23 mantissa bits
+	GLuint bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	GLuint sign = (bits >> 16) & 0x8000;
+	GLint exponent = (GLint)((bits >> 23) & 0xFF) - 127 + 15;
+	GLuint mantissa = bits & 0x7FFFFF;
+
+	// NaN stays NaN, infinity and anything too big become infinity
+	if (((bits >> 23) & 0xFF) == 0xFF)
+		return (GLushort)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31)
+		return (GLushort)(sign | 0x7C00);
+	// Too small even for a denormal half: zero with the same sign
+	if (exponent < -10)
+		return (GLushort)sign;
+	// Denormal half: the implicit 1 becomes part of the mantissa
+	if (exponent <= 0)
+	{
+		mantissa |= 0x800000;
+		GLuint shift = 14 - exponent;
+		GLuint half = mantissa >> shift;
+		// Round to nearest, ties to even
+		GLuint rest = mantissa & ((1u << shift) - 1);
+		GLuint halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return (GLushort)(sign | half);
+	}
+	// Normal half: drop 13 bits of mantissa, rounding (a carry into the exponent is still right)
+	GLuint half = sign | ((GLuint)exponent << 10) | (mantissa >> 13);
+	GLuint rest = mantissa & 0x1FFF;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return (GLushort)half;
+}
+
+// Two 16 bit floats, read as a vec2 by the shader
+Half2::Half2(glm::vec2 value)
+{
+	x = FloatToHalf(value.x);
+	y = FloatToHalf(value.y);
+}
+
+// Four 16 bit floats, read as a vec4 by the shader
+Half4::Half4(glm::vec4 value)
+{
+	x = FloatToHalf(value.x);
+	y = FloatToHalf(value.y);
+	z = FloatToHalf(value.z);
+	w = FloatToHalf(value.w);
+}
+
+// Signed normalized value of the given bits, as OpenGL reads it back: round(v * (2^(bits-1) - 1))
+static GLuint PackSnorm(float value, int bits)
+{
+	float scale = (float)((1 << (bits - 1)) - 1);
+	GLint packed = (GLint)std::lround(glm::clamp(value, -1.0f, 1.0f) * scale);
+	return (GLuint)packed & ((1u << bits) - 1);
+}
+
+// A direction in 32 bits: x, y and z get 10 bits each as [-1, 1] and w the last 2
+Packed1010102::Packed1010102(glm::vec3 value, float w)
+{
+	bits = PackSnorm(value.x, 10) | (PackSnorm(value.y, 10) << 10) | (PackSnorm(value.z, 10) << 20) | (PackSnorm(w, 2) << 30);
+}
@@ -1,5 +1,159 @@
 // #include"shaderClass.h"
 #include<../include/conf/shaderClass.h>
+#include<GLFW/glfw3.h>
+#include<iomanip>
+
+// Program binaries are GL 4.1 (or ARB_get_program_binary), newer than what glad was generated for
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+
+static GetProgramBinaryProc getProgramBinary = NULL;
+static ProgramBinaryProc programBinary = NULL;
+static ProgramParameteriProc programParameteri = NULL;
+
+// Bump whenever the layout of .programcache files changes
+static const char programCacheMagic[8] = { 'P','R','O','G','B','I','N', 1 };
+
+// What's at the start of every .programcache file, the binary follows
+struct ProgramCacheHeader
+{
+	char magic[8];
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+// Looks the program binary functions up the first time, and checks the driver has a binary format
+static bool programBinarySupported()
+{
+	static int supported = -1;
+	if (supported < 0)
+	{
+		getProgramBinary = (GetProgramBinaryProc)glfwGetProcAddress("glGetProgramBinary");
+		programBinary = (ProgramBinaryProc)glfwGetProcAddress("glProgramBinary");
+		programParameteri = (ProgramParameteriProc)glfwGetProcAddress("glProgramParameteri");
+		GLint formats = 0;
+		if (getProgramBinary != NULL && programBinary != NULL && programParameteri != NULL)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		supported = formats > 0 ? 1 : 0;
+		if (!supported)
+			std::cout << "No program binary support, shaders are compiled on every run" << std::endl;
+	}
+	return supported == 1;
+}
+
+// FNV-1a of the sources, the defines and the driver, since a binary only works on the driver that made it
+static uint64_t programKey(const std::string& vertexCode, const std::string& fragmentCode, const char* defines)
+{
+	const GLubyte* vendor = glGetString(GL_VENDOR);
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	const GLubyte* version = glGetString(GL_VERSION);
+	const char* parts[6] = {
+		vertexCode.c_str(), fragmentCode.c_str(), defines,
+		vendor ? (const char*)vendor : "", renderer ? (const char*)renderer : "", version ? (const char*)version : ""
+	};
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < 6; i++)
+	{
+		// The terminating zero goes in too, so "ab" + "c" and "a" + "bc" differ
+		const char* c = parts[i];
+		do
+		{
+			hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+		} while (*c++ != 0);
+	}
+	return hash;
+}
+
+// "<fragment path>.<hash of both paths>.programcache" : programs that share a fragment shader
+// each get their file instead of overwriting one
+static std::string programCachePath(const char* vertexFile, const char* fragmentFile)
+{
+	const char* paths[2] = { vertexFile, fragmentFile };
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < 2; i++)
+	{
+		const char* c = paths[i];
+		do
+		{
+			hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+		} while (*c++ != 0);
+	}
+	std::ostringstream path;
+	path << fragmentFile << "." << std::hex << std::setw(16) << std::setfill('0') << hash << ".programcache";
+	return path.str();
+}
+
+// Returns the program linked from the cache file, or 0 if it's missing, stale or rejected by the driver
+static GLuint loadProgramBinary(const std::string& cachePath, uint64_t key)
+{
+	if (!programBinarySupported())
+		return 0;
+	std::ifstream in(cachePath, std::ios::binary);
+	if (!in)
+		return 0;
+	ProgramCacheHeader header;
+	std::vector<char> binary;
+	bool valid = in.read((char*)&header, sizeof(header))
+		&& memcmp(header.magic, programCacheMagic, sizeof(header.magic)) == 0
+		&& header.key == key && header.length > 0;
+	if (valid)
+	{
+		binary.resize(header.length);
+		valid = (bool)in.read(&binary[0], binary.size());
+	}
+	if (!valid)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	programBinary(program, header.format, &binary[0], header.length);
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE)
+	{
+		std::cout << cachePath << " was rejected by the driver, compiling again" << std::endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+// Writes the linked program to the cache file, header last so a half written file is never valid
+static void saveProgramBinary(GLuint program, const std::string& cachePath, uint64_t key)
+{
+	GLint linked = GL_FALSE, length = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!programBinarySupported() || linked != GL_TRUE)
+		return;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, programCacheMagic, sizeof(header.magic));
+	header.key = key;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	getProgramBinary(program, length, &length, &format, &binary[0]);
+	header.format = format;
+	header.length = (uint32_t)length;
+
+	ProgramCacheHeader blank;
+	memset(&blank, 0, sizeof(blank));
+	std::ofstream out(cachePath, std::ios::binary);
+	out.write((const char*)&blank, sizeof(blank));
+	out.write(&binary[0], header.length);
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(header));
+	out.close();
+	if (!out)
+		std::cout << "Could not write " << cachePath << ", the program will be compiled again next run" << std::endl;
+}
 
 // Reads a text file and outputs a string with everything in the text file
 std::string get_file_contents(const char* filename)
@@ -25,6 +179,20 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 	std::string vertexCode = get_file_contents(vertexFile);
 	std::string fragmentCode = get_file_contents(fragmentFile);
 
+	// Times the startup of the program, from the cache or compiled
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// Uses the program linked on an earlier run if the sources and the driver haven't changed
+	uint64_t key = programKey(vertexCode, fragmentCode, "");
+	std::string cachePath = programCachePath(vertexFile, fragmentFile);
+	ID = loadProgramBinary(cachePath, key);
+	if (ID != 0)
+	{
+		reflect();
+		std::cout << "Loaded program " << vertexFile << " + " << fragmentFile << " from its binary in "
+			<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+		return;
+	}
+
 	// Convert the shader source strings into character arrays
 	const char* vertexSource = vertexCode.c_str();
 	const char* fragmentSource = fragmentCode.c_str();
@@ -52,6 +220,9 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 	// Attach the Vertex and Fragment Shaders to the Shader Program
 	glAttachShader(ID, vertexShader);
 	glAttachShader(ID, fragmentShader);
+	// Lets the driver hand the linked program back for the cache
+	if (programBinarySupported())
+		programParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	// Wrap-up/Link all the shaders together into the Shader Program
 	glLinkProgram(ID);
 	// Checks if Shaders linked succesfully
@@ -61,6 +232,19 @@ Shader::Shader(const char* vertexFile, const char* fragmentFile)
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
 
+	// Looks the uniforms up once, instead of on every glUniform
+	reflect();
+	// Keeps the linked program for the next run
+	saveProgramBinary(ID, cachePath, key);
+	std::cout << "Compiled program " << vertexFile << " + " << fragmentFile << " in "
+		<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+}
+
+// Gets the location of a uniform without asking the driver
+GLint Shader::Uniform(const char* name)
+{
+	std::unordered_map<std::string, GLint>::const_iterator uniform = uniforms.find(name);
+	return uniform != uniforms.end() ? uniform->second : -1;
 }
 
 // Activates the Shader Program
@@ -69,10 +253,11 @@ void Shader::Activate()
 	glUseProgram(ID);
 }
 
-// Deletes the Shader Program
+// Deletes the Shader Program, and its uniform table with it
 void Shader::Delete()
 {
 	glDeleteProgram(ID);
+	uniforms.clear();
 }
 
 // Checks if the different Shaders have compiled properly
@@ -100,4 +285,39 @@ void Shader::compileErrors(unsigned int shader, const char* type)
 			std::cout << "SHADER_LINKING_ERROR for:" << type << "\n" << infoLog << std::endl;
 		}
 	}
-}
\ No newline at end of file
+}
+
+// Reads the active uniforms of the linked program into the table
+void Shader::reflect()
+{
+	uniforms.clear();
+	GLint linked = GL_FALSE;
+	glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+	if (linked != GL_TRUE)
+		return;
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(ID, i, (GLsizei)name.size(), NULL, &size, &type, &name[0]);
+		GLint location = glGetUniformLocation(ID, &name[0]);
+		// Uniforms inside a block have no location
+		if (location < 0)
+			continue;
+		std::string uniform(&name[0]);
+		uniforms[uniform] = location;
+		// Arrays are listed as "name[0]", and also asked for as "name"
+		if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+			uniforms[uniform.substr(0, uniform.size() - 3)] = location;
+	}
+
+	// Every program that declares the CameraBlock reads it from the same uniform buffer
+	GLuint block = glGetUniformBlockIndex(ID, "CameraBlock");
+	if (block != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, block, CAMERA_BLOCK_BINDING);
+}
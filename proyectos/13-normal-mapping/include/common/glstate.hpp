@@ -0,0 +1,50 @@
+#ifndef GLSTATE_HPP
+#define GLSTATE_HPP
+
+// Thin layer over the GL calls that change state. It remembers the last value set of each piece
+// of state, and a call asking for the value that's already there doesn't reach the driver, so a
+// render loop can say everything each draw needs without paying for what didn't change.
+// It only knows what went through it, and starts out knowing nothing : code that changes the same
+// state behind its back (loaders, other modules) has to be followed by resetGLState.
+
+// UseProgram (which also collects queued programs)
+void bindProgram(GLuint program);
+void bindVertexArray(GLuint vao);
+// Call before deleting a VAO : GL falls back to 0 if it was bound, and a new one may get its name
+void forgetVertexArray(GLuint vao);
+
+// glActiveTexture + glBindTexture ; the active unit is only changed when the binding changes
+void bindTexture(GLuint unit, GLenum target, GLuint texture);
+// The same as forgetVertexArray, for textures (every unit it's bound to) and buffers (every target)
+void forgetTexture(GLuint texture);
+void forgetBuffer(GLuint buffer);
+
+// Targets outside the VAO (GL_ARRAY_BUFFER, GL_PIXEL_UNPACK_BUFFER...), not GL_ELEMENT_ARRAY_BUFFER.
+// glBindBufferBase / glBindBufferRange also bind the generic target : reset it after using them.
+void bindBuffer(GLenum target, GLuint buffer);
+
+// glEnable / glDisable of GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_RASTERIZER_DISCARD...
+void setCapability(GLenum capability, bool enabled);
+void setBlendFunc(GLenum source, GLenum destination);
+void setDepthFunc(GLenum func);
+void setCullFace(GLenum face);
+
+// glUniform1i of a sampler of program, which must be the one in use. Kept per program, since
+// the value stays with the program : a sampler set once is never sent again.
+void setSamplerUniform(GLuint program, GLint location, GLint unit);
+
+// Forgets everything, so the next call of each kind goes to the driver
+void resetGLState();
+
+// true : printGLStateCounters prints. Off by default
+extern bool printGLStateCalls;
+
+// Call once a frame. printGLStateCounters prints, per frame since it last printed, how many calls
+// were asked for and how many of them were skipped, by kind of state, and starts counting again.
+void endGLStateFrame();
+void printGLStateCounters();
+
+// Calls skipped since the last printGLStateCounters
+unsigned long elidedGLStateCalls();
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MESHCACHE_HPP
+#define MESHCACHE_HPP
+
+#include "mappedfile.hpp"
+
+// Bump whenever the layout or the contents of .meshcache files change
+// (2 : the indexed caches hold loadOBJ_indexed's 32-bit indices and its tangent basis)
+#define MESH_CACHE_VERSION 2
+
+// Vertex streams of a model, read from "<model>.meshcache".
+// The pointers go straight into the mapped file : hand them to glBufferData as they are.
+struct MeshCache{
+	unsigned int vertexCount = 0;          // Elements in each vertex stream
+	unsigned int indexCount = 0;           // 0 for triangle soup
+	unsigned int indexSize = 0;            // 2 (unsigned short) or 4 (unsigned int) bytes
+	const glm::vec3 * vertices = NULL;
+	const glm::vec2 * uvs = NULL;
+	const glm::vec3 * normals = NULL;
+	const glm::vec3 * tangents = NULL;     // NULL when not stored
+	const glm::vec3 * bitangents = NULL;   // NULL when not stored
+	const void * indices = NULL;           // NULL for triangle soup
+
+	MappedFile file;
+	std::vector<char> memory;              // Used instead of file when the cache couldn't be written
+};
+
+// Opens the cache of sourcePath if it was built from the current contents of sourcePath.
+// The key is the size and modification time of the source, then a hash of its contents
+// if only the time changed (e.g. after a fresh checkout).
+bool openMeshCache(const char * sourcePath, MeshCache & cache);
+
+// Writes the cache of sourcePath and opens it. Pass empty vectors for the streams you don't have
+// and indices == NULL for triangle soup. If the file can't be written the streams are kept in memory.
+bool writeMeshCache(
+	const char * sourcePath,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<glm::vec3> & tangents,
+	const std::vector<glm::vec3> & bitangents,
+	const void * indices, unsigned int indexCount, unsigned int indexSize,
+	MeshCache & cache
+);
+
+void closeMeshCache(MeshCache & cache);
+
+// loadOBJ that only parses the file when there's no valid triangle-soup cache for it
+bool loadOBJ_cached(const char * path, MeshCache & cache);
+
+#endif
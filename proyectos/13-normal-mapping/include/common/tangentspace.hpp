@@ -11,5 +11,56 @@ void computeTangentBasis(
 	std::vector<glm::vec3> & bitangents
 );
 
+// Same output as computeTangentBasis, with the triangles split across threads
+// (threadCount == 0 uses one per core)
+void computeTangentBasis_parallel(
+	// inputs
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents,
+	unsigned int threadCount = 0
+);
+
+// Runs computeTangentBasis (one thread, then one per core) and the scalar version it replaced on the
+// same triangles, and checks every tangent and bitangent against it within epsilon (relative, for
+// components above 1). Prints the times and the largest error; true when every vertex is within epsilon.
+bool checkTangentBasis(
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	float epsilon = 1e-5f
+);
+
+// Tangent basis of an indexed mesh (e.g. from loadOBJ_indexed) : one tangent and bitangent per vertex,
+// from the angle-weighted sum over its triangles, orthonormalized against the normal.
+// Mirrored vertices get their tangent flipped, like computeTangentBasis does. Vertices shared by
+// mirrored and non-mirrored triangles are split, which appends to vertices, uvs and normals
+// and rewrites the indices of the mirrored triangles.
+void computeTangentBasis_indexed(
+	// inputs, and outputs when a vertex has to be split
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents
+);
+
+// Packs each vertex's tangent, bitangent and normal into one quaternion (x, y, z, w) of 16-bit snorms,
+// to be read as a normalized GL_SHORT vec4 and decoded in the vertex shader.
+// w is negative where the bitangent is cross(tangent, normal), i.e. the UVs are mirrored.
+void computeQTangents(
+	// inputs
+	std::vector<glm::vec3> & normals,
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents,
+	// output
+	std::vector<glm::i16vec4> & qtangents
+);
+
 
 #endif
\ No newline at end of file
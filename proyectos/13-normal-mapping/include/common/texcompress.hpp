@@ -0,0 +1,22 @@
+#ifndef TEXCOMPRESS_HPP
+#define TEXCOMPRESS_HPP
+
+// Block formats the compressor writes
+enum BlockFormat {
+	BLOCK_BC1,   // DXT1 : RGB, 4 bits per texel
+	BLOCK_BC3,   // DXT5 : RGBA, 8 bits per texel
+	BLOCK_BC5    // ATI2 / RGTC2 : red and green only, 8 bits per texel. For normal maps : rebuild z in the shader
+};
+
+// Compresses width x height RGBA texels (4 bytes each, in the row order glTexImage2D takes them)
+// and the whole mip chain below them into a DDS file loadDDS can read. Rows land in the file in
+// the same order, so the texture is sampled with the same UVs as the uncompressed one.
+// BLOCK_BC5 treats the texels as a normal map : the smaller levels are renormalized.
+// threadCount == 0 uses one thread per core.
+bool writeCompressedDDS(const char * path, const unsigned char * rgba, unsigned int width, unsigned int height,
+	BlockFormat format, unsigned int threadCount = 0);
+
+// Compresses a 24 bits .bmp into ddsPath, unless ddsPath is already newer than it and in that format
+bool compressBMP(const char * bmpPath, const char * ddsPath, BlockFormat format);
+
+#endif
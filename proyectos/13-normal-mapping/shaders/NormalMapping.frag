@@ -13,9 +13,10 @@ in vec3 EyeDirection_tangentspace;
 out vec3 color;
 
 // Values that stay constant for the whole mesh.
-uniform sampler2D DiffuseTextureSampler;
+uniform sampler2DArray MaterialTextureSampler; // Diffuse and specular, one layer each
 uniform sampler2D NormalTextureSampler;
-uniform sampler2D SpecularTextureSampler;
+uniform vec3 DiffuseLayer;  // xy : UV scale, z : layer
+uniform vec3 SpecularLayer;
 uniform mat4 V;
 uniform mat4 M;
 uniform mat3 MV3x3;
@@ -29,12 +30,18 @@ void main(){
 	float LightPower = 40.0;
 	
 	// Material properties
-	vec3 MaterialDiffuseColor = texture( DiffuseTextureSampler, UV ).rgb;
+	// The layers are clamped to their edge (padded ones would repeat their padding) : UV is wrapped here,
+	// V being negative. The gradients are the unwrapped ones, fract's jumps would pick the smallest mip
+	vec3 MaterialDiffuseColor = textureGrad( MaterialTextureSampler, vec3(fract(UV) * DiffuseLayer.xy, DiffuseLayer.z),
+		dFdx(UV * DiffuseLayer.xy), dFdy(UV * DiffuseLayer.xy) ).rgb;
 	vec3 MaterialAmbientColor = vec3(0.1,0.1,0.1) * MaterialDiffuseColor;
-	vec3 MaterialSpecularColor = texture( SpecularTextureSampler, UV ).rgb * 0.3;
+	vec3 MaterialSpecularColor = textureGrad( MaterialTextureSampler, vec3(fract(UV) * SpecularLayer.xy, SpecularLayer.z),
+		dFdx(UV * SpecularLayer.xy), dFdy(UV * SpecularLayer.xy) ).rgb * 0.3;
 
-	// Local normal, in tangent space. V tex coordinate is inverted because normal map is in TGA (not in DDS) for better quality
-	vec3 TextureNormal_tangentspace = normalize(texture( NormalTextureSampler, vec2(UV.x,-UV.y) ).rgb*2.0 - 1.0);
+	// Local normal, in tangent space. V tex coordinate is inverted because normal map rows are in BMP order (not DDS)
+	// Only x and y are stored (BC5) : z is rebuilt, the normal being unit length and pointing out of the surface
+	vec2 TextureNormal_xy = texture( NormalTextureSampler, vec2(UV.x,-UV.y) ).rg*2.0 - 1.0;
+	vec3 TextureNormal_tangentspace = vec3(TextureNormal_xy, sqrt(max(0.0, 1.0 - dot(TextureNormal_xy, TextureNormal_xy))));
 	
 	// Distance to the light
 	float distance = length( LightPosition_worldspace - Position_worldspace );
@@ -3,9 +3,7 @@
 // Input vertex data, different for all executions of this shader.
 layout(location = 0) in vec3 vertexPosition_modelspace;
 layout(location = 1) in vec2 vertexUV;
-layout(location = 2) in vec3 vertexNormal_modelspace;
-layout(location = 3) in vec3 vertexTangent_modelspace;
-layout(location = 4) in vec3 vertexBitangent_modelspace;
+layout(location = 2) in vec4 vertexQTangent_modelspace; // Tangent frame as a quaternion, w < 0 when mirrored
 
 // Output data ; will be interpolated for each fragment.
 out vec2 UV;
@@ -43,6 +41,13 @@ void main(){
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
 	
+	// Decode the tangent frame : the columns of the quaternion's rotation matrix
+	vec4 q = normalize(vertexQTangent_modelspace);
+	vec3 vertexTangent_modelspace = vec3(1.0 - 2.0*(q.y*q.y + q.z*q.z), 2.0*(q.x*q.y + q.w*q.z), 2.0*(q.x*q.z - q.w*q.y));
+	vec3 vertexBitangent_modelspace = vec3(2.0*(q.x*q.y - q.w*q.z), 1.0 - 2.0*(q.x*q.x + q.z*q.z), 2.0*(q.y*q.z + q.w*q.x));
+	vec3 vertexNormal_modelspace = vec3(2.0*(q.x*q.z + q.w*q.y), 2.0*(q.y*q.z - q.w*q.x), 1.0 - 2.0*(q.x*q.x + q.y*q.y));
+	vertexBitangent_modelspace *= q.w < 0.0 ? -1.0 : 1.0;
+
 	// model to camera = ModelView
 	vec3 vertexTangent_cameraspace = MV3x3 * vertexTangent_modelspace;
 	vec3 vertexBitangent_cameraspace = MV3x3 * vertexBitangent_modelspace;
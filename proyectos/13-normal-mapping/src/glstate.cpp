@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <unordered_map>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <../include/common/shader.hpp>
+#include <../include/common/glstate.hpp>
+
+enum StateKind {
+	STATE_PROGRAM,
+	STATE_VERTEX_ARRAY,
+	STATE_TEXTURE,
+	STATE_BUFFER,
+	STATE_CAPABILITY,
+	STATE_FIXED_FUNCTION,  // Blend, depth and cull functions
+	STATE_SAMPLER,
+	STATE_KIND_COUNT
+};
+
+static const char * stateKindNames[STATE_KIND_COUNT] = {
+	"program", "vertex array", "texture", "buffer", "enable/disable", "blend/depth/cull func", "sampler uniform"
+};
+
+// ~0 : not known, whatever is set next goes to the driver
+static const GLuint UNKNOWN = ~0u;
+
+static GLuint currentProgram = UNKNOWN;
+static GLuint currentVertexArray = UNKNOWN;
+static GLuint activeUnit = UNKNOWN;
+static std::unordered_map<uint64_t, GLuint> boundTextures;    // (unit << 32) | target
+static std::unordered_map<GLenum, GLuint> boundBuffers;
+static std::unordered_map<GLenum, bool> capabilities;
+static GLenum blendSource = UNKNOWN, blendDestination = UNKNOWN;
+static GLenum depthFunc = UNKNOWN;
+static GLenum cullFace = UNKNOWN;
+static std::unordered_map<uint64_t, GLint> samplers;          // (program << 32) | location
+
+static unsigned long requested[STATE_KIND_COUNT];
+static unsigned long elided[STATE_KIND_COUNT];
+static unsigned int frames = 0;
+
+// Counts the call, and says whether it has to reach the driver
+static bool changes(StateKind kind, bool changed){
+	requested[kind]++;
+	if (!changed)
+		elided[kind]++;
+	return changed;
+}
+
+void bindProgram(GLuint program){
+	if (changes(STATE_PROGRAM, program != currentProgram)){
+		UseProgram(program);
+		currentProgram = program;
+	}
+}
+
+void bindVertexArray(GLuint vao){
+	if (changes(STATE_VERTEX_ARRAY, vao != currentVertexArray)){
+		glBindVertexArray(vao);
+		currentVertexArray = vao;
+	}
+}
+
+void forgetVertexArray(GLuint vao){
+	if (vao == currentVertexArray)
+		currentVertexArray = UNKNOWN;
+}
+
+void forgetTexture(GLuint texture){
+	std::unordered_map<uint64_t, GLuint>::iterator bound = boundTextures.begin();
+	while (bound != boundTextures.end()){
+		if (bound->second == texture)
+			bound = boundTextures.erase(bound);
+		else
+			++bound;
+	}
+}
+
+void forgetBuffer(GLuint buffer){
+	std::unordered_map<GLenum, GLuint>::iterator bound = boundBuffers.begin();
+	while (bound != boundBuffers.end()){
+		if (bound->second == buffer)
+			bound = boundBuffers.erase(bound);
+		else
+			++bound;
+	}
+}
+
+void bindTexture(GLuint unit, GLenum target, GLuint texture){
+	uint64_t key = ((uint64_t)unit << 32) | target;
+	std::unordered_map<uint64_t, GLuint>::iterator bound = boundTextures.find(key);
+	if (!changes(STATE_TEXTURE, bound == boundTextures.end() || bound->second != texture))
+		return;
+	if (unit != activeUnit){
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+	}
+	glBindTexture(target, texture);
+	boundTextures[key] = texture;
+}
+
+void bindBuffer(GLenum target, GLuint buffer){
+	std::unordered_map<GLenum, GLuint>::iterator bound = boundBuffers.find(target);
+	if (changes(STATE_BUFFER, bound == boundBuffers.end() || bound->second != buffer)){
+		glBindBuffer(target, buffer);
+		boundBuffers[target] = buffer;
+	}
+}
+
+void setCapability(GLenum capability, bool enabled){
+	std::unordered_map<GLenum, bool>::iterator current = capabilities.find(capability);
+	if (!changes(STATE_CAPABILITY, current == capabilities.end() || current->second != enabled))
+		return;
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+	capabilities[capability] = enabled;
+}
+
+void setBlendFunc(GLenum source, GLenum destination){
+	if (changes(STATE_FIXED_FUNCTION, source != blendSource || destination != blendDestination)){
+		glBlendFunc(source, destination);
+		blendSource = source;
+		blendDestination = destination;
+	}
+}
+
+void setDepthFunc(GLenum func){
+	if (changes(STATE_FIXED_FUNCTION, func != depthFunc)){
+		glDepthFunc(func);
+		depthFunc = func;
+	}
+}
+
+void setCullFace(GLenum face){
+	if (changes(STATE_FIXED_FUNCTION, face != cullFace)){
+		glCullFace(face);
+		cullFace = face;
+	}
+}
+
+void setSamplerUniform(GLuint program, GLint location, GLint unit){
+	if (location < 0)
+		return;
+	uint64_t key = ((uint64_t)program << 32) | (GLuint)location;
+	std::unordered_map<uint64_t, GLint>::iterator current = samplers.find(key);
+	if (changes(STATE_SAMPLER, current == samplers.end() || current->second != unit)){
+		glUniform1i(location, unit);
+		samplers[key] = unit;
+	}
+}
+
+void resetGLState(){
+	currentProgram = UNKNOWN;
+	currentVertexArray = UNKNOWN;
+	activeUnit = UNKNOWN;
+	boundTextures.clear();
+	boundBuffers.clear();
+	capabilities.clear();
+	blendSource = blendDestination = UNKNOWN;
+	depthFunc = UNKNOWN;
+	cullFace = UNKNOWN;
+	samplers.clear();
+}
+
+void endGLStateFrame(){
+	frames++;
+}
+
+bool printGLStateCalls = false;
+
+void printGLStateCounters(){
+	unsigned int perFrame = frames > 0 ? frames : 1;
+	unsigned long totalRequested = 0, totalElided = 0;
+	if (printGLStateCalls)
+		printf("GL state calls per frame, skipped / asked for :");
+	for (int kind = 0; kind < STATE_KIND_COUNT; kind++){
+		totalRequested += requested[kind];
+		totalElided += elided[kind];
+		if (printGLStateCalls && requested[kind] > 0)
+			printf(" %s %.1f/%.1f,", stateKindNames[kind], (double)elided[kind] / perFrame, (double)requested[kind] / perFrame);
+		requested[kind] = elided[kind] = 0;
+	}
+	if (printGLStateCalls)
+		printf(" total %.1f/%.1f\n", (double)totalElided / perFrame, (double)totalRequested / perFrame);
+	frames = 0;
+}
+
+unsigned long elidedGLStateCalls(){
+	unsigned long total = 0;
+	for (int kind = 0; kind < STATE_KIND_COUNT; kind++)
+		total += elided[kind];
+	return total;
+}
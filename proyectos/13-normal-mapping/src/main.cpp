@@ -19,8 +19,13 @@ using namespace glm;
 #include <../include/common/texture.hpp>
 #include <../include/common/controls.hpp>
 #include <../include/common/objloader.hpp>
-#include <../include/common/vboindexer.hpp>
 #include <../include/common/tangentspace.hpp>
+#include <../include/common/vboindexer.hpp>
+#include <../include/common/meshcache.hpp>
+#include <../include/common/texcompress.hpp>
+#include <../include/common/texturearray.hpp>
+#include <../include/common/mesh.hpp>
+#include <../include/common/glstate.hpp>
 
 int main( void )
 {
@@ -79,8 +84,12 @@ int main( void )
 	glGenVertexArrays(1, &VertexArrayID);
 	glBindVertexArray(VertexArrayID);
 
+	// true : el marco tangente (normal, tangente, bitangente) va empaquetado en un cuaternion
+	// de 4 shorts, 28 bytes por vertice. false : cinco streams de floats, 56 bytes por vertice.
+	const bool usarQTangents = true;
+
 	// Create and compile our GLSL program from the shaders
-	GLuint programID = LoadShaders( "../shaders/NormalMapping.vert", "../shaders/NormalMapping.frag" );
+	GLuint programID = LoadShaders( usarQTangents ? "../shaders/NormalMapping.vert" : "../shaders/NormalMappingTBN.vert", "../shaders/NormalMapping.frag" );
 
 	// Get a handle for our "MVP" uniform
 	GLuint MatrixID = glGetUniformLocation(programID, "MVP");
@@ -88,77 +97,168 @@ int main( void )
 	GLuint ModelMatrixID = glGetUniformLocation(programID, "M");
 	GLuint ModelView3x3MatrixID = glGetUniformLocation(programID, "MV3x3");
 
-	// Load the texture
-	GLuint DiffuseTexture = loadDDS("../shaders/diffuse.DDS");
-	GLuint NormalTexture = loadBMP_custom("../shaders/normal.bmp");
-	GLuint SpecularTexture = loadDDS("../shaders/specular.DDS");
+	// Load the texture : difusa y especular tienen el mismo formato, van como dos capas de un solo array
+	std::vector<const char *> materialPaths;
+	materialPaths.push_back("../shaders/diffuse.DDS");
+	materialPaths.push_back("../shaders/specular.DDS");
+	TexturePack materials;
+	if (!packTextures(materialPaths, materials)) {
+		glfwTerminate();
+		return -1;
+	}
+	const TextureLayer & diffuseLayer = materials.layers[0];
+	const TextureLayer & specularLayer = materials.layers[1];
+	// El normal map se comprime a BC5 la primera vez (solo x e y, el shader reconstruye z)
+	GLuint NormalTexture = compressBMP("../shaders/normal.bmp", "../shaders/normal.bmp.dds", BLOCK_BC5)
+		? loadDDS("../shaders/normal.bmp.dds") : loadBMP_custom("../shaders/normal.bmp");
 	
 	// Get a handle for our "myTextureSampler" uniform
-	GLuint DiffuseTextureID  = glGetUniformLocation(programID, "DiffuseTextureSampler");
+	GLuint MaterialTextureID  = glGetUniformLocation(programID, "MaterialTextureSampler");
 	GLuint NormalTextureID  = glGetUniformLocation(programID, "NormalTextureSampler");
-	GLuint SpecularTextureID  = glGetUniformLocation(programID, "SpecularTextureSampler");
-
-	// Read our .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals;
-	bool res = loadOBJ("../models/cylinder.obj", vertices, uvs, normals);
-
-	std::vector<glm::vec3> tangents;
-	std::vector<glm::vec3> bitangents;
-	computeTangentBasis(
-		vertices, uvs, normals, // input
-		tangents, bitangents    // output
-	);
-
-	std::vector<unsigned short> indices;
-	std::vector<glm::vec3> indexed_vertices;
-	std::vector<glm::vec2> indexed_uvs;
-	std::vector<glm::vec3> indexed_normals;
-	std::vector<glm::vec3> indexed_tangents;
-	std::vector<glm::vec3> indexed_bitangents;
-	indexVBO_TBN(
-		vertices, uvs, normals, tangents, bitangents, 
-		indices, indexed_vertices, indexed_uvs, indexed_normals, indexed_tangents, indexed_bitangents
-	);
+	GLuint DiffuseLayerID  = glGetUniformLocation(programID, "DiffuseLayer");
+	GLuint SpecularLayerID  = glGetUniformLocation(programID, "SpecularLayer");
+
+	// Read our .obj file, or the .meshcache written next to it by a previous run,
+	// which already holds the indexed vertices and their tangent basis
+	MeshCache mesh;
+	if (!openMeshCache("../models/cylinder.obj", mesh) || mesh.tangents == NULL || mesh.bitangents == NULL){
+		// The loader already welds identical v/vt/vn, the tangents are computed once per vertex
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> indexed_vertices;
+		std::vector<glm::vec2> indexed_uvs;
+		std::vector<glm::vec3> indexed_normals;
+		if (!loadOBJ_indexed("../models/cylinder.obj", indices, indexed_vertices, indexed_uvs, indexed_normals)){
+			glfwTerminate();
+			return -1;
+		}
+		// Un modelo sin triangulos no tiene nada que dibujar (ni que guardar)
+		if (indices.empty()){
+			printf("../models/cylinder.obj no tiene triangulos\n");
+			glfwTerminate();
+			return -1;
+		}
+
+		std::vector<glm::vec3> indexed_tangents;
+		std::vector<glm::vec3> indexed_bitangents;
+		computeTangentBasis_indexed(
+			indices, indexed_vertices, indexed_uvs, indexed_normals, // input
+			indexed_tangents, indexed_bitangents                     // output
+		);
+
+		if (!writeMeshCache(
+			"../models/cylinder.obj",
+			indexed_vertices, indexed_uvs, indexed_normals, indexed_tangents, indexed_bitangents,
+			indices.data(), indices.size(), sizeof(unsigned int),
+			mesh
+		)){
+			glfwTerminate();
+			return -1;
+		}
+	}
 
 	// Load it into a VBO
 
 	GLuint vertexbuffer;
 	glGenBuffers(1, &vertexbuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec3), mesh.vertices, GL_STATIC_DRAW);
 
 	GLuint uvbuffer;
 	glGenBuffers(1, &uvbuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-	GLuint normalbuffer;
-	glGenBuffers(1, &normalbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec2), mesh.uvs, GL_STATIC_DRAW);
+
+	GLuint qtangentbuffer = 0;
+	GLuint normalbuffer = 0;
+	GLuint tangentbuffer = 0;
+	GLuint bitangentbuffer = 0;
+	if (usarQTangents){
+		// Un cuaternion por vertice en lugar de normal, tangente y bitangente
+		std::vector<glm::vec3> normals(mesh.normals, mesh.normals + mesh.vertexCount);
+		std::vector<glm::vec3> tangents(mesh.tangents, mesh.tangents + mesh.vertexCount);
+		std::vector<glm::vec3> bitangents(mesh.bitangents, mesh.bitangents + mesh.vertexCount);
+		std::vector<glm::i16vec4> qtangents;
+		computeQTangents(normals, tangents, bitangents, qtangents);
+
+		glGenBuffers(1, &qtangentbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, qtangentbuffer);
+		glBufferData(GL_ARRAY_BUFFER, qtangents.size() * sizeof(glm::i16vec4), &qtangents[0], GL_STATIC_DRAW);
+	}else{
+		glGenBuffers(1, &normalbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
+		glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec3), mesh.normals, GL_STATIC_DRAW);
 
-	GLuint tangentbuffer;
-	glGenBuffers(1, &tangentbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_tangents.size() * sizeof(glm::vec3), &indexed_tangents[0], GL_STATIC_DRAW);
+		glGenBuffers(1, &tangentbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer);
+		glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec3), mesh.tangents, GL_STATIC_DRAW);
 
-	GLuint bitangentbuffer;
-	glGenBuffers(1, &bitangentbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, bitangentbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_bitangents.size() * sizeof(glm::vec3), &indexed_bitangents[0], GL_STATIC_DRAW);
+		glGenBuffers(1, &bitangentbuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, bitangentbuffer);
+		glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * sizeof(glm::vec3), mesh.bitangents, GL_STATIC_DRAW);
+	}
 
 	// Generate a buffer for the indices as well
 	GLuint elementbuffer;
 	glGenBuffers(1, &elementbuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexCount * mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+
+	// El VAO del cilindro se arma una vez : cada frame solo se enlaza y se dibuja
+	Mesh cilindro;
+	cilindro.elementbuffer = elementbuffer;
+	cilindro.count = mesh.indexCount;
+	cilindro.indexType = mesh.indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	// 1rst attribute buffer : vertices
+	addMeshAttribute(cilindro, 0, vertexbuffer, 3);
+	// 2nd attribute buffer : UVs
+	addMeshAttribute(cilindro, 1, uvbuffer, 2);
+	if (usarQTangents){
+		// 3rd attribute buffer : QTangents, shorts leidos como [-1, 1]
+		addMeshAttribute(cilindro, 2, qtangentbuffer, 4, GL_SHORT, GL_TRUE);
+	}else{
+		// 3rd, 4th and 5th attribute buffers : normals, tangents, bitangents
+		addMeshAttribute(cilindro, 2, normalbuffer, 3);
+		addMeshAttribute(cilindro, 3, tangentbuffer, 3);
+		addMeshAttribute(cilindro, 4, bitangentbuffer, 3);
+	}
+	buildMesh(cilindro);
+
+	// OpenGL has its own copy now
+	closeMeshCache(mesh);
 
 	// Get a handle for our "LightPosition" uniform
 	glUseProgram(programID);
 	GLuint LightID = glGetUniformLocation(programID, "LightPosition_worldspace");
 
+	// true : antes de empezar compara los indexadores de vboindexer con el cilindro y con saturno
+	// (el modelo grande del proyecto 16, que pasa de los 65535 vertices)
+	const bool medirIndexado = false;
+	if (medirIndexado) {
+		const char * modelos[] = { "../models/cylinder.obj", "../../16-colision-dos-obj/models/saturno.obj" };
+		for (int i = 0; i < 2; i++) {
+			std::vector<glm::vec3> vertices;
+			std::vector<glm::vec2> uvs;
+			std::vector<glm::vec3> normals;
+			if (loadOBJ(modelos[i], vertices, uvs, normals))
+				benchmarkIndexVBO(vertices, uvs, normals);
+		}
+	}
+
+	// true : comprueba que computeTangentBasis (SIMD y con hilos) da lo mismo que la version escalar
+	const bool comprobarTangentes = false;
+	if (comprobarTangentes) {
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		if (loadOBJ("../models/cylinder.obj", vertices, uvs, normals) && !checkTangentBasis(vertices, uvs, normals))
+			printf("computeTangentBasis no coincide con la version escalar\n");
+	}
+
+	// true : antes de empezar mide lo que cuesta en CPU mandar el cilindro, con y sin su VAO
+	const bool medirEnvio = false;
+	if (medirEnvio)
+		benchmarkMeshSubmission(cilindro, 10000);
+
 	// For speed computation
 	double lastTime = glfwGetTime();
 	int nbFrames = 0;
@@ -173,6 +273,8 @@ int main( void )
 		if ( currentTime - lastTime >= 1.0 ){ // If last prinf() was more than 1sec ago
 			// printf and reset
 			printf("%f ms/frame\n", 1000.0/double(nbFrames));
+			// Solo imprime con printGLStateCalls = true
+			printGLStateCounters();
 			nbFrames = 0;
 			lastTime += 1.0;
 		}
@@ -180,8 +282,8 @@ int main( void )
 		// Clear the screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Use our shader
-		glUseProgram(programID);
+		// Use our shader (si ya está en uso no se vuelve a mandar)
+		bindProgram(programID);
 	
 		// Compute the MVP matrix from keyboard and mouse input
 		computeMatricesFromInputs();
@@ -204,94 +306,23 @@ int main( void )
 		glm::vec3 lightPos = glm::vec3(0,0,4);
 		glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
 
-		// Bind our diffuse texture in Texture Unit 0
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, DiffuseTexture);
-		// Set our "DiffuseTextureSampler" sampler to use Texture Unit 0
-		glUniform1i(DiffuseTextureID, 0);
+		// Bind the diffuse and specular array in Texture Unit 0
+		bindTexture(0, GL_TEXTURE_2D_ARRAY, diffuseLayer.array);
+		// Set our "MaterialTextureSampler" sampler to use Texture Unit 0
+		setSamplerUniform(programID, MaterialTextureID, 0);
+		// Capa y escala de UV de cada una dentro del array
+		glUniform3f(DiffuseLayerID, diffuseLayer.scale.x, diffuseLayer.scale.y, (float)diffuseLayer.layer);
+		glUniform3f(SpecularLayerID, specularLayer.scale.x, specularLayer.scale.y, (float)specularLayer.layer);
 
 		// Bind our normal texture in Texture Unit 1
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, NormalTexture);
+		bindTexture(1, GL_TEXTURE_2D, NormalTexture);
 		// Set our "NormalTextureSampler" sampler to use Texture Unit 1
-		glUniform1i(NormalTextureID, 1);
-
-		// Bind our specular texture in Texture Unit 2
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, SpecularTexture);
-		// Set our "SpecularTextureSampler" sampler to use Texture Unit 2
-		glUniform1i(SpecularTextureID, 2);
-
-
-		// 1rst attribute buffer : vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,(void*)0);
-
-		// 2nd attribute buffer : UVs
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-		glVertexAttribPointer(
-			1,                                // attribute
-			2,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
+		setSamplerUniform(programID, NormalTextureID, 1);
 
-		// 3rd attribute buffer : normals
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-		glVertexAttribPointer(
-			2,                                // attribute
-			3,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// 4th attribute buffer : tangents
-		glEnableVertexAttribArray(3);
-		glBindBuffer(GL_ARRAY_BUFFER, tangentbuffer);
-		glVertexAttribPointer(
-			3,                                // attribute
-			3,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// 5th attribute buffer : bitangents
-		glEnableVertexAttribArray(4);
-		glBindBuffer(GL_ARRAY_BUFFER, bitangentbuffer);
-		glVertexAttribPointer(
-			4,                                // attribute
-			3,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// Index buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
 
 		// Draw the triangles !
-		glDrawElements(
-			GL_TRIANGLES,      // mode
-			indices.size(),    // count
-			GL_UNSIGNED_SHORT, // type
-			(void*)0           // element array buffer offset
-		);
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
-		glDisableVertexAttribArray(3);
-		glDisableVertexAttribArray(4);
+		drawMesh(cilindro);
+		endGLStateFrame();
 
 		// Swap buffers
 		glfwSwapBuffers(window);
@@ -302,14 +333,15 @@ int main( void )
 	// Cleanup VBO and shader
 	glDeleteBuffers(1, &vertexbuffer);
 	glDeleteBuffers(1, &uvbuffer);
+	glDeleteBuffers(1, &qtangentbuffer);
 	glDeleteBuffers(1, &normalbuffer);
 	glDeleteBuffers(1, &tangentbuffer);
 	glDeleteBuffers(1, &bitangentbuffer);
 	glDeleteBuffers(1, &elementbuffer);
-	glDeleteProgram(programID);
-	glDeleteTextures(1, &DiffuseTexture);
+	deleteMesh(cilindro);
+	DeleteProgram(programID);
+	deleteTexturePack(materials);
 	glDeleteTextures(1, &NormalTexture);
-	glDeleteTextures(1, &SpecularTexture);
 	glDeleteVertexArrays(1, &VertexArrayID);
 
 	// Close OpenGL window and terminate GLFW
@@ -0,0 +1,524 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <chrono>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <../include/common/texture.hpp>
+#include <../include/common/parallel.hpp>
+#include <../include/common/texcompress.hpp>
+
+// What follows the "DDS " magic (the same layout loadDDS reads)
+struct DDSFileHeader{
+	unsigned int size;
+	unsigned int flags;
+	unsigned int height;
+	unsigned int width;
+	unsigned int pitchOrLinearSize;
+	unsigned int depth;
+	unsigned int mipMapCount;
+	unsigned int reserved1[11];
+	unsigned int pfSize;
+	unsigned int pfFlags;
+	unsigned int fourCC;
+	unsigned int rgbBitCount;
+	unsigned int rBitMask, gBitMask, bBitMask, aBitMask;
+	unsigned int caps, caps2, caps3, caps4;
+	unsigned int reserved2;
+};
+
+#define DDSD_CAPS        0x1
+#define DDSD_HEIGHT      0x2
+#define DDSD_WIDTH       0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE  0x80000
+#define DDPF_FOURCC      0x4
+#define DDSCAPS_COMPLEX  0x8
+#define DDSCAPS_TEXTURE  0x1000
+#define DDSCAPS_MIPMAP   0x400000
+
+#define FOURCC_DXT1 0x31545844 // "DXT1"
+#define FOURCC_DXT5 0x35545844 // "DXT5"
+#define FOURCC_ATI2 0x32495441 // "ATI2"
+
+// ---- BC4 : one channel, two 8 bits endpoints and 3 bits per texel ----
+
+// Nearest of the 8 values a BC4 block can hold, as the GPU decodes them, for every value. Returns the squared error.
+// first > second interpolates 6 values between the endpoints; otherwise 4 are interpolated and the
+// last two are 0 and 255. The interpolated values are evenly spaced, so the nearest one is a rounded
+// position between the endpoints : step s holds ((steps - s) * first + s * second) / steps.
+static float fitChannel(int first, int second, const unsigned char values[16], unsigned char indices[16]){
+	bool eight = first > second;
+	int steps = eight ? 7 : 5;
+	float scale = second != first ? (float)steps / (second - first) : 0.0f;
+#ifdef __SSE2__
+	// Branch free, 4 values at a time : noisy blocks would mispredict every other comparison
+	__m128 total = _mm_setzero_ps();
+	for (int i = 0; i < 16; i += 4){
+		__m128i bytes = _mm_cvtsi32_si128(*(const int *)(values + i));
+		__m128 v = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, _mm_setzero_si128()), _mm_setzero_si128()));
+		__m128 position = _mm_mul_ps(_mm_sub_ps(v, _mm_set1_ps((float)first)), _mm_set1_ps(scale));
+		position = _mm_min_ps(_mm_max_ps(position, _mm_setzero_ps()), _mm_set1_ps((float)steps));
+		__m128i step = _mm_cvttps_epi32(_mm_add_ps(position, _mm_set1_ps(0.5f)));
+		// The value at that step
+		__m128 s = _mm_cvtepi32_ps(step);
+		__m128 value = _mm_div_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_set1_ps((float)steps), s), _mm_set1_ps((float)first)),
+			_mm_mul_ps(s, _mm_set1_ps((float)second))), _mm_set1_ps((float)steps));
+		// step 0 is index 0, the last step index 1, the others step + 1
+		__m128i isFirst = _mm_cmpeq_epi32(step, _mm_setzero_si128());
+		__m128i isLast = _mm_cmpeq_epi32(step, _mm_set1_epi32(steps));
+		__m128i index = _mm_add_epi32(step, _mm_set1_epi32(1));
+		index = _mm_andnot_si128(isFirst, index);
+		index = _mm_or_si128(_mm_and_si128(isLast, _mm_set1_epi32(1)), _mm_andnot_si128(isLast, index));
+		__m128 d = _mm_sub_ps(v, value);
+		__m128 error = _mm_mul_ps(d, d);
+		if (!eight){
+			// 0 and 255 are there too
+			__m128 toZero = _mm_mul_ps(v, v);
+			__m128 up = _mm_sub_ps(_mm_set1_ps(255.0f), v);
+			__m128 toMax = _mm_mul_ps(up, up);
+			__m128i zero = _mm_castps_si128(_mm_cmplt_ps(toZero, error));
+			error = _mm_min_ps(error, toZero);
+			index = _mm_or_si128(_mm_and_si128(zero, _mm_set1_epi32(6)), _mm_andnot_si128(zero, index));
+			__m128i max = _mm_castps_si128(_mm_cmplt_ps(toMax, error));
+			error = _mm_min_ps(error, toMax);
+			index = _mm_or_si128(_mm_and_si128(max, _mm_set1_epi32(7)), _mm_andnot_si128(max, index));
+		}
+		total = _mm_add_ps(total, error);
+		int lanes[4];
+		_mm_storeu_si128((__m128i *)lanes, index);
+		for (int k = 0; k < 4; k++)
+			indices[i + k] = (unsigned char)lanes[k];
+	}
+	float sums[4];
+	_mm_storeu_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int i = 0; i < 16; i++){
+		float position = (values[i] - first) * scale;
+		int step = position <= 0.0f ? 0 : (int)(position + 0.5f);
+		if (step > steps)
+			step = steps;
+		unsigned char index = (unsigned char)(step == 0 ? 0 : (step == steps ? 1 : step + 1));
+		float d = values[i] - ((steps - step) * first + step * second) / (float)steps;
+		float error = d * d;
+		if (!eight){
+			// 0 and 255 are there too
+			float toZero = (float)values[i] * values[i], toMax = (255.0f - values[i]) * (255.0f - values[i]);
+			if (toZero < error){ error = toZero; index = 6; }
+			if (toMax < error){ error = toMax; index = 7; }
+		}
+		indices[i] = index;
+		total += error;
+	}
+	return total;
+#endif
+}
+
+// Tries the extremes in the 6 values mode, and the 4 values mode with whatever isn't close
+// to 0 or 255 between its endpoints (noisy normal maps often have both in the same block).
+static void encodeChannelBlock(const unsigned char values[16], unsigned char out[8]){
+	int high = values[0], low = values[0];
+	for (int i = 1; i < 16; i++){
+		if (values[i] > high) high = values[i];
+		if (values[i] < low)  low = values[i];
+	}
+
+	int bestFirst = high, bestSecond = low;
+	unsigned char bestIndices[16];
+	float bestError = fitChannel(high, low, values, bestIndices);
+
+	static const int margins[3] = { 1, 16, 48 };
+	for (int m = 0; m < 3 && bestError > 0.0f; m++){
+		int innerLow = 256, innerHigh = -1;
+		for (int i = 0; i < 16; i++){
+			if (values[i] < margins[m] || values[i] > 255 - margins[m])
+				continue;
+			if (values[i] < innerLow)  innerLow = values[i];
+			if (values[i] > innerHigh) innerHigh = values[i];
+		}
+		if (innerHigh < 0)
+			continue;
+		unsigned char indices[16];
+		float error = fitChannel(innerLow, innerHigh, values, indices);
+		if (error < bestError){
+			bestError = error;
+			bestFirst = innerLow;
+			bestSecond = innerHigh;
+			memcpy(bestIndices, indices, 16);
+		}
+	}
+
+	out[0] = (unsigned char)bestFirst;
+	out[1] = (unsigned char)bestSecond;
+	unsigned long long bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned long long)bestIndices[i] << (3 * i);
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// ---- BC1 : two RGB565 endpoints and 2 bits per texel ----
+
+static inline unsigned short packColor(const glm::vec3 & color){
+	glm::vec3 c = glm::clamp(color, 0.0f, 255.0f);
+	unsigned int r = (unsigned int)(c.r * 31.0f / 255.0f + 0.5f);
+	unsigned int g = (unsigned int)(c.g * 63.0f / 255.0f + 0.5f);
+	unsigned int b = (unsigned int)(c.b * 31.0f / 255.0f + 0.5f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static inline glm::vec3 unpackColor(unsigned short color){
+	unsigned int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	return glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+// Texels of a block, one array per channel so 4 of them fit in an SSE register
+struct ColorBlock{
+	float r[16], g[16], b[16];
+};
+
+// Picks the nearest of the 4 palette entries for every texel. Returns the squared error.
+static float fitIndices(const ColorBlock & block, const glm::vec3 palette[4], unsigned char indices[16]){
+#ifdef __SSE2__
+	__m128 total = _mm_setzero_ps();
+	for (int i = 0; i < 16; i += 4){
+		__m128 r = _mm_loadu_ps(block.r + i), g = _mm_loadu_ps(block.g + i), b = _mm_loadu_ps(block.b + i);
+		__m128 best = _mm_set1_ps(1e30f);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int p = 0; p < 4; p++){
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p].r));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p].g));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p].b));
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+			best = _mm_min_ps(distance, best);
+			bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex));
+		}
+		total = _mm_add_ps(total, best);
+		int lanes[4];
+		_mm_storeu_si128((__m128i *)lanes, bestIndex);
+		for (int k = 0; k < 4; k++)
+			indices[i + k] = (unsigned char)lanes[k];
+	}
+	float sums[4];
+	_mm_storeu_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int i = 0; i < 16; i++){
+		glm::vec3 texel(block.r[i], block.g[i], block.b[i]);
+		float best = 1e30f;
+		for (int p = 0; p < 4; p++){
+			glm::vec3 d = texel - palette[p];
+			float distance = glm::dot(d, d);
+			if (distance < best){
+				best = distance;
+				indices[i] = (unsigned char)p;
+			}
+		}
+		total += best;
+	}
+	return total;
+#endif
+}
+
+// The 4 colors mode palette of two endpoints, as the GPU decodes it
+static void makePalette(unsigned short color0, unsigned short color1, glm::vec3 palette[4]){
+	palette[0] = unpackColor(color0);
+	palette[1] = unpackColor(color1);
+	palette[2] = (2.0f * palette[0] + palette[1]) / 3.0f;
+	palette[3] = (palette[0] + 2.0f * palette[1]) / 3.0f;
+}
+
+// Endpoints along the principal axis of the texels, then one least squares pass on them
+static void encodeColorBlock(const ColorBlock & block, unsigned char out[8]){
+
+	glm::vec3 mean(0.0f);
+	for (int i = 0; i < 16; i++)
+		mean += glm::vec3(block.r[i], block.g[i], block.b[i]);
+	mean /= 16.0f;
+
+	float covariance[6] = { 0, 0, 0, 0, 0, 0 }; // rr rg rb gg gb bb
+	for (int i = 0; i < 16; i++){
+		glm::vec3 d = glm::vec3(block.r[i], block.g[i], block.b[i]) - mean;
+		covariance[0] += d.r * d.r; covariance[1] += d.r * d.g; covariance[2] += d.r * d.b;
+		covariance[3] += d.g * d.g; covariance[4] += d.g * d.b; covariance[5] += d.b * d.b;
+	}
+	glm::vec3 axis(1.0f, 1.0f, 1.0f);
+	for (int iteration = 0; iteration < 8; iteration++){
+		glm::vec3 next(
+			covariance[0] * axis.r + covariance[1] * axis.g + covariance[2] * axis.b,
+			covariance[1] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+			covariance[2] * axis.r + covariance[4] * axis.g + covariance[5] * axis.b);
+		float length = glm::length(next);
+		if (length < 1e-6f)
+			break;
+		axis = next / length;
+	}
+
+	float lowest = 1e30f, highest = -1e30f;
+	for (int i = 0; i < 16; i++){
+		float t = glm::dot(glm::vec3(block.r[i], block.g[i], block.b[i]) - mean, axis);
+		if (t < lowest)  lowest = t;
+		if (t > highest) highest = t;
+	}
+
+	unsigned short color0 = packColor(mean + axis * highest);
+	unsigned short color1 = packColor(mean + axis * lowest);
+	glm::vec3 palette[4];
+	unsigned char indices[16];
+	makePalette(color0, color1, palette);
+	float error = fitIndices(block, palette, indices);
+
+	// Least squares endpoints for these indices : texel = a * end0 + b * end1
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0, ab = 0, bb = 0;
+	glm::vec3 ax(0.0f), bx(0.0f);
+	for (int i = 0; i < 16; i++){
+		float a = weights[indices[i]], b = 1.0f - a;
+		glm::vec3 texel(block.r[i], block.g[i], block.b[i]);
+		aa += a * a; ab += a * b; bb += b * b;
+		ax += a * texel; bx += b * texel;
+	}
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) > 1e-6f){
+		unsigned short refined0 = packColor((ax * bb - bx * ab) / determinant);
+		unsigned short refined1 = packColor((bx * aa - ax * ab) / determinant);
+		glm::vec3 refinedPalette[4];
+		unsigned char refinedIndices[16];
+		makePalette(refined0, refined1, refinedPalette);
+		float refinedError = fitIndices(block, refinedPalette, refinedIndices);
+		if (refinedError < error){
+			color0 = refined0;
+			color1 = refined1;
+			memcpy(indices, refinedIndices, 16);
+		}
+	}
+
+	// color0 > color1 selects the 4 colors mode; equal endpoints decode the same in both modes
+	static const unsigned char swapped[4] = { 1, 0, 3, 2 };
+	if (color0 < color1){
+		unsigned short color = color0; color0 = color1; color1 = color;
+		for (int i = 0; i < 16; i++)
+			indices[i] = swapped[indices[i]];
+	}else if (color0 == color1){
+		memset(indices, 0, 16);
+	}
+
+	unsigned int bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (unsigned int)indices[i] << (2 * i);
+	out[0] = (unsigned char)color0; out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)color1; out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+// ---- Mip chain and file ----
+
+static unsigned int blockBytes(BlockFormat format){
+	return format == BLOCK_BC1 ? 8 : 16;
+}
+
+static unsigned int formatFourCC(BlockFormat format){
+	return format == BLOCK_BC1 ? FOURCC_DXT1 : (format == BLOCK_BC3 ? FOURCC_DXT5 : FOURCC_ATI2);
+}
+
+// The fourCC in the header of a DDS file, 0 if it can't be read
+static unsigned int fileFourCC(const char * path){
+	FILE * file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	char magic[4];
+	DDSFileHeader header;
+	bool read = fread(magic, 1, 4, file) == 4 && fread(&header, sizeof(header), 1, file) == 1;
+	fclose(file);
+	if (!read || strncmp(magic, "DDS ", 4) != 0)
+		return 0;
+	return header.fourCC;
+}
+
+// Compresses one level, a row of blocks per task item, edges clamped for sizes that aren't multiples of 4
+static void compressLevel(const unsigned char * rgba, unsigned int width, unsigned int height, BlockFormat format,
+	unsigned char * out, unsigned int threadCount){
+
+	unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	unsigned int bytes = blockBytes(format);
+	unsigned int count = workerCount(blocksY, 16, threadCount);
+	runParallel(count, [&](unsigned int thread){
+		for (unsigned int by = blocksY * thread / count; by < blocksY * (thread + 1) / count; by++){
+			for (unsigned int bx = 0; bx < blocksX; bx++){
+				unsigned char texels[16][4];
+				for (unsigned int j = 0; j < 4; j++){
+					unsigned int y = by * 4 + j < height ? by * 4 + j : height - 1;
+					for (unsigned int i = 0; i < 4; i++){
+						unsigned int x = bx * 4 + i < width ? bx * 4 + i : width - 1;
+						memcpy(texels[j * 4 + i], rgba + ((size_t)y * width + x) * 4, 4);
+					}
+				}
+				unsigned char * block = out + ((size_t)by * blocksX + bx) * bytes;
+				if (format == BLOCK_BC5){
+					unsigned char red[16], green[16];
+					for (int i = 0; i < 16; i++){
+						red[i] = texels[i][0];
+						green[i] = texels[i][1];
+					}
+					encodeChannelBlock(red, block);
+					encodeChannelBlock(green, block + 8);
+					continue;
+				}
+				ColorBlock colors;
+				for (int i = 0; i < 16; i++){
+					colors.r[i] = texels[i][0];
+					colors.g[i] = texels[i][1];
+					colors.b[i] = texels[i][2];
+				}
+				if (format == BLOCK_BC3){
+					unsigned char alpha[16];
+					for (int i = 0; i < 16; i++)
+						alpha[i] = texels[i][3];
+					encodeChannelBlock(alpha, block);
+					block += 8;
+				}
+				encodeColorBlock(colors, block);
+			}
+		}
+	});
+}
+
+// Next mip level : 2x2 box filter (edges clamped for odd sizes). Normals are averaged as
+// vectors and renormalized, so the smaller levels don't flatten the bumps towards the surface.
+static void downsample(const std::vector<unsigned char> & level, unsigned int width, unsigned int height,
+	bool normals, std::vector<unsigned char> & next, unsigned int threadCount){
+
+	unsigned int nextWidth = width > 1 ? width / 2 : 1, nextHeight = height > 1 ? height / 2 : 1;
+	next.resize((size_t)nextWidth * nextHeight * 4);
+	unsigned int count = workerCount(nextHeight, 64, threadCount);
+	runParallel(count, [&](unsigned int thread){
+		for (unsigned int y = nextHeight * thread / count; y < nextHeight * (thread + 1) / count; y++){
+			unsigned int y0 = y * 2 < height ? y * 2 : height - 1, y1 = y * 2 + 1 < height ? y * 2 + 1 : height - 1;
+			for (unsigned int x = 0; x < nextWidth; x++){
+				unsigned int x0 = x * 2 < width ? x * 2 : width - 1, x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+				const unsigned char * texels[4] = {
+					&level[((size_t)y0 * width + x0) * 4], &level[((size_t)y0 * width + x1) * 4],
+					&level[((size_t)y1 * width + x0) * 4], &level[((size_t)y1 * width + x1) * 4] };
+				unsigned char * out = &next[((size_t)y * nextWidth + x) * 4];
+				if (normals){
+					glm::vec3 sum(0.0f);
+					for (int i = 0; i < 4; i++)
+						sum += glm::vec3(texels[i][0], texels[i][1], texels[i][2]) / 127.5f - 1.0f;
+					glm::vec3 n = glm::length(sum) > 1e-6f ? glm::normalize(sum) : glm::vec3(0, 0, 1);
+					glm::vec3 encoded = (n + 1.0f) * 127.5f + 0.5f;
+					out[0] = (unsigned char)glm::clamp(encoded.x, 0.0f, 255.0f);
+					out[1] = (unsigned char)glm::clamp(encoded.y, 0.0f, 255.0f);
+					out[2] = (unsigned char)glm::clamp(encoded.z, 0.0f, 255.0f);
+					out[3] = (unsigned char)((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+					continue;
+				}
+				for (int c = 0; c < 4; c++)
+					out[c] = (unsigned char)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+			}
+		}
+	});
+}
+
+bool writeCompressedDDS(const char * path, const unsigned char * rgba, unsigned int width, unsigned int height,
+	BlockFormat format, unsigned int threadCount){
+
+	if (width == 0 || height == 0)
+		return false;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	unsigned int mipMapCount = 1;
+	while ((width >> mipMapCount) > 0 || (height >> mipMapCount) > 0)
+		mipMapCount++;
+
+	DDSFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(header);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = height;
+	header.width = width;
+	header.pitchOrLinearSize = ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+	header.mipMapCount = mipMapCount;
+	header.pfSize = 32;
+	header.pfFlags = DDPF_FOURCC;
+	header.fourCC = formatFourCC(format);
+	header.caps = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+	std::vector<unsigned char> blocks;
+	std::vector<unsigned char> level(rgba, rgba + (size_t)width * height * 4), next;
+	unsigned int w = width, h = height;
+	for (unsigned int mip = 0; mip < mipMapCount; mip++){
+		size_t offset = blocks.size();
+		blocks.resize(offset + (size_t)((w + 3) / 4) * ((h + 3) / 4) * blockBytes(format));
+		compressLevel(&level[0], w, h, format, &blocks[offset], threadCount);
+		if (mip + 1 < mipMapCount){
+			downsample(level, w, h, format == BLOCK_BC5, next, threadCount);
+			level.swap(next);
+			w = w > 1 ? w / 2 : 1;
+			h = h > 1 ? h / 2 : 1;
+		}
+	}
+
+	FILE * file = fopen(path, "wb");
+	if (!file){
+		printf("Impossible to write %s\n", path);
+		return false;
+	}
+	bool written = fwrite("DDS ", 1, 4, file) == 4
+		&& fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&blocks[0], 1, blocks.size(), file) == blocks.size();
+	written = (fclose(file) == 0) && written;
+	if (!written){
+		printf("Impossible to write %s\n", path);
+		remove(path);
+		return false;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Compressed %ux%u texels into %s : %u levels, %.2f MB in %.2f ms\n", width, height, path,
+		mipMapCount, blocks.size() / 1048576.0, seconds * 1000.0);
+	return true;
+}
+
+bool compressBMP(const char * bmpPath, const char * ddsPath, BlockFormat format){
+
+	struct stat source, compressed;
+	if (stat(bmpPath, &source) != 0)
+		return false;
+	// A file written for another format (the call changed its BlockFormat) is rebuilt too
+	if (stat(ddsPath, &compressed) == 0 && compressed.st_mtime >= source.st_mtime
+		&& fileFourCC(ddsPath) == formatFourCC(format))
+		return true;
+
+	BMPImage * image = readBMP(bmpPath);
+	if (image == NULL)
+		return false;
+	unsigned int width, height;
+	const unsigned char * bgr = bmpPixels(image, width, height);
+	size_t rowSize = ((size_t)width * 3 + 3) & ~(size_t)3;
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	for (unsigned int y = 0; y < height; y++){
+		for (unsigned int x = 0; x < width; x++){
+			const unsigned char * in = bgr + y * rowSize + x * 3;
+			unsigned char * out = &rgba[((size_t)y * width + x) * 4];
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			out[3] = 255;
+		}
+	}
+	freeBMP(image);
+	return writeCompressedDDS(ddsPath, &rgba[0], width, height, format);
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <../include/common/mappedfile.hpp>
+
+bool mapFile(const char * path, MappedFile & file){
+
+	file.data = NULL;
+	file.size = 0;
+	file.handle = NULL;
+
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size)){
+		CloseHandle(fileHandle);
+		return false;
+	}
+	if (size.QuadPart == 0){
+		CloseHandle(fileHandle);
+		return true;
+	}
+
+	// The mapping keeps the file alive, the file handle itself is not needed anymore
+	HANDLE mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(fileHandle);
+	if (mapping == NULL)
+		return false;
+
+	void * view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL){
+		CloseHandle(mapping);
+		return false;
+	}
+
+	file.data = (const char *)view;
+	file.size = (size_t)size.QuadPart;
+	file.handle = mapping;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0){
+		close(fd);
+		return false;
+	}
+	if (info.st_size == 0){
+		close(fd);
+		return true;
+	}
+
+	void * view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	// We read front to back, let the kernel read ahead aggressively
+	madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+	file.data = (const char *)view;
+	file.size = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if (file.data != NULL){
+#ifdef _WIN32
+		UnmapViewOfFile(file.data);
+		CloseHandle((HANDLE)file.handle);
+#else
+		munmap((void *)file.data, file.size);
+#endif
+	}
+	file.data = NULL;
+	file.size = 0;
+	file.handle = NULL;
+}
+
+unsigned long long hashFile(const MappedFile & file){
+	unsigned long long hash = 14695981039346656037ull;
+	size_t i = 0;
+	for (; i + 8 <= file.size; i += 8){
+		unsigned long long word;
+		memcpy(&word, file.data + i, 8);
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+	for (; i < file.size; i++)
+		hash = (hash ^ (unsigned char)file.data[i]) * 1099511628211ull;
+	return hash;
+}
@@ -1,101 +1,468 @@
 #include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <cstring>
+#include <chrono>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 
 #include <../include/common/objloader.hpp>
+#include <../include/common/mappedfile.hpp>
+#include <../include/common/parallel.hpp>
 
-bool loadOBJ(
-	const char * path, 
-	std::vector<glm::vec3> & out_vertices, 
-	std::vector<glm::vec2> & out_uvs,
-	std::vector<glm::vec3> & out_normals
-){
-	printf("Loading OBJ file %s...\n", path);
+// One corner of a face, as the 1-based v/vt/vn indices written in the file
+struct ObjCorner{
+	unsigned int vertex;
+	unsigned int uv;
+	unsigned int normal;
+};
+
+// Everything read from a range of the file, before de-indexing
+struct ObjData{
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjCorner> corners; // 3 per triangle
+};
+
+static inline bool isBlank(char c){
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char * skipBlanks(const char * p, const char * end){
+	while (p < end && isBlank(*p))
+		p++;
+	return p;
+}
+
+static inline const char * nextLine(const char * p, const char * end){
+	const char * eol = (const char *)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+// Every power of ten up to 1e10 is exact in a float
+static const float exactPowersOf10[] = {
+	1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+};
 
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices; 
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
+// Reads one decimal float. The 6-decimal values Blender exports fit in 24 bits of mantissa,
+// so a single correctly rounded float multiply/divide gives exactly what fscanf("%f") gives.
+// Anything longer (or inf/nan) goes through strtof.
+static const char * parseFloat(const char * p, const char * end, float & out){
+	p = skipBlanks(p, end);
+	const char * start = p;
 
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')){
+		negative = (*p == '-');
+		p++;
+	}
 
-	FILE * file = fopen(path, "r");
-	if( file == NULL ){
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	while (p < end && *p >= '0' && *p <= '9'){
+		mantissa = mantissa * 10 + (*p - '0');
+		digits++;
+		p++;
+	}
+	if (p < end && *p == '.'){
+		p++;
+		while (p < end && *p >= '0' && *p <= '9'){
+			mantissa = mantissa * 10 + (*p - '0');
+			digits++;
+			exponent--;
+			p++;
+		}
+	}
+	bool fast = digits > 0 && digits <= 19;
+	if (fast && p < end && (*p == 'e' || *p == 'E')){
+		p++;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+')){
+			negativeExponent = (*p == '-');
+			p++;
+		}
+		int e = 0;
+		while (p < end && *p >= '0' && *p <= '9' && e < 10000){
+			e = e * 10 + (*p - '0');
+			p++;
+		}
+		exponent += negativeExponent ? -e : e;
+	}
+
+	if (fast && mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10){
+		float value = (float)mantissa;
+		value = exponent < 0 ? value / exactPowersOf10[-exponent] : value * exactPowersOf10[exponent];
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// Slow path : copy the token so strtof can't run past the end of the mapping
+	const char * tokenEnd = start;
+	while (tokenEnd < end && !isBlank(*tokenEnd) && *tokenEnd != '\n')
+		tokenEnd++;
+	char buffer[64];
+	size_t length = tokenEnd - start;
+	if (length == 0 || length >= sizeof(buffer))
+		return NULL;
+	memcpy(buffer, start, length);
+	buffer[length] = '\0';
+	char * parsedEnd;
+	out = strtof(buffer, &parsedEnd);
+	if (parsedEnd == buffer)
+		return NULL;
+	return start + (parsedEnd - buffer);
+}
+
+static inline const char * parseIndex(const char * p, const char * end, unsigned int & out){
+	unsigned int value = 0;
+	const char * start = p;
+	while (p < end && *p >= '0' && *p <= '9'){
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+	out = value;
+	return p == start ? NULL : p;
+}
+
+// Reads one "v/vt/vn" corner
+static inline const char * parseCorner(const char * p, const char * end, ObjCorner & corner){
+	p = parseIndex(p, end, corner.vertex);
+	if (p == NULL || p >= end || *p != '/') return NULL;
+	p = parseIndex(p + 1, end, corner.uv);
+	if (p == NULL || p >= end || *p != '/') return NULL;
+	return parseIndex(p + 1, end, corner.normal);
+}
+
+enum ObjRecord { OBJ_OTHER, OBJ_VERTEX, OBJ_UV, OBJ_NORMAL, OBJ_FACE };
+
+// Looks at the keyword at p and moves p past it
+static inline ObjRecord readKeyword(const char * & p, const char * end){
+	if (end - p >= 2 && isBlank(p[1])){
+		if (p[0] == 'v'){ p += 2; return OBJ_VERTEX; }
+		if (p[0] == 'f'){ p += 2; return OBJ_FACE; }
+	}else if (end - p >= 3 && p[0] == 'v' && isBlank(p[2])){
+		if (p[1] == 't'){ p += 3; return OBJ_UV; }
+		if (p[1] == 'n'){ p += 3; return OBJ_NORMAL; }
+	}
+	return OBJ_OTHER;
+}
+
+// Parses the v/vt/vn/f records in [begin, end). begin must be at the start of a line.
+// A first, cheap pass counts the records so every array is allocated exactly once.
+static bool parseOBJRange(const char * begin, const char * end, ObjData & data){
+
+	size_t vertexCount = 0, uvCount = 0, normalCount = 0, faceCount = 0;
+	for (const char * p = begin; p < end; p = nextLine(p, end)){
+		const char * q = skipBlanks(p, end);
+		switch (readKeyword(q, end)){
+			case OBJ_VERTEX: vertexCount++; break;
+			case OBJ_UV:     uvCount++;     break;
+			case OBJ_NORMAL: normalCount++; break;
+			case OBJ_FACE:   faceCount++;   break;
+			default: break;
+		}
+	}
+	data.vertices.resize(vertexCount);
+	data.uvs.resize(uvCount);
+	data.normals.resize(normalCount);
+	data.corners.reserve(faceCount * 3); // Polygons with more than 3 corners will grow it
+
+	size_t v = 0, vt = 0, vn = 0;
+	for (const char * p = begin; p < end; p = nextLine(p, end)){
+		p = skipBlanks(p, end);
+		switch (readKeyword(p, end)){
+			case OBJ_VERTEX:{
+				glm::vec3 & vertex = data.vertices[v++];
+				if (!(p = parseFloat(p, end, vertex.x)) || !(p = parseFloat(p, end, vertex.y)) || !(p = parseFloat(p, end, vertex.z)))
+					return false;
+				break;
+			}
+			case OBJ_UV:{
+				glm::vec2 & uv = data.uvs[vt++];
+				if (!(p = parseFloat(p, end, uv.x)) || !(p = parseFloat(p, end, uv.y)))
+					return false;
+				uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+				break;
+			}
+			case OBJ_NORMAL:{
+				glm::vec3 & normal = data.normals[vn++];
+				if (!(p = parseFloat(p, end, normal.x)) || !(p = parseFloat(p, end, normal.y)) || !(p = parseFloat(p, end, normal.z)))
+					return false;
+				break;
+			}
+			case OBJ_FACE:{
+				// Polygons are split in a fan around their first corner
+				ObjCorner first, previous, corner;
+				int cornerCount = 0;
+				p = skipBlanks(p, end);
+				while (p < end && *p != '\n'){
+					if (!(p = parseCorner(p, end, corner)))
+						return false;
+					if (cornerCount >= 2){
+						data.corners.push_back(first);
+						data.corners.push_back(previous);
+						data.corners.push_back(corner);
+					}
+					if (cornerCount == 0)
+						first = corner;
+					previous = corner;
+					cornerCount++;
+					p = skipBlanks(p, end);
+				}
+				if (cornerCount < 3)
+					return false;
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	return true;
+}
+
+// Chunks smaller than this aren't worth a thread
+static const size_t MIN_BYTES_PER_THREAD = 1 << 20;
+
+// A whole file after parsing : the attributes are concatenated, the face corners stay in
+// the chunk that read them and cornerBase[i] is where chunk i starts in the file-wide order.
+struct ObjFile{
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<ObjData> chunks;
+	std::vector<size_t> cornerBase;
+	size_t fileSize;
+};
+
+static bool readOBJFile(const char * path, unsigned int threadCount, ObjFile & obj){
+
+	MappedFile file;
+	if (!mapFile(path, file)){
 		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
 		getchar();
 		return false;
 	}
+	obj.fileSize = file.size;
 
-	while( 1 ){
-
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
-
-		// else : parse lineHeader
-		
-		if ( strcmp( lineHeader, "v" ) == 0 ){
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z );
-			temp_vertices.push_back(vertex);
-		}else if ( strcmp( lineHeader, "vt" ) == 0 ){
-			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y );
-			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			temp_uvs.push_back(uv);
-		}else if ( strcmp( lineHeader, "vn" ) == 0 ){
-			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z );
-			temp_normals.push_back(normal);
-		}else if ( strcmp( lineHeader, "f" ) == 0 ){
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2] );
-			if (matches != 9){
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				fclose(file);
-				return false;
+	// Split the file in one chunk per thread, each one starting at the beginning of a line
+	unsigned int chunkCount = workerCount(file.size, MIN_BYTES_PER_THREAD, threadCount);
+	std::vector<const char *> bounds(chunkCount + 1);
+	const char * end = file.data + file.size;
+	bounds[0] = file.data;
+	bounds[chunkCount] = end;
+	for (unsigned int i = 1; i < chunkCount; i++){
+		const char * p = file.data + file.size / chunkCount * i;
+		bounds[i] = p < bounds[i-1] ? bounds[i-1] : nextLine(p, end);
+	}
+
+	std::vector<ObjData> & chunks = obj.chunks;
+	chunks.resize(chunkCount);
+	std::vector<char> ok(chunkCount);
+	runParallel(chunkCount, [&](unsigned int i){
+		ok[i] = parseOBJRange(bounds[i], bounds[i+1], chunks[i]);
+	});
+	unmapFile(file);
+
+	// Prefix sums : where each chunk's records land in the file-wide arrays.
+	// Face indices are absolute, so they stay valid once the chunks are concatenated.
+	std::vector<size_t> vertexBase(chunkCount + 1, 0), uvBase(chunkCount + 1, 0), normalBase(chunkCount + 1, 0);
+	obj.cornerBase.assign(chunkCount + 1, 0);
+	for (unsigned int i = 0; i < chunkCount; i++){
+		if (!ok[i]){
+			printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+			return false;
+		}
+		vertexBase    [i+1] = vertexBase    [i] + chunks[i].vertices.size();
+		uvBase        [i+1] = uvBase        [i] + chunks[i].uvs.size();
+		normalBase    [i+1] = normalBase    [i] + chunks[i].normals.size();
+		obj.cornerBase[i+1] = obj.cornerBase[i] + chunks[i].corners.size();
+	}
+
+	// Concatenate the attributes and check that every corner points to one of them
+	obj.vertices.resize(vertexBase[chunkCount]);
+	obj.uvs     .resize(uvBase[chunkCount]);
+	obj.normals .resize(normalBase[chunkCount]);
+	runParallel(chunkCount, [&](unsigned int i){
+		ObjData & chunk = chunks[i];
+		std::copy(chunk.vertices.begin(), chunk.vertices.end(), obj.vertices.begin() + vertexBase[i]);
+		std::copy(chunk.uvs     .begin(), chunk.uvs     .end(), obj.uvs     .begin() + uvBase[i]);
+		std::copy(chunk.normals .begin(), chunk.normals .end(), obj.normals .begin() + normalBase[i]);
+		std::vector<glm::vec3>().swap(chunk.vertices);
+		std::vector<glm::vec2>().swap(chunk.uvs);
+		std::vector<glm::vec3>().swap(chunk.normals);
+		for (size_t c = 0; c < chunk.corners.size(); c++){
+			const ObjCorner & corner = chunk.corners[c];
+			if (corner.vertex - 1 >= obj.vertices.size() || corner.uv - 1 >= obj.uvs.size() || corner.normal - 1 >= obj.normals.size()){
+				ok[i] = false;
+				break;
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices    .push_back(uvIndex[0]);
-			uvIndices    .push_back(uvIndex[1]);
-			uvIndices    .push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		}else{
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
 		}
+	});
+	for (unsigned int i = 0; i < chunkCount; i++){
+		if (!ok[i]){
+			printf("%s references a vertex that doesn't exist\n", path);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool printOBJLoadTime = false;
+
+static void printLoadTime(const char * path, const ObjFile & obj, std::chrono::steady_clock::time_point startTime){
+	if (!printOBJLoadTime)
+		return;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Loaded %s : %u triangles, %.2f MB in %.2f ms on %u thread(s) (%.1f MB/s)\n", path,
+		(unsigned int)(obj.cornerBase.back() / 3), obj.fileSize / 1048576.0, seconds * 1000.0,
+		(unsigned int)obj.chunks.size(), obj.fileSize / 1048576.0 / seconds);
+}
+
+static bool loadOBJFile(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	printf("Loading OBJ file %s...\n", path);
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	ObjFile obj;
+	if (!readOBJFile(path, threadCount, obj))
+		return false;
+
+	size_t first = out_vertices.size();
+	out_vertices.resize(first + obj.cornerBase.back());
+	out_uvs     .resize(first + obj.cornerBase.back());
+	out_normals .resize(first + obj.cornerBase.back());
+
+	// For each vertex of each triangle, fetch its attributes through the indices
+	runParallel((unsigned int)obj.chunks.size(), [&](unsigned int i){
+		const std::vector<ObjCorner> & corners = obj.chunks[i].corners;
+		size_t out = first + obj.cornerBase[i];
+		for (size_t c = 0; c < corners.size(); c++, out++){
+			const ObjCorner & corner = corners[c];
+			out_vertices[out] = obj.vertices[ corner.vertex-1 ];
+			out_uvs     [out] = obj.uvs     [ corner.uv-1 ];
+			out_normals [out] = obj.normals [ corner.normal-1 ];
+		}
+	});
+
+	printLoadTime(path, obj, startTime);
+	return true;
+}
+
+bool loadOBJ(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals
+){
+	return loadOBJFile(path, out_vertices, out_uvs, out_normals, 1);
+}
 
+bool loadOBJ_parallel(
+	const char * path,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	return loadOBJFile(path, out_vertices, out_uvs, out_normals, threadCount);
+}
+
+static inline unsigned int hashCorner(const ObjCorner & corner){
+	unsigned int hash = corner.vertex * 0x9E3779B1u ^ corner.uv * 0x85EBCA77u ^ corner.normal * 0xC2B2AE3Du;
+	hash ^= hash >> 15;
+	hash *= 0x2C1B3C6Du;
+	hash ^= hash >> 12;
+	return hash;
+}
+
+static const unsigned int EMPTY_SLOT = 0xFFFFFFFFu;
+
+bool loadOBJ_indexed(
+	const char * path,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount
+){
+	printf("Loading OBJ file %s...\n", path);
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	ObjFile obj;
+	if (!readOBJFile(path, threadCount, obj))
+		return false;
+
+	// Each distinct v/vt/vn triple becomes one output vertex, numbered in order of first use.
+	// Open addressing with linear probing; the table holds the number of the vertex in the slot.
+	std::vector<ObjCorner> uniqueCorners;
+	uniqueCorners.reserve(obj.vertices.size() + obj.vertices.size() / 2);
+	size_t capacity = 1024;
+	while (capacity < uniqueCorners.capacity() * 2)
+		capacity *= 2;
+	std::vector<unsigned int> slots(capacity, EMPTY_SLOT);
+
+	size_t firstIndex = out_indices.size();
+	unsigned int firstVertex = (unsigned int)out_vertices.size();
+	out_indices.resize(firstIndex + obj.cornerBase.back());
+	unsigned int * index = out_indices.empty() ? NULL : &out_indices[firstIndex];
+
+	for (size_t i = 0; i < obj.chunks.size(); i++){
+		const std::vector<ObjCorner> & corners = obj.chunks[i].corners;
+		for (size_t c = 0; c < corners.size(); c++){
+			const ObjCorner & corner = corners[c];
+			size_t mask = slots.size() - 1;
+			size_t slot = hashCorner(corner) & mask;
+			while (slots[slot] != EMPTY_SLOT){
+				const ObjCorner & other = uniqueCorners[slots[slot]];
+				if (other.vertex == corner.vertex && other.uv == corner.uv && other.normal == corner.normal)
+					break;
+				slot = (slot + 1) & mask;
+			}
+			if (slots[slot] == EMPTY_SLOT){
+				slots[slot] = (unsigned int)uniqueCorners.size();
+				uniqueCorners.push_back(corner);
+
+				// Keep the table at most half full
+				if (uniqueCorners.size() * 2 > slots.size()){
+					std::vector<unsigned int>(slots.size() * 2, EMPTY_SLOT).swap(slots);
+					mask = slots.size() - 1;
+					for (size_t u = 0; u < uniqueCorners.size(); u++){
+						size_t s = hashCorner(uniqueCorners[u]) & mask;
+						while (slots[s] != EMPTY_SLOT)
+							s = (s + 1) & mask;
+						slots[s] = (unsigned int)u;
+					}
+				}
+				*index++ = firstVertex + (unsigned int)uniqueCorners.size() - 1;
+			}else{
+				*index++ = firstVertex + slots[slot];
+			}
+		}
+		std::vector<ObjCorner>().swap(obj.chunks[i].corners);
 	}
+	std::vector<unsigned int>().swap(slots);
 
-	// For each vertex of each triangle
-	for( unsigned int i=0; i<vertexIndices.size(); i++ ){
-
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
-		
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[ vertexIndex-1 ];
-		glm::vec2 uv = temp_uvs[ uvIndex-1 ];
-		glm::vec3 normal = temp_normals[ normalIndex-1 ];
-		
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs     .push_back(uv);
-		out_normals .push_back(normal);
-	
+	out_vertices.resize(firstVertex + uniqueCorners.size());
+	out_uvs     .resize(firstVertex + uniqueCorners.size());
+	out_normals .resize(firstVertex + uniqueCorners.size());
+	for (size_t u = 0; u < uniqueCorners.size(); u++){
+		const ObjCorner & corner = uniqueCorners[u];
+		out_vertices[firstVertex + u] = obj.vertices[ corner.vertex-1 ];
+		out_uvs     [firstVertex + u] = obj.uvs     [ corner.uv-1 ];
+		out_normals [firstVertex + u] = obj.normals [ corner.normal-1 ];
 	}
-	fclose(file);
+
+	printLoadTime(path, obj, startTime);
+	if (printOBJLoadTime)
+		printf("%s : %u unique vertices for %u corners\n", path, (unsigned int)uniqueCorners.size(), (unsigned int)obj.cornerBase.back());
 	return true;
 }
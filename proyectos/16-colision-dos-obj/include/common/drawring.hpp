@@ -0,0 +1,40 @@
+#ifndef DRAWRING_HPP
+#define DRAWRING_HPP
+
+// Per-draw uniforms of a whole frame in one uniform buffer. The draws of a frame are added first
+// (addDraw), sent to the GPU in a single upload (uploadDraws), and each draw then only binds its
+// slice of the buffer to DRAW_BLOCK_BINDING (bindDraw) instead of setting uniforms.
+// The buffer has a region for each of DRAW_RING_FRAMES frames in flight ; endDrawFrame leaves a
+// fence behind the draws of a region, and the region is only written again once the GPU is past it.
+// The shader side is drawblock.glsl.
+
+#define DRAW_RING_FRAMES 3
+
+// What DrawBlock holds, in std140 : each mat4 is 4 vec4 columns, the same as glm's
+struct DrawBlock{
+	glm::mat4 model;
+	glm::mat4 MVP;
+	glm::mat4 normalMatrix;  // Inverse transpose of model. A mat3 would be padded to 3 vec4 anyway
+	glm::vec4 material;      // Up to the shader : a color, a shininess...
+};
+
+struct DrawRing;
+
+// Room for maxDraws draws a frame to begin with ; the buffer grows when a frame has more
+DrawRing * createDrawRing(unsigned int maxDraws = 256);
+void deleteDrawRing(DrawRing * ring);
+
+// Adds a draw to the frame and returns the index bindDraw takes. Nothing reaches the GPU yet.
+unsigned int addDraw(DrawRing * ring, const glm::mat4 & model, const glm::mat4 & viewProjection, const glm::vec4 & material = glm::vec4(1.0f));
+
+// Writes the draws added since the last endDrawFrame to this frame's region, all at once.
+// Call after the last addDraw and before the first bindDraw of the frame.
+void uploadDraws(DrawRing * ring);
+
+// glBindBufferRange of the block of draw index to DRAW_BLOCK_BINDING
+void bindDraw(const DrawRing * ring, unsigned int index);
+
+// Call after the draws of the frame : fences them and moves on to the next region
+void endDrawFrame(DrawRing * ring);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+// Read-only view of a whole file, backed by mmap() or MapViewOfFile()
+struct MappedFile{
+	const char * data = NULL;
+	size_t size = 0;
+	void * handle = NULL; // Platform specific, don't touch
+};
+
+// Maps the file into memory. An empty file maps to data == NULL, size == 0.
+bool mapFile(const char * path, MappedFile & file);
+
+// Releases the view. Pointers into file.data are invalid afterwards.
+void unmapFile(MappedFile & file);
+
+// FNV-1a over 64-bit words : only meant to notice that two files differ, at memory speed
+unsigned long long hashFile(const MappedFile & file);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+// Something to draw, with a vertex array object of its own. The VAO remembers which buffer feeds
+// each attribute and how, the index buffer and the per-instance streams, all set once in buildMesh.
+// A draw is then glBindVertexArray and the draw call, instead of a round of glEnableVertexAttribArray /
+// glBindBuffer / glVertexAttribPointer per attribute every frame.
+// The buffers aren't the mesh's : they stay owned (and deleted) by whoever made them.
+
+struct MeshAttribute{
+	GLuint location;
+	GLuint buffer;
+	GLint size;              // Components, 1 to 4
+	GLenum type;             // GL_FLOAT, or an integer type read as float (normalized or not)
+	GLboolean normalized;
+	GLsizei stride;
+	size_t offset;
+	GLuint divisor;          // 0 : per vertex. n : one value every n instances
+};
+
+struct Mesh{
+	GLuint vao = 0;
+	std::vector<MeshAttribute> attributes;
+	GLuint elementbuffer = 0;          // 0 draws with glDrawArrays
+	GLenum indexType = GL_UNSIGNED_INT;
+	GLenum mode = GL_TRIANGLES;
+	GLsizei count = 0;                 // Vertices, or indices if there's an element buffer
+};
+
+void addMeshAttribute(Mesh & mesh, GLuint location, GLuint buffer, GLint size, GLenum type = GL_FLOAT,
+	GLboolean normalized = GL_FALSE, GLsizei stride = 0, size_t offset = 0, GLuint divisor = 0);
+
+// Records the attributes and the element buffer into mesh.vao, creating it the first time.
+// Call it again after pointing an attribute to another buffer. The VAO bound before stays bound.
+void buildMesh(Mesh & mesh);
+
+// They leave the mesh's VAO bound : the GL_ELEMENT_ARRAY_BUFFER binding is part of it, so bind
+// another VAO before binding an index buffer to fill it. The bind goes through bindVertexArray
+// (glstate.hpp), so consecutive draws of the same mesh only bind it once.
+void drawMesh(const Mesh & mesh);
+void drawMeshInstanced(const Mesh & mesh, GLsizei instances);
+
+// Deletes the VAO, not the buffers (and tells glstate it's gone)
+void deleteMesh(Mesh & mesh);
+
+// CPU cost of submitting the mesh draws times, both ways : re-specifying its attributes on a
+// shared VAO before each draw, and binding its own VAO. Each draw is only the first triangle and
+// rasterization is off, so it's the API calls and the driver's validation. Uses the program in use ;
+// prints microseconds per draw. The binds go straight to the driver, and glstate is reset afterwards.
+void benchmarkMeshSubmission(const Mesh & mesh, unsigned int draws);
+
+#endif
@@ -2,6 +2,7 @@
 #define TEXT2D_HPP
 
 void initText2D(const char * texturePath);
+// Leaves blending on : disable it with setCapability (glstate.hpp) before drawing opaque geometry
 void printText2D(const char * text, int x, int y, int size);
 void cleanupText2D();
 
@@ -1,16 +1,24 @@
 #version 330 core
 
-// Interpolated values from the vertex shaders
-in vec2 UV;
+// Variantes (QueueShaderVariant) : TEXTURA pinta la textura ; sin ella el objeto sale blanco
 
 // Output data
 out vec3 color;
 
+#ifdef TEXTURA
+// Interpolated values from the vertex shaders
+in vec2 UV;
+
 // Values that stay constant for the whole mesh.
 uniform sampler2D myTextureSampler;
+#endif
 
 void main(){
 
+#ifdef TEXTURA
 	// Output color = color of the texture at the specified UV
 	color = texture( myTextureSampler, UV ).rgb;
-}
\ No newline at end of file
+#else
+	color = vec3(1, 1, 1); // Blanco
+#endif
+}
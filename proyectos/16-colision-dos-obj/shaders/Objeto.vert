@@ -0,0 +1,22 @@
+#version 330 core
+
+// Variantes (QueueShaderVariant) : TEXTURA pasa las UV al fragment shader
+
+#include "transform.glsl"
+
+#ifdef TEXTURA
+layout(location = 1) in vec2 vertexUV;
+
+// Output data ; will be interpolated for each fragment.
+out vec2 UV;
+#endif
+
+void main(){
+
+	gl_Position = transformPosition();
+
+#ifdef TEXTURA
+	// UV of the vertex. No special space for this one.
+	UV = vertexUV;
+#endif
+}
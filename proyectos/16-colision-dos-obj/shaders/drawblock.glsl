@@ -0,0 +1,8 @@
+// Uniforms de cada dibujo : el trozo del DrawRing que bindDraw enlaza (drawring.hpp)
+
+layout(std140) uniform DrawBlock {
+	mat4 model;
+	mat4 MVP;
+	mat4 normalMatrix;
+	vec4 material;
+};
@@ -0,0 +1,12 @@
+// Posicion del vertice en clip space, comun a todas las variantes de Objeto.vert
+
+// Input vertex data, different for all executions of this shader.
+layout(location = 0) in vec3 vertexPosition_modelspace;
+
+// Values that stay constant for the whole mesh : MVP comes from the DrawBlock of the draw
+#include "drawblock.glsl"
+
+vec4 transformPosition(){
+	// Output position of the vertex, in clip space : MVP * position
+	return MVP * vec4(vertexPosition_modelspace, 1);
+}
@@ -0,0 +1,124 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <../include/common/shader.hpp>
+#include <../include/common/drawring.hpp>
+
+// With GL 4.4 the buffer is mapped once and for all (persistent, coherent) and uploadDraws is a
+// memcpy. Without it, each upload maps just its region, unsynchronized : the fence already says
+// the GPU is done with it, so there's no reason to let the driver wait or copy.
+struct DrawRing{
+	GLuint buffer;
+	unsigned char * memory;               // Persistent mapping, NULL without GL 4.4
+	GLsizeiptr stride;                    // sizeof(DrawBlock) rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+	unsigned int capacity;                // Draws in a region
+	unsigned int region;                  // The one this frame writes
+	GLsync fences[DRAW_RING_FRAMES];      // 0 while nothing reads the region
+	std::vector<unsigned char> blocks;    // The frame's blocks, stride apart, as they'll be in the buffer
+	unsigned int count;
+};
+
+static void waitRegion(DrawRing * ring, unsigned int region){
+	if (ring->fences[region] == 0)
+		return;
+	glClientWaitSync(ring->fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(ring->fences[region]);
+	ring->fences[region] = 0;
+}
+
+// (Re)creates the buffer with DRAW_RING_FRAMES regions of capacity draws
+static void allocateDrawRing(DrawRing * ring, unsigned int capacity){
+	for (unsigned int i = 0; i < DRAW_RING_FRAMES; i++)
+		waitRegion(ring, i);
+	if (ring->buffer != 0)
+		glDeleteBuffers(1, &ring->buffer);
+
+	ring->capacity = capacity;
+	ring->region = 0;
+	GLsizeiptr size = ring->stride * capacity * DRAW_RING_FRAMES;
+	glGenBuffers(1, &ring->buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+	if (GLAD_GL_VERSION_4_4){
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+		ring->memory = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+	}else{
+		glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		ring->memory = NULL;
+	}
+}
+
+DrawRing * createDrawRing(unsigned int maxDraws){
+	DrawRing * ring = new DrawRing();
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	ring->stride = (sizeof(DrawBlock) + alignment - 1) / alignment * alignment;
+	allocateDrawRing(ring, maxDraws > 0 ? maxDraws : 1);
+	return ring;
+}
+
+void deleteDrawRing(DrawRing * ring){
+	if (ring == NULL)
+		return;
+	for (unsigned int i = 0; i < DRAW_RING_FRAMES; i++)
+		if (ring->fences[i] != 0)
+			glDeleteSync(ring->fences[i]);
+	glDeleteBuffers(1, &ring->buffer); // Unmaps it too
+	delete ring;
+}
+
+unsigned int addDraw(DrawRing * ring, const glm::mat4 & model, const glm::mat4 & viewProjection, const glm::vec4 & material){
+	size_t offset = (size_t)ring->count * ring->stride;
+	if (ring->blocks.size() < offset + ring->stride)
+		ring->blocks.resize(offset + ring->stride);
+
+	DrawBlock * block = (DrawBlock *)&ring->blocks[offset];
+	block->model = model;
+	block->MVP = viewProjection * model;
+	block->normalMatrix = glm::transpose(glm::inverse(model));
+	block->material = material;
+	return ring->count++;
+}
+
+void uploadDraws(DrawRing * ring){
+	if (ring->count > ring->capacity){
+		unsigned int capacity = ring->capacity * 2 > ring->count ? ring->capacity * 2 : ring->count;
+		printf("Growing the draw ring from %u to %u draws a frame\n", ring->capacity, capacity);
+		allocateDrawRing(ring, capacity);
+	}
+	if (ring->count == 0)
+		return;
+
+	waitRegion(ring, ring->region);
+	GLintptr offset = ring->stride * ring->capacity * ring->region;
+	GLsizeiptr size = ring->stride * ring->count;
+	if (ring->memory != NULL){
+		memcpy(ring->memory + offset, &ring->blocks[0], size);
+		return;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+	void * memory = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (memory != NULL){
+		memcpy(memory, &ring->blocks[0], size);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}else{
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, &ring->blocks[0]);
+	}
+}
+
+void bindDraw(const DrawRing * ring, unsigned int index){
+	GLintptr offset = ring->stride * (ring->capacity * ring->region + index);
+	glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_BLOCK_BINDING, ring->buffer, offset, sizeof(DrawBlock));
+}
+
+void endDrawFrame(DrawRing * ring){
+	if (ring->count > 0)
+		ring->fences[ring->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring->region = (ring->region + 1) % DRAW_RING_FRAMES;
+	ring->count = 0;
+}
@@ -20,6 +20,10 @@ using namespace glm;
 #include <../include/common/texture.hpp>
 #include <../include/common/controls.hpp>
 #include <../include/common/objloader.hpp>
+#include <../include/common/meshcache.hpp>
+#include <../include/common/drawring.hpp>
+#include <../include/common/mesh.hpp>
+#include <../include/common/glstate.hpp>
 
 
 const float orbitRadiusSaturno = 10.0f; // Radio de la órbita para Saturno
@@ -94,45 +98,65 @@ int main( void )
 	glGenVertexArrays(1, &VertexArrayID);
 	glBindVertexArray(VertexArrayID);
 
-	// Create and compile our GLSL program from the shaders
-	GLuint programIDSaturno = LoadShaders( "../shaders/TransformVertexShaderMaza.glsl", "../shaders/TextureFragmentShaderMaza.glsl" );
-	GLuint programIDUrano = LoadShaders("../shaders/VertexPlano.glsl","../shaders/FragmentPlano.glsl");
+	// Create and compile our GLSL program from the shaders : variantes de Objeto.vert/frag,
+	// Saturno con textura, Urano y la linea blancos (la misma variante, se compila una vez)
+	GLuint programIDSaturno = QueueShaderVariant( "../shaders/Objeto.vert", "../shaders/Objeto.frag", "TEXTURA" );
+	GLuint programIDUrano = QueueShaderVariant( "../shaders/Objeto.vert", "../shaders/Objeto.frag", "" );
+	GLuint programIDLinea = QueueShaderVariant( "../shaders/Objeto.vert", "../shaders/Objeto.frag", "" );
 
-	// Get a handle for our "MVP" uniform
-	GLuint MatrixIDSaturno = glGetUniformLocation(programIDSaturno, "MVP");
-	GLuint MatrixIDUrano = glGetUniformLocation(programIDUrano, "MVP");
+	// Las MVP ya no son uniforms sueltos : cada dibujo lee la suya del DrawBlock (drawblock.glsl),
+	// todas las del frame van al DrawRing de una vez y cada dibujo enlaza solo su trozo
+	// (los programas siguen compilando mientras se cargan la textura y los modelos)
+	DrawRing * draws = createDrawRing();
 
 	// Textura de Saturno
 	GLuint TextureSaturno = loadDDS("../shaders/Saturn2_Saturn_Metallic_1.dds");
-	GLuint TextureIDSaturno  = glGetUniformLocation(programIDSaturno, "myTextureSampler");
 
-	// variables para saturno
-	std::vector<glm::vec3> verticesSaturno;
-	std::vector<glm::vec2> uvsSaturno;
-	std::vector<glm::vec3> normalsSaturno; // Won't be used at the moment.
-	bool saturno = loadOBJ("../models/saturno.obj", verticesSaturno, uvsSaturno, normalsSaturno);
-
-		// Variables para urano
-	std::vector<glm::vec3> verticesUrano;
-	std::vector<glm::vec2> uvsUrano;  
-	std::vector<glm::vec3> normalsUrano; 
-	bool urano = loadOBJ("../models/urano.obj", verticesUrano, uvsUrano, normalsUrano);
+	// Saturno y urano : el primer arranque parsea los .obj y deja un ../models/*.obj.meshcache,
+	// los siguientes solo mapean ese archivo y se lo pasan tal cual a glBufferData
+	MeshCache saturno, urano;
+	if (!loadOBJ_cached("../models/saturno.obj", saturno) || !loadOBJ_cached("../models/urano.obj", urano)){
+		glfwTerminate();
+		return -1;
+	}
+	GLsizei vertexCountSaturno = saturno.vertexCount;
+	GLsizei vertexCountUrano = urano.vertexCount;
 
 	// Carga en un VBO para el saturno y urano
 	GLuint vertexbufferUrano,vertexbufferSaturno,lineBuffer;
 
 	glGenBuffers(1, &vertexbufferUrano);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexbufferUrano);
-	glBufferData(GL_ARRAY_BUFFER, verticesUrano.size() * sizeof(glm::vec3), &verticesUrano[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertexCountUrano * sizeof(glm::vec3), urano.vertices, GL_STATIC_DRAW);
 
 	glGenBuffers(1, &vertexbufferSaturno);
 	glBindBuffer(GL_ARRAY_BUFFER, vertexbufferSaturno);
-	glBufferData(GL_ARRAY_BUFFER, verticesSaturno.size() * sizeof(glm::vec3), &verticesSaturno[0], GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertexCountSaturno * sizeof(glm::vec3), saturno.vertices, GL_STATIC_DRAW);
+
+	// OpenGL ya tiene su copia
+	closeMeshCache(saturno);
+	closeMeshCache(urano);
 
 	glGenBuffers(1, &lineBuffer);
 	glBindBuffer(GL_ARRAY_BUFFER, lineBuffer);
 	glBufferData(GL_ARRAY_BUFFER, 2 * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
 
+	// Un VAO por objeto, armado una vez : los dibujos solo lo enlazan
+	Mesh meshUrano, meshSaturno, meshLinea;
+	meshUrano.count = vertexCountUrano;
+	addMeshAttribute(meshUrano, 0, vertexbufferUrano, 3);
+	buildMesh(meshUrano);
+	meshSaturno.count = vertexCountSaturno;
+	addMeshAttribute(meshSaturno, 0, vertexbufferSaturno, 3);
+	buildMesh(meshSaturno);
+	meshLinea.mode = GL_LINES;
+	meshLinea.count = 2;
+	addMeshAttribute(meshLinea, 0, lineBuffer, 3);
+	buildMesh(meshLinea);
+
+	// Ya con todo cargado : aqui se recoge el programa de Saturno, si no termino de compilar
+	GLint TextureIDSaturno = UniformLocation(programIDSaturno, "myTextureSampler");
+
     float angleSaturno = 0.0f;
     float angleUrano = 0.0f;
 	float scaleFactor = 1.0f;
@@ -146,15 +170,13 @@ int main( void )
 		computeMatricesFromInputs();
 		glm::mat4 ProjectionMatrix = getProjectionMatrix();
 		glm::mat4 ViewMatrix = getViewMatrix();
-		glm::mat4 ModelMatrix = glm::mat4(1.0);
-		glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
+		glm::mat4 ViewProjectionMatrix = ProjectionMatrix * ViewMatrix;
 
         // Update rotation angles
         angleSaturno += rotationAngleSaturno;
         angleUrano += rotationAngleUrano;
 
-		// ---- Renderizar el urano ----
-		glUseProgram(programIDUrano); 
+		// ---- Matrices de urano ----
 		// Matriz de escalado
 		glm::mat4 ScaleMatrixUrano = glm::scale(glm::mat4(1.0f), glm::vec3(scaleFactor, scaleFactor, scaleFactor));
 		// Matriz de traslación (desplazando 5 unidades en el eje x)
@@ -163,18 +185,8 @@ int main( void )
 		glm::mat4 OrbitMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(cos(angleUrano) * orbitRadiusUrano, 0.0f, sin(angleUrano) * orbitRadiusUrano));
 		// Combina las transformaciones
 		glm::mat4 ModelMatrixUrano = TranslationMatrix * OrbitMatrix * ScaleMatrixUrano;
-        glm::mat4 MVPUrano = ProjectionMatrix * ViewMatrix * ModelMatrixUrano;
-        glUniformMatrix4fv(MatrixIDUrano, 1, GL_FALSE, &MVPUrano[0][0]);
-
-		// Enviar los vértices de urano
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbufferUrano);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-		glDrawArrays(GL_TRIANGLES, 0, verticesUrano.size());
-		glDisableVertexAttribArray(0);
 
-		// ---- Renderizar la saturno ----
-		glUseProgram(programIDSaturno); 
+		// ---- Matrices de saturno ----
 		// Matriz de escalado para Saturno
 		glm::mat4 ScaleMatrixSaturno = glm::scale(glm::mat4(1.0f), glm::vec3(scaleFactor, scaleFactor, scaleFactor));
 		// Matriz de traslación (desplazando unidades en el eje )
@@ -183,17 +195,33 @@ int main( void )
 		glm::mat4 OrbitMatrixSaturno = glm::translate(glm::mat4(1.0f), glm::vec3(cos(angleSaturno) * orbitRadiusSaturno, 0.0f, sin(angleSaturno) * orbitRadiusSaturno));
 		// Combina las transformaciones
 		glm::mat4 ModelMatrixSaturno = TranslationMatrixSaturno * OrbitMatrixSaturno * ScaleMatrixSaturno;
-		// matriz mvp
-        glm::mat4 MVPSaturno = ProjectionMatrix * ViewMatrix * ModelMatrixSaturno;
-        glUniformMatrix4fv(MatrixIDSaturno, 1, GL_FALSE, &MVPSaturno[0][0]);
-
-		// Enviar los vértices 
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbufferSaturno);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+		// Restablecer la transformación de la línea a una identidad
+		glm::mat4 ModelMatrixLine = glm::mat4(1.0f);
+
+		// Los tres bloques del frame, en una sola subida
+		unsigned int drawUrano = addDraw(draws, ModelMatrixUrano, ViewProjectionMatrix);
+		unsigned int drawSaturno = addDraw(draws, ModelMatrixSaturno, ViewProjectionMatrix);
+		unsigned int drawLinea = addDraw(draws, ModelMatrixLine, ViewProjectionMatrix);
+		uploadDraws(draws);
+
+		// ---- Renderizar el urano ----
+		// Los cambios de programa, textura y buffer pasan por glstate : lo que ya está puesto no se vuelve a mandar
+		bindProgram(programIDUrano);
+		bindDraw(draws, drawUrano);
+
+		// Dibujar urano
+		drawMesh(meshUrano);
+
+		// ---- Renderizar la saturno ----
+		bindProgram(programIDSaturno);
+		bindDraw(draws, drawSaturno);
+		// Textura de Saturno en la unidad 0
+		bindTexture(0, GL_TEXTURE_2D, TextureSaturno);
+		setSamplerUniform(programIDSaturno, TextureIDSaturno, 0);
+
 		// Dibujar saturno
-		glDrawArrays(GL_TRIANGLES, 0, verticesSaturno.size());
-		glDisableVertexAttribArray(0);
+		drawMesh(meshSaturno);
 	
 
 		// Definir las posiciones de los objetos en el espacio
@@ -202,23 +230,15 @@ int main( void )
 
 		// Actualizar los datos de los vértices de la línea
 		std::vector<glm::vec3> lineVertices = { posicionSaturno, posicionUrano };
-		glBindBuffer(GL_ARRAY_BUFFER, lineBuffer);
+		bindBuffer(GL_ARRAY_BUFFER, lineBuffer);
 		glBufferSubData(GL_ARRAY_BUFFER, 0, lineVertices.size() * sizeof(glm::vec3), &lineVertices[0]);
 
-		// Restablecer la transformación de la línea a una identidad
-		glm::mat4 ModelMatrixLine = glm::mat4(1.0f);
-		glm::mat4 MVPLine = ProjectionMatrix * ViewMatrix * ModelMatrixLine;
-
-		// Usar uno de los programas de shader para la línea 
-		glUseProgram(programIDSaturno);
-		glUniformMatrix4fv(MatrixIDSaturno, 1, GL_FALSE, &MVPLine[0][0]);  // Asignar la matriz MVP para la línea
+		// La linea usa la variante blanca, sin UV que leer (el mismo programa que urano)
+		bindProgram(programIDLinea);
+		bindDraw(draws, drawLinea);  // El bloque con la matriz MVP de la línea
 
-		// Dibujar la línea
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, lineBuffer);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-		glDrawArrays(GL_LINES, 0, 2);  // Dibujar la línea entre los dos puntos
-		glDisableVertexAttribArray(0);
+		// Dibujar la línea entre los dos puntos (su VAO sigue leyendo lineBuffer)
+		drawMesh(meshLinea);
 
 		// Calcular la distancia entre Saturno y Urano
         float distancia = distance(posicionSaturno, posicionUrano);
@@ -228,16 +248,27 @@ int main( void )
             printf("Las orbitas se han intersectado.\n");
         }
 
+		// Los bloques de este frame no se reescriben hasta que la GPU los haya usado
+		endDrawFrame(draws);
+		endGLStateFrame();
+
 		// Intercambiar buffers
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
+	// Llamadas de estado por frame, y cuantas se ahorraron (solo con printGLStateCalls = true)
+	printGLStateCounters();
+
 	// Cleanup VBOs, shaders, and texture
 	glDeleteBuffers(1, &vertexbufferSaturno);
 	glDeleteBuffers(1, &vertexbufferUrano);
 	glDeleteBuffers(1, &lineBuffer);
-	glDeleteProgram(programIDSaturno);
-	glDeleteProgram(programIDUrano);
+	deleteMesh(meshUrano);
+	deleteMesh(meshSaturno);
+	deleteMesh(meshLinea);
+	DeleteProgram(programIDSaturno);
+	DeleteProgram(programIDUrano);
+	deleteDrawRing(draws);
 	glDeleteTextures(1, &TextureSaturno); // Liberar la textura
 	glDeleteVertexArrays(1, &VertexArrayID);
 
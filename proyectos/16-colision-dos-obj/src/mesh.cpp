@@ -0,0 +1,143 @@
+#include <vector>
+#include <stdio.h>
+#include <chrono>
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <../include/common/shader.hpp>
+#include <../include/common/glstate.hpp>
+#include <../include/common/mesh.hpp>
+
+void addMeshAttribute(Mesh & mesh, GLuint location, GLuint buffer, GLint size, GLenum type,
+	GLboolean normalized, GLsizei stride, size_t offset, GLuint divisor){
+	MeshAttribute attribute;
+	attribute.location = location;
+	attribute.buffer = buffer;
+	attribute.size = size;
+	attribute.type = type;
+	attribute.normalized = normalized;
+	attribute.stride = stride;
+	attribute.offset = offset;
+	attribute.divisor = divisor;
+	mesh.attributes.push_back(attribute);
+}
+
+// What the render loops used to do before every draw : point each attribute to its buffer.
+// Also what buildMesh records, with the mesh's VAO bound. The binds go straight to the driver :
+// the loaders bind buffers behind glstate's back, and a skipped bind would record the wrong VBO.
+static void specifyAttributes(const Mesh & mesh){
+	for (size_t i = 0; i < mesh.attributes.size(); i++){
+		const MeshAttribute & attribute = mesh.attributes[i];
+		glEnableVertexAttribArray(attribute.location);
+		glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer);
+		glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized,
+			attribute.stride, (void*)attribute.offset);
+		if (attribute.divisor != 0)
+			glVertexAttribDivisor(attribute.location, attribute.divisor);
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.elementbuffer);
+}
+
+static void disableAttributes(const Mesh & mesh){
+	for (size_t i = 0; i < mesh.attributes.size(); i++){
+		if (mesh.attributes[i].divisor != 0)
+			glVertexAttribDivisor(mesh.attributes[i].location, 0);
+		glDisableVertexAttribArray(mesh.attributes[i].location);
+	}
+}
+
+void buildMesh(Mesh & mesh){
+	// Both put back at the end, so what glstate knows stays true
+	GLint previousVAO = 0, previousBuffer = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previousBuffer);
+	if (mesh.vao == 0)
+		glGenVertexArrays(1, &mesh.vao);
+	glBindVertexArray(mesh.vao);
+	// Attributes dropped or changed since the last build
+	GLint maxAttributes = 16;
+	glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttributes);
+	for (GLint i = 0; i < maxAttributes; i++){
+		glDisableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 0);
+	}
+	specifyAttributes(mesh);
+	glBindVertexArray(previousVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, previousBuffer);
+}
+
+void drawMesh(const Mesh & mesh){
+	bindVertexArray(mesh.vao);
+	if (mesh.elementbuffer != 0)
+		glDrawElements(mesh.mode, mesh.count, mesh.indexType, (void*)0);
+	else
+		glDrawArrays(mesh.mode, 0, mesh.count);
+}
+
+void drawMeshInstanced(const Mesh & mesh, GLsizei instances){
+	bindVertexArray(mesh.vao);
+	if (mesh.elementbuffer != 0)
+		glDrawElementsInstanced(mesh.mode, mesh.count, mesh.indexType, (void*)0, instances);
+	else
+		glDrawArraysInstanced(mesh.mode, 0, mesh.count, instances);
+}
+
+void deleteMesh(Mesh & mesh){
+	forgetVertexArray(mesh.vao);
+	glDeleteVertexArrays(1, &mesh.vao);
+	mesh.vao = 0;
+}
+
+void benchmarkMeshSubmission(const Mesh & mesh, unsigned int draws){
+	if (draws == 0)
+		return;
+	GLint previousVAO = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+	GLuint sharedVAO;
+	glGenVertexArrays(1, &sharedVAO);
+	glEnable(GL_RASTERIZER_DISCARD);
+	// Only the first triangle : what a draw costs to submit doesn't depend on its size, and
+	// a software renderer would otherwise be timing its vertex shader
+	Mesh triangle = mesh;
+	if (triangle.count > 3)
+		triangle.count = 3;
+
+	// Straight to the driver in both loops : glstate would skip the repeated binds, and only
+	// the draws would be left to time
+	// Before : one VAO for everything, attributes set up again around each draw
+	glBindVertexArray(sharedVAO);
+	glFinish();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < draws; i++){
+		specifyAttributes(triangle);
+		if (triangle.elementbuffer != 0)
+			glDrawElements(triangle.mode, triangle.count, triangle.indexType, (void*)0);
+		else
+			glDrawArrays(triangle.mode, 0, triangle.count);
+		disableAttributes(triangle);
+	}
+	double respecified = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	glFinish();
+
+	// After : the mesh's VAO, bound for each draw like a scene of different meshes would
+	start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < draws; i++){
+		glBindVertexArray(triangle.vao);
+		if (triangle.elementbuffer != 0)
+			glDrawElements(triangle.mode, triangle.count, triangle.indexType, (void*)0);
+		else
+			glDrawArrays(triangle.mode, 0, triangle.count);
+	}
+	double bound = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	glFinish();
+
+	glDisable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(previousVAO);
+	glDeleteVertexArrays(1, &sharedVAO);
+	// The VAO, the buffers and GL_RASTERIZER_DISCARD changed behind glstate's back
+	resetGLState();
+	printf("Submitting %u draws of %u attributes : %.3f us/draw re-specifying the attributes, %.3f us/draw with the VAO\n",
+		draws, (unsigned int)mesh.attributes.size(), respecified / draws, bound / draws);
+}
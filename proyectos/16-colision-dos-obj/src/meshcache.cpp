@@ -0,0 +1,277 @@
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <../include/common/objloader.hpp>
+#include <../include/common/meshcache.hpp>
+
+enum MeshStream {
+	STREAM_VERTICES,
+	STREAM_UVS,
+	STREAM_NORMALS,
+	STREAM_TANGENTS,
+	STREAM_BITANGENTS,
+	STREAM_INDICES,
+	STREAM_COUNT
+};
+
+// What's at the start of every .meshcache file. Streams follow, each 16-byte aligned.
+struct MeshCacheHeader{
+	char magic[8];                  // "MESHCACH"
+	uint32_t version;               // MESH_CACHE_VERSION
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;
+	uint64_t sourceSize;            // Key : the source file this was built from
+	int64_t  sourceTime;
+	uint64_t sourceHash;
+	uint64_t offsets[STREAM_COUNT]; // 0 when the stream isn't stored
+};
+
+static const char MESH_CACHE_MAGIC[8] = { 'M','E','S','H','C','A','C','H' };
+
+static std::string cachePathOf(const char * sourcePath){
+	return std::string(sourcePath) + ".meshcache";
+}
+
+// Puts from in place of to. The old file may still be mapped (by an open MeshCache) : it keeps
+// its contents until unmapped, and an interrupted write never leaves a half-written cache.
+static bool replaceFile(const char * from, const char * to){
+#ifdef _WIN32
+	// Fails while to is mapped : Windows can't replace a file in use
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+static bool statSource(const char * sourcePath, uint64_t & size, int64_t & time){
+	struct stat info;
+	if (stat(sourcePath, &info) != 0)
+		return false;
+	size = (uint64_t)info.st_size;
+	time = (int64_t)info.st_mtime;
+	return true;
+}
+
+static bool hashSource(const char * sourcePath, uint64_t & hash){
+	MappedFile source;
+	if (!mapFile(sourcePath, source))
+		return false;
+	hash = hashFile(source);
+	unmapFile(source);
+	return true;
+}
+
+static size_t streamBytes(const MeshCacheHeader & header, int stream){
+	switch (stream){
+		case STREAM_UVS:     return (size_t)header.vertexCount * sizeof(glm::vec2);
+		case STREAM_INDICES: return (size_t)header.indexCount * header.indexSize;
+		default:             return (size_t)header.vertexCount * sizeof(glm::vec3);
+	}
+}
+
+// Points the MeshCache at the streams of a cache image (mapped or in memory)
+static bool bindStreams(const char * data, size_t size, MeshCache & cache){
+	if (data == NULL || size < sizeof(MeshCacheHeader))
+		return false;
+	MeshCacheHeader header;
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != MESH_CACHE_VERSION)
+		return false;
+	if (header.indexCount > 0 && header.indexSize != 2 && header.indexSize != 4)
+		return false;
+
+	const void * streams[STREAM_COUNT];
+	for (int i = 0; i < STREAM_COUNT; i++){
+		streams[i] = NULL;
+		if (header.offsets[i] == 0)
+			continue;
+		if (header.offsets[i] % 16 != 0 || header.offsets[i] > size || streamBytes(header, i) > size - header.offsets[i])
+			return false;
+		streams[i] = data + header.offsets[i];
+	}
+	if (streams[STREAM_VERTICES] == NULL || streams[STREAM_UVS] == NULL || streams[STREAM_NORMALS] == NULL)
+		return false;
+
+	cache.vertexCount = header.vertexCount;
+	cache.indexCount  = header.indexCount;
+	cache.indexSize   = header.indexCount > 0 ? header.indexSize : 0;
+	cache.vertices    = (const glm::vec3 *)streams[STREAM_VERTICES];
+	cache.uvs         = (const glm::vec2 *)streams[STREAM_UVS];
+	cache.normals     = (const glm::vec3 *)streams[STREAM_NORMALS];
+	cache.tangents    = (const glm::vec3 *)streams[STREAM_TANGENTS];
+	cache.bitangents  = (const glm::vec3 *)streams[STREAM_BITANGENTS];
+	cache.indices     = header.indexCount > 0 ? streams[STREAM_INDICES] : NULL;
+	return true;
+}
+
+static void resetStreams(MeshCache & cache){
+	cache.vertexCount = 0;
+	cache.indexCount = 0;
+	cache.indexSize = 0;
+	cache.vertices = NULL;
+	cache.uvs = NULL;
+	cache.normals = NULL;
+	cache.tangents = NULL;
+	cache.bitangents = NULL;
+	cache.indices = NULL;
+}
+
+bool openMeshCache(const char * sourcePath, MeshCache & cache){
+
+	closeMeshCache(cache);
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!statSource(sourcePath, sourceSize, sourceTime))
+		return false;
+
+	std::string cachePath = cachePathOf(sourcePath);
+	if (!mapFile(cachePath.c_str(), cache.file))
+		return false;
+
+	MeshCacheHeader header;
+	bool valid = cache.file.size >= sizeof(header);
+	if (valid){
+		memcpy(&header, cache.file.data, sizeof(header));
+		valid = header.sourceSize == sourceSize;
+	}
+	bool touched = false;
+	if (valid && header.sourceTime != sourceTime){
+		// Same size, different time : only trust the cache if the contents didn't change
+		uint64_t sourceHash;
+		valid = hashSource(sourcePath, sourceHash) && sourceHash == header.sourceHash;
+		touched = valid;
+	}
+	if (!valid || !bindStreams(cache.file.data, cache.file.size, cache)){
+		closeMeshCache(cache);
+		return false;
+	}
+	if (touched){
+		// Remember the new time so the next run doesn't have to hash again. Only now : a file of
+		// another version or a broken one must not be marked as up to date.
+		FILE * file = fopen(cachePath.c_str(), "r+b");
+		if (file){
+			int64_t time = sourceTime;
+			fseek(file, offsetof(MeshCacheHeader, sourceTime), SEEK_SET);
+			fwrite(&time, sizeof(time), 1, file);
+			fclose(file);
+		}
+	}
+	return true;
+}
+
+bool writeMeshCache(
+	const char * sourcePath,
+	const std::vector<glm::vec3> & vertices,
+	const std::vector<glm::vec2> & uvs,
+	const std::vector<glm::vec3> & normals,
+	const std::vector<glm::vec3> & tangents,
+	const std::vector<glm::vec3> & bitangents,
+	const void * indices, unsigned int indexCount, unsigned int indexSize,
+	MeshCache & cache
+){
+	closeMeshCache(cache);
+
+	if (uvs.size() != vertices.size() || normals.size() != vertices.size()
+		|| (!tangents.empty() && tangents.size() != vertices.size())
+		|| (!bitangents.empty() && bitangents.size() != vertices.size())
+		|| (indices != NULL && indexSize != 2 && indexSize != 4)){
+		printf("Mesh streams for %s don't match, not caching them\n", sourcePath);
+		return false;
+	}
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.vertexCount = (uint32_t)vertices.size();
+	header.indexCount = indices != NULL ? indexCount : 0;
+	header.indexSize = indices != NULL ? indexSize : 0;
+	if (!statSource(sourcePath, header.sourceSize, header.sourceTime) || !hashSource(sourcePath, header.sourceHash)){
+		printf("Impossible to open %s to build its cache\n", sourcePath);
+		return false;
+	}
+
+	const void * streams[STREAM_COUNT] = {
+		vertices.empty() ? NULL : &vertices[0],
+		uvs.empty() ? NULL : &uvs[0],
+		normals.empty() ? NULL : &normals[0],
+		tangents.empty() ? NULL : &tangents[0],
+		bitangents.empty() ? NULL : &bitangents[0],
+		header.indexCount > 0 ? indices : NULL
+	};
+
+	// Lay the streams out after the header
+	size_t size = (sizeof(header) + 15) & ~(size_t)15;
+	for (int i = 0; i < STREAM_COUNT; i++){
+		if (streams[i] == NULL && i > STREAM_NORMALS)
+			continue;
+		header.offsets[i] = size;
+		size = (size + streamBytes(header, i) + 15) & ~(size_t)15;
+	}
+	std::vector<char> image(size, 0);
+	memcpy(&image[0], &header, sizeof(header));
+	for (int i = 0; i < STREAM_COUNT; i++){
+		if (streams[i] != NULL && streamBytes(header, i) > 0)
+			memcpy(&image[header.offsets[i]], streams[i], streamBytes(header, i));
+	}
+
+	// Written next to the cache, then renamed over it
+	std::string cachePath = cachePathOf(sourcePath);
+	std::string temporaryPath = cachePath + ".tmp";
+	FILE * file = fopen(temporaryPath.c_str(), "wb");
+	bool written = false;
+	if (file){
+		written = fwrite(&image[0], 1, size, file) == size;
+		written = (fclose(file) == 0) && written;
+		written = written && replaceFile(temporaryPath.c_str(), cachePath.c_str());
+		if (!written)
+			remove(temporaryPath.c_str());
+	}
+
+	if (written && mapFile(cachePath.c_str(), cache.file) && bindStreams(cache.file.data, cache.file.size, cache))
+		return true;
+
+	printf("Could not write %s, keeping the mesh in memory\n", cachePath.c_str());
+	unmapFile(cache.file);
+	cache.memory.swap(image);
+	return bindStreams(&cache.memory[0], cache.memory.size(), cache);
+}
+
+void closeMeshCache(MeshCache & cache){
+	unmapFile(cache.file);
+	std::vector<char>().swap(cache.memory);
+	resetStreams(cache);
+}
+
+bool loadOBJ_cached(const char * path, MeshCache & cache){
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	if (openMeshCache(path, cache) && cache.tangents == NULL && cache.indices == NULL){
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		printf("Loaded %s from its cache : %u vertices in %.2f ms\n", path, cache.vertexCount, seconds * 1000.0);
+		return true;
+	}
+	closeMeshCache(cache);
+
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if (!loadOBJ_parallel(path, vertices, uvs, normals))
+		return false;
+
+	std::vector<glm::vec3> none;
+	return writeMeshCache(path, vertices, uvs, normals, none, none, NULL, 0, 0, cache);
+}
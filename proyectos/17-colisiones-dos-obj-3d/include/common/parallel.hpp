@@ -0,0 +1,33 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <thread>
+#include <vector>
+
+// Number of threads worth using for `work` items when each thread should get at least
+// `minWorkPerThread` of them. requested == 0 means one per core.
+inline unsigned int workerCount(size_t work, size_t minWorkPerThread, unsigned int requested = 0){
+	unsigned int count = requested ? requested : std::thread::hardware_concurrency();
+	if (count == 0)
+		count = 1;
+	size_t useful = minWorkPerThread ? work / minWorkPerThread : work;
+	if (useful < count)
+		count = useful > 0 ? (unsigned int)useful : 1;
+	return count;
+}
+
+// Calls task(i) for every i in [0, count), each on its own thread.
+// The calling thread runs task(0) itself and returns once all of them are done.
+template <typename Task>
+void runParallel(unsigned int count, Task task){
+	std::vector<std::thread> threads;
+	threads.reserve(count > 1 ? count - 1 : 0);
+	for (unsigned int i = 1; i < count; i++)
+		threads.emplace_back(task, i);
+	if (count > 0)
+		task(0u);
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef RESOURCES_HPP
+#define RESOURCES_HPP
+
+// Assets shared by everything that asks for them. A file is only loaded once, whether it's
+// asked for again by the same path, by another path to it, or as a copy with the same contents.
+// Each acquire must be paired with a release ; the GL objects are deleted with the last one.
+
+// .dds through loadDDS, anything else through loadBMP_custom. Returns 0 if it can't be loaded.
+GLuint acquireTexture(const char * path);
+void releaseTexture(GLuint texture);
+
+// The same paths in the same order, packed into arrays by packTextures (texturearray.hpp). NULL if one can't be read
+const TexturePack * acquireTexturePack(const std::vector<const char *> & paths);
+void releaseTexturePack(const TexturePack * pack);
+
+// An indexed OBJ model (loadOBJ_indexed), with its vertex buffers already uploaded
+struct MeshResource{
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	GLuint elementbuffer;  // GL_UNSIGNED_INT
+	GLuint vertexbuffer;
+	GLuint uvbuffer;
+	GLuint normalbuffer;
+};
+
+// NULL if it can't be loaded
+const MeshResource * acquireMesh(const char * path);
+void releaseMesh(const MeshResource * mesh);
+
+// Prints every live resource with its references, paths and size in bytes
+void printResources();
+
+#endif
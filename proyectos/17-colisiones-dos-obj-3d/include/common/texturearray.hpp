@@ -0,0 +1,36 @@
+#ifndef TEXTUREARRAY_HPP
+#define TEXTUREARRAY_HPP
+
+// Textures packed as the layers of GL_TEXTURE_2D_ARRAYs, so the draws that sample any of them
+// bind the array once and only change a layer index. Textures with the same format share an array
+// (.DDS keep their compressed blocks, anything else goes through the BMP loader into GL_RGBA8 ;
+// so do DXT files when the driver has no S3TC). A texture smaller than the biggest of its array is
+// padded with copies of its edge and sampled through a UV scale, clamped to its edge : UVs outside
+// [0,1] (the OBJ loader's V is negative) have to be wrapped before the scale.
+
+// Where a texture ended up. In GLSL : texture(sampler, vec3(fract(UV) * scale, layer)), or textureGrad
+// with the derivatives of UV * scale so the jumps of fract don't pick the smallest mip level.
+struct TextureLayer{
+	GLuint array;        // GL_TEXTURE_2D_ARRAY
+	unsigned int layer;
+	glm::vec2 scale;     // (1,1) unless the texture is padded
+};
+
+struct TexturePack{
+	std::vector<GLuint> arrays;
+	std::vector<TextureLayer> layers;  // One per packed path, in the same order
+};
+
+// Packs the textures at paths. Returns false (and packs nothing) if one of them can't be read.
+bool packTextures(const std::vector<const char *> & paths, TexturePack & pack);
+void deleteTexturePack(TexturePack & pack);
+
+// Bakes the layer's scale into a mesh's UVs, for shaders that sample vec3(UV, layer) directly.
+// The mesh is moved by whole tiles to start in [0,1] ; its UVs shouldn't span more than one.
+void remapUVs(std::vector<glm::vec2> & uvs, const TextureLayer & layer);
+
+// Offline version : packs .DDS files of one format into a single array .DDS that loadDDS opens as a
+// GL_TEXTURE_2D_ARRAY, layer i being paths[i]. Returns false if the files would need several arrays.
+bool writeTextureArrayDDS(const std::vector<const char *> & paths, const char * outPath);
+
+#endif
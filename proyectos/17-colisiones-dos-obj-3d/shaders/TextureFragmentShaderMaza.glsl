@@ -7,10 +7,14 @@ in vec2 UV;
 out vec3 color;
 
 // Values that stay constant for the whole mesh.
-uniform sampler2D myTextureSampler;
+uniform sampler2DArray myTextureSampler;
+uniform vec3 TextureLayer; // xy : UV scale, z : layer of the array
 
 void main(){
 
 	// Output color = color of the texture at the specified UV
-	color = texture( myTextureSampler, UV ).rgb;
+	// Wrapped here : V is negative and a padded layer is clamped to its edge. The gradients are
+	// the unwrapped ones, or fract's jump would pick the smallest mip level along it
+	vec2 scaled = UV * TextureLayer.xy;
+	color = textureGrad( myTextureSampler, vec3(fract(UV) * TextureLayer.xy, TextureLayer.z), dFdx(scaled), dFdy(scaled) ).rgb;
 }
\ No newline at end of file
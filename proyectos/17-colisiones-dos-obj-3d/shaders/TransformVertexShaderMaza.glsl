@@ -7,13 +7,15 @@ layout(location = 1) in vec2 vertexUV;
 // Output data ; will be interpolated for each fragment.
 out vec2 UV;
 
+#include "camera.glsl"
+
 // Values that stay constant for the whole mesh.
-uniform mat4 MVP;
+uniform mat4 model;
 
 void main(){
 
-	// Output position of the vertex, in clip space : MVP * position
-	gl_Position =  MVP * vec4(vertexPosition_modelspace,1);
+	// Output position of the vertex, in clip space : projection * view * model * position
+	gl_Position =  viewProjection * model * vec4(vertexPosition_modelspace,1);
 	
 	// UV of the vertex. No special space for this one.
 	UV = vertexUV;
@@ -0,0 +1,7 @@
+// Camara compartida por todos los programas : un solo uniform buffer (UpdateCameraBlock)
+// que se sube y se enlaza una vez por frame
+layout(std140) uniform CameraBlock {
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+};
@@ -20,6 +20,10 @@ using namespace glm;
 #include <../include/common/texture.hpp>
 #include <../include/common/controls.hpp>
 #include <../include/common/objloader.hpp>
+#include <../include/common/texturearray.hpp>
+#include <../include/common/resources.hpp>
+#include <../include/common/mesh.hpp>
+#include <../include/common/glstate.hpp>
 
 
 int main( void )
@@ -75,47 +79,57 @@ int main( void )
 	// Cull triangles which normal is not towards the camera
 	glEnable(GL_CULL_FACE);
 
-	GLuint VertexArrayID;
-	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
-
-	// Create and compile our GLSL program from the shaders
-	GLuint programIDSaturno = LoadShaders( "../shaders/TransformVertexShaderMaza.glsl", "../shaders/TextureFragmentShaderMaza.glsl" );
-	GLuint programIDAnillos = LoadShaders("../shaders/VertexShaderOBJ.glsl","../shaders/FragmentShaderOBJ.glsl");
+	// Create and compile our GLSL program from the shaders : Saturno y los anillos comparten programa.
+	// Los dos programas se encolan y el driver los compila mientras se cargan texturas y modelos ;
+	// los errores salen la primera vez que UseProgram los enlaza
+	GLuint programID = QueueShaders( "../shaders/TransformVertexShaderMaza.glsl", "../shaders/TextureFragmentShaderMaza.glsl" );
 
 	// shaders de fragmentos
-	GLuint geometricProgramID = Load3Shaders( "../shaders/geometry.vert", "../shaders/geometry.frag","../shaders/geometry.geom" );
+	GLuint geometricProgramID = Queue3Shaders( "../shaders/geometry.vert", "../shaders/geometry.frag","../shaders/geometry.geom" );
 	
 
-	// Get a handle for our "MVP" uniform
-	GLuint MatrixID = glGetUniformLocation(programIDSaturno, "MVP");
-	GLuint MatrixIDAnillos = glGetUniformLocation(programIDAnillos, "MVP");
-
-	// Load the texture
-	GLuint TexturePlaneta = loadDDS("../shaders/planeta.dds");
-	GLuint TextureAnillos = loadDDS("../shaders/anillos.dds");
+	// Load the texture : las dos texturas van como capas de un array, asi no se cambia de textura entre dibujos
+	std::vector<const char *> texturePaths;
+	texturePaths.push_back("../shaders/planeta.dds");
+	texturePaths.push_back("../shaders/anillos.dds");
+	// (el array tambien va al registro, que lo comparte con quien pida las mismas texturas)
+	const TexturePack * textures = acquireTexturePack(texturePaths);
+	if (textures == NULL) {
+		glfwTerminate();
+		return -1;
+	}
+	const TextureLayer & TexturePlaneta = textures->layers[0];
+	const TextureLayer & TextureAnillos = textures->layers[1];
 	
-	// Get a handle for our "myTextureSampler" uniform
-	GLuint TextureID  = glGetUniformLocation(programIDSaturno, "myTextureSampler");
-	GLuint TextureIDAnillos  = glGetUniformLocation(programIDAnillos, "TexturaAnillos");
+	// Read our .obj files, ya indexados y subidos a sus VBOs por el registro
+	const MeshResource * saturno = acquireMesh("../models/saturn.obj");
+	const MeshResource * anillos = acquireMesh("../models/anillos.obj");
+	if (saturno == NULL || anillos == NULL) {
+		glfwTerminate();
+		return -1;
+	}
+	printResources();
 
-	// Read our .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals; // Won't be used at the moment.
-	bool res = loadOBJ("../models/saturn.obj", vertices, uvs, normals);
+	// Get a handle for our "model" uniform : ya con los recursos cargados, para no esperar al driver antes.
+	// Las ubicaciones salen de la tabla que se llena al enlazar ; view y projection van en el CameraBlock
+	UseProgram(programID);
+	GLint ModelID = UniformLocation(programID, "model");
+	GLint TextureLayerID = UniformLocation(programID, "TextureLayer");
+	GLint GeometricModelID = UniformLocation(geometricProgramID, "model");
 
-	// Variables para el plano (anillos)
-	std::vector<glm::vec3> verticesAnillos;
-	std::vector<glm::vec2> uvsAnillos;
-	std::vector<glm::vec3> normalsAnillos;  // No se usará
-	bool resPlano = loadOBJ("../models/anillos.obj", verticesAnillos, uvsAnillos, normalsAnillos);
+	// Set our "myTextureSampler" sampler to use Texture Unit 0 : no cambia, se fija una vez
+	glUniform1i(UniformLocation(programID, "myTextureSampler"), 0);
 
-	std::vector<glm::vec3> combinedNormals = normals;
-	combinedNormals.insert(combinedNormals.end(), normalsAnillos.begin(), normalsAnillos.end());
+	std::vector<glm::vec3> combinedNormals = saturno->normals;
+	combinedNormals.insert(combinedNormals.end(), anillos->normals.begin(), anillos->normals.end());
 
-	std::vector<glm::vec3> combinedVertices = vertices;
-	combinedVertices.insert(combinedVertices.end(), verticesAnillos.begin(), verticesAnillos.end());
+	std::vector<glm::vec3> combinedVertices = saturno->vertices;
+	combinedVertices.insert(combinedVertices.end(), anillos->vertices.begin(), anillos->vertices.end());
+
+	// Los indices de los anillos se desplazan detras de los vertices de Saturno
+	std::vector<unsigned int> combinedIndices = saturno->indices;
+	for (size_t i = 0; i < anillos->indices.size(); i++)
+		combinedIndices.push_back(anillos->indices[i] + (unsigned int)saturno->vertices.size());
 
 	// buffer de normales
 	GLuint Combinednormalbuffer;
@@ -129,29 +143,32 @@ int main( void )
 	glBindBuffer(GL_ARRAY_BUFFER, combinedVertexBuffer);
 	glBufferData(GL_ARRAY_BUFFER, combinedVertices.size() * sizeof(glm::vec3), &combinedVertices[0], GL_STATIC_DRAW);
 
-	// Carga en un VBO para el plano (anillos)
-	GLuint vertexbufferAnillos;
-	glGenBuffers(1, &vertexbufferAnillos);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbufferAnillos);
-	glBufferData(GL_ARRAY_BUFFER, verticesAnillos.size() * sizeof(glm::vec3), &verticesAnillos[0], GL_STATIC_DRAW);
-
-	// Load it into a VBO para Saturno
-	GLuint vertexbuffer;
-	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-	// Buffer de UVs para Saturno
-	GLuint uvbuffer;
-	glGenBuffers(1, &uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-
-	// Buffer de UVs para los anillos
-	GLuint uvbufferAnillos;
-	glGenBuffers(1, &uvbufferAnillos);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbufferAnillos);
-	glBufferData(GL_ARRAY_BUFFER, uvsAnillos.size() * sizeof(glm::vec2), &uvsAnillos[0], GL_STATIC_DRAW);
+	// Indices del dibujo combinado. Sin VAO ligado se suben por GL_ARRAY_BUFFER ; el VAO de la malla
+	// los liga como GL_ELEMENT_ARRAY_BUFFER
+	GLuint combinedElementBuffer;
+	glGenBuffers(1, &combinedElementBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, combinedElementBuffer);
+	glBufferData(GL_ARRAY_BUFFER, combinedIndices.size() * sizeof(unsigned int), &combinedIndices[0], GL_STATIC_DRAW);
+
+	// Un VAO por dibujo, armado una vez con sus vertices, UVs (o normales) e indices
+	Mesh meshAnillos, meshSaturno, meshNormales;
+	meshAnillos.elementbuffer = anillos->elementbuffer;
+	meshAnillos.count = anillos->indices.size();
+	addMeshAttribute(meshAnillos, 0, anillos->vertexbuffer, 3);
+	addMeshAttribute(meshAnillos, 1, anillos->uvbuffer, 2);
+	buildMesh(meshAnillos);
+
+	meshSaturno.elementbuffer = saturno->elementbuffer;
+	meshSaturno.count = saturno->indices.size();
+	addMeshAttribute(meshSaturno, 0, saturno->vertexbuffer, 3);
+	addMeshAttribute(meshSaturno, 1, saturno->uvbuffer, 2);
+	buildMesh(meshSaturno);
+
+	meshNormales.elementbuffer = combinedElementBuffer;
+	meshNormales.count = combinedIndices.size();
+	addMeshAttribute(meshNormales, 0, combinedVertexBuffer, 3);
+	addMeshAttribute(meshNormales, 1, Combinednormalbuffer, 3);
+	buildMesh(meshNormales);
 
 	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS && glfwWindowShouldClose(window) == 0) {
 
@@ -163,103 +180,66 @@ int main( void )
 		glm::mat4 ProjectionMatrix = getProjectionMatrix();
 		glm::mat4 ViewMatrix = getViewMatrix();
 		glm::mat4 ModelMatrix = glm::mat4(1.0);
-		glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-		// ---- Renderizar los anillos ----
-		glUseProgram(programIDAnillos); // Usar el shader para los anillos
-
-		// Calcular y enviar la matriz MVP para los anillos
-		glm::mat4 ModelMatrixAnillos = glm::mat4(1.0f);  // Posicionar los anillos si lo deseas
-		glm::mat4 MVPAnillos = ProjectionMatrix * ViewMatrix * ModelMatrixAnillos;
-		glUniformMatrix4fv(MatrixIDAnillos, 1, GL_FALSE, &MVPAnillos[0][0]);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, TextureAnillos);
-		glUniform1i(TextureIDAnillos, 0);
+		// Una sola subida de la camara para los dos programas
+		UpdateCameraBlock(ViewMatrix, ProjectionMatrix);
 
-		// Enviar los vértices de los anillos
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbufferAnillos);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		// ---- Renderizar los anillos ----
+		bindProgram(programID); // El mismo shader sirve para los anillos y Saturno
 
-		// Enviar las UVs de los anillos
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbufferAnillos);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		// Cada dibujo pide su array y su capa ; glstate solo lo enlaza si cambia de un dibujo a otro
+		bindTexture(0, GL_TEXTURE_2D_ARRAY, TextureAnillos.array);
 
-		glDrawArrays(GL_TRIANGLES, 0, verticesAnillos.size());
+		// Enviar la matriz de modelo de los anillos
+		glm::mat4 ModelMatrixAnillos = glm::mat4(1.0f);  // Posicionar los anillos si lo deseas
+		glUniformMatrix4fv(ModelID, 1, GL_FALSE, &ModelMatrixAnillos[0][0]);
+		glUniform3f(TextureLayerID, TextureAnillos.scale.x, TextureAnillos.scale.y, (float)TextureAnillos.layer);
 
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
+		// Dibujar los anillos con sus indices
+		drawMesh(meshAnillos);
 
 		// ---- Renderizar Saturno ----
-		glUseProgram(programIDSaturno); // Usar el shader para Saturno
-		// Calcular y enviar la matriz MVP para Saturno
+		// Enviar la matriz de modelo de Saturno
 		glm::mat4 ModelMatrixSaturno = glm::mat4(1.0f);  // Matriz de modelo para Saturno
-		glm::mat4 MVPSaturno = ProjectionMatrix * ViewMatrix * ModelMatrixSaturno;
-		glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVPSaturno[0][0]);
+		glUniformMatrix4fv(ModelID, 1, GL_FALSE, &ModelMatrixSaturno[0][0]);
 				
-		// Enviar la textura de Saturno
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, TexturePlaneta);
-		glUniform1i(TextureID, 0);
-
-		// Enviar los vértices de Saturno
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-		
-		// Enviar las UVs de Saturno
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+		// Enviar la capa de Saturno (el mismo array que los anillos si tienen el mismo formato)
+		bindTexture(0, GL_TEXTURE_2D_ARRAY, TexturePlaneta.array);
+		glUniform3f(TextureLayerID, TexturePlaneta.scale.x, TexturePlaneta.scale.y, (float)TexturePlaneta.layer);
 
 		// Dibujar Saturno
-		glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
+		drawMesh(meshSaturno);
 
 		//---- renderizar normales----
-		glUseProgram(geometricProgramID);
-		// Pass transformation matrices to the shader
-        glUniformMatrix4fv(glGetUniformLocation(geometricProgramID, "model"), 1, GL_FALSE, glm::value_ptr(ModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(geometricProgramID, "view"), 1, GL_FALSE, glm::value_ptr(ViewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(geometricProgramID, "projection"), 1, GL_FALSE, glm::value_ptr(ProjectionMatrix));
+		bindProgram(geometricProgramID);
+		// Pass the model matrix to the shader : view y projection ya estan en el CameraBlock
+        glUniformMatrix4fv(GeometricModelID, 1, GL_FALSE, glm::value_ptr(ModelMatrix));
 
-		// pasamos vertices y luego normales
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, combinedVertexBuffer);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, Combinednormalbuffer);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-        // dibujamos las normales
-        glDrawArrays(GL_TRIANGLES, 0, combinedVertices.size());
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
+        // dibujamos las normales : vertices y normales ya van en su VAO
+        drawMesh(meshNormales);
+		endGLStateFrame();
 
 		// Intercambiar buffers
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 	}
-	// Cleanup VBO and shader
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteProgram(programIDSaturno);
-	glDeleteTextures(1, &TexturePlaneta);
-	
-	glDeleteBuffers(1, &vertexbufferAnillos);
-	glDeleteBuffers(1, &uvbufferAnillos);
-	glDeleteProgram(programIDAnillos);
-	glDeleteTextures(1, &TextureAnillos);
+	// Llamadas de estado por frame, y cuantas se ahorraron (solo con printGLStateCalls = true)
+	printGLStateCounters();
+
+	// Cleanup VBO and shader : el registro borra los VBOs con su ultima referencia
+	deleteMesh(meshAnillos);
+	deleteMesh(meshSaturno);
+	deleteMesh(meshNormales);
+	releaseMesh(saturno);
+	releaseMesh(anillos);
+	releaseTexturePack(textures);
+	DeleteProgram(programID);
+	DeleteProgram(geometricProgramID);
+	DeleteCameraBlock();
 
 	glDeleteBuffers(1,&Combinednormalbuffer);
 	glDeleteBuffers(1,&combinedVertexBuffer);
-	
-	glDeleteVertexArrays(1, &VertexArrayID);
+	glDeleteBuffers(1,&combinedElementBuffer);
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -0,0 +1,356 @@
+#include <vector>
+#include <map>
+#include <string>
+#include <utility>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <../include/common/texture.hpp>
+#include <../include/common/texturearray.hpp>
+#include <../include/common/objloader.hpp>
+#include <../include/common/mappedfile.hpp>
+#include <../include/common/glstate.hpp>
+#include <../include/common/resources.hpp>
+
+enum ResourceKind {
+	RESOURCE_TEXTURE,
+	RESOURCE_TEXTURE_PACK,
+	RESOURCE_MESH,
+	RESOURCE_KIND_COUNT
+};
+
+static const char * resourceKindNames[RESOURCE_KIND_COUNT] = { "Texture", "Texture pack", "Mesh" };
+
+typedef std::pair<unsigned long long, size_t> Content;  // Hash and size of the file(s)
+
+struct Resource{
+	ResourceKind kind;
+	unsigned int references;
+	size_t bytes;                     // What the GL objects hold
+	std::vector<std::string> paths;   // Canonical paths that lead to it
+	Content content;
+	GLuint texture;
+	GLenum target;                    // Of texture
+	TexturePack pack;
+	MeshResource meshData;
+};
+
+static std::map<std::string, Resource *> resourcesByPath;
+static std::map<Content, Resource *> resourcesByContent[RESOURCE_KIND_COUNT];
+static std::map<GLuint, Resource *> resourcesByTexture;
+static std::map<const TexturePack *, Resource *> resourcesByPack;
+static std::map<const MeshResource *, Resource *> resourcesByMesh;
+
+// Absolute path with "..", "." and links resolved, so two spellings of a file compare equal
+static std::string canonicalPath(const char * path){
+#ifdef _WIN32
+	char full[_MAX_PATH];
+	if (_fullpath(full, path, _MAX_PATH) == NULL)
+		return path;
+	for (char * c = full; *c; c++)
+		*c = *c == '/' ? '\\' : (char)tolower((unsigned char)*c);
+	return full;
+#else
+	char * full = realpath(path, NULL);
+	if (full == NULL)
+		return path;
+	std::string result(full);
+	free(full);
+	return result;
+#endif
+}
+
+static bool hasExtension(const char * path, const char * extension){
+	size_t length = strlen(path), extensionLength = strlen(extension);
+	if (length < extensionLength)
+		return false;
+	for (size_t i = 0; i < extensionLength; i++){
+		if (tolower((unsigned char)path[length - extensionLength + i]) != extension[i])
+			return false;
+	}
+	return true;
+}
+
+static bool fileContent(const std::string & canonical, Content & content){
+	MappedFile file;
+	if (!mapFile(canonical.c_str(), file))
+		return false;
+	content = std::make_pair(hashFile(file), file.size);
+	unmapFile(file);
+	return true;
+}
+
+// Finds the resource with the same contents as the file(s) behind key (a canonical path, or the
+// paths of a pack), and adds key to its paths
+static Resource * findResource(const std::string & key, ResourceKind kind, const Content & content){
+	std::map<Content, Resource *>::iterator found = resourcesByContent[kind].find(content);
+	if (found == resourcesByContent[kind].end())
+		return NULL;
+	found->second->paths.push_back(key);
+	resourcesByPath[key] = found->second;
+	return found->second;
+}
+
+static Resource * findResourceByPath(const std::string & key, ResourceKind kind){
+	std::map<std::string, Resource *>::iterator found = resourcesByPath.find(key);
+	return found != resourcesByPath.end() && found->second->kind == kind ? found->second : NULL;
+}
+
+static Resource * addResource(const std::string & key, ResourceKind kind, const Content & content){
+	Resource * resource = new Resource();
+	resource->kind = kind;
+	resource->references = 1;
+	resource->bytes = 0;
+	resource->paths.push_back(key);
+	resource->content = content;
+	resource->texture = 0;
+	resource->target = GL_TEXTURE_2D;
+	resourcesByPath[key] = resource;
+	resourcesByContent[kind][content] = resource;
+	return resource;
+}
+
+static void removeResource(Resource * resource){
+	for (size_t i = 0; i < resource->paths.size(); i++)
+		resourcesByPath.erase(resource->paths[i]);
+	resourcesByContent[resource->kind].erase(resource->content);
+	delete resource;
+}
+
+static GLenum bindingOf(GLenum target){
+	switch (target){
+		case GL_TEXTURE_CUBE_MAP:       return GL_TEXTURE_BINDING_CUBE_MAP;
+		case GL_TEXTURE_2D_ARRAY:       return GL_TEXTURE_BINDING_2D_ARRAY;
+		case GL_TEXTURE_CUBE_MAP_ARRAY: return GL_TEXTURE_BINDING_CUBE_MAP_ARRAY;
+		default:                        return GL_TEXTURE_BINDING_2D;
+	}
+}
+
+// Bytes of every level of a texture, as stored by GL. Leaves the texture bound to target as it was.
+static size_t textureBytes(GLuint texture, GLenum target){
+	GLint previous = 0;
+	glGetIntegerv(bindingOf(target), &previous);
+	glBindTexture(target, texture);
+
+	// Levels are queried on one face of a cube map ; arrays report their layers (times 6 for cube arrays) as the depth
+	GLenum levelTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+	size_t faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+	size_t bytes = 0;
+	GLint maxLevel = 0, compressed = 0;
+	glGetTexParameteriv(target, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+	glGetTexLevelParameteriv(levelTarget, 0, GL_TEXTURE_COMPRESSED, &compressed);
+	for (GLint level = 0; level <= maxLevel && level < 32; level++){
+		GLint width = 0, height = 0, depth = 1;
+		glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_HEIGHT, &height);
+		glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_DEPTH, &depth);
+		if (width == 0 || height == 0)
+			break;
+		if (compressed){
+			// Covers every layer of an array
+			GLint size = 0;
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			bytes += (size_t)size * faces;
+		}else{
+			GLint red = 0, green = 0, blue = 0, alpha = 0;
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_RED_SIZE, &red);
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_GREEN_SIZE, &green);
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_BLUE_SIZE, &blue);
+			glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_ALPHA_SIZE, &alpha);
+			bytes += (size_t)width * height * depth * faces * ((red + green + blue + alpha + 7) / 8);
+		}
+	}
+
+	glBindTexture(target, previous);
+	return bytes;
+}
+
+GLuint acquireTexture(const char * path){
+	std::string canonical = canonicalPath(path);
+	Content content;
+	Resource * resource = findResourceByPath(canonical, RESOURCE_TEXTURE);
+	if (resource == NULL){
+		if (!fileContent(canonical, content)){
+			printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", path);
+			return 0;
+		}
+		resource = findResource(canonical, RESOURCE_TEXTURE, content);
+	}
+	if (resource != NULL){
+		resource->references++;
+		return resource->texture;
+	}
+
+	// The target a .dds gets (cube map, array) is only known from its header
+	GLuint texture;
+	GLenum target = GL_TEXTURE_2D;
+	if (hasExtension(path, ".dds")){
+		DDSImage * image = readDDS(path);
+		if (image != NULL)
+			target = ddsTarget(image);
+		texture = uploadDDS(image);
+	}else{
+		texture = loadBMP_custom(path);
+	}
+	if (texture == 0)
+		return 0;
+	resource = addResource(canonical, RESOURCE_TEXTURE, content);
+	resource->texture = texture;
+	resource->target = target;
+	resource->bytes = textureBytes(texture, target);
+	resourcesByTexture[texture] = resource;
+	return texture;
+}
+
+void releaseTexture(GLuint texture){
+	std::map<GLuint, Resource *>::iterator found = resourcesByTexture.find(texture);
+	if (found == resourcesByTexture.end())
+		return;
+	Resource * resource = found->second;
+	if (--resource->references > 0)
+		return;
+	forgetTexture(resource->texture);
+	glDeleteTextures(1, &resource->texture);
+	resourcesByTexture.erase(found);
+	removeResource(resource);
+}
+
+const TexturePack * acquireTexturePack(const std::vector<const char *> & paths){
+	// Keyed by all the paths in order, and by the contents of all the files
+	std::string key;
+	for (size_t i = 0; i < paths.size(); i++)
+		key += (i > 0 ? " + " : "") + canonicalPath(paths[i]);
+	Resource * resource = findResourceByPath(key, RESOURCE_TEXTURE_PACK);
+	Content content(14695981039346656037ull, 0);
+	if (resource == NULL){
+		for (size_t i = 0; i < paths.size(); i++){
+			Content file;
+			if (!fileContent(canonicalPath(paths[i]), file)){
+				printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", paths[i]);
+				return NULL;
+			}
+			content.first = (content.first ^ file.first) * 1099511628211ull;
+			content.second += file.second;
+		}
+		resource = findResource(key, RESOURCE_TEXTURE_PACK, content);
+	}
+	if (resource != NULL){
+		resource->references++;
+		return &resource->pack;
+	}
+
+	TexturePack pack;
+	if (!packTextures(paths, pack))
+		return NULL;
+	resource = addResource(key, RESOURCE_TEXTURE_PACK, content);
+	resource->pack = pack;
+	for (size_t i = 0; i < pack.arrays.size(); i++)
+		resource->bytes += textureBytes(pack.arrays[i], GL_TEXTURE_2D_ARRAY);
+	resourcesByPack[&resource->pack] = resource;
+	return &resource->pack;
+}
+
+void releaseTexturePack(const TexturePack * pack){
+	std::map<const TexturePack *, Resource *>::iterator found = resourcesByPack.find(pack);
+	if (found == resourcesByPack.end())
+		return;
+	Resource * resource = found->second;
+	if (--resource->references > 0)
+		return;
+	deleteTexturePack(resource->pack);
+	resourcesByPack.erase(found);
+	removeResource(resource);
+}
+
+const MeshResource * acquireMesh(const char * path){
+	std::string canonical = canonicalPath(path);
+	Content content;
+	Resource * resource = findResourceByPath(canonical, RESOURCE_MESH);
+	if (resource == NULL){
+		if (!fileContent(canonical, content)){
+			printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", path);
+			return NULL;
+		}
+		resource = findResource(canonical, RESOURCE_MESH, content);
+	}
+	if (resource != NULL){
+		resource->references++;
+		return &resource->meshData;
+	}
+
+	MeshResource mesh;
+	if (!loadOBJ_indexed(path, mesh.indices, mesh.vertices, mesh.uvs, mesh.normals) || mesh.indices.empty())
+		return NULL;
+	resource = addResource(canonical, RESOURCE_MESH, content);
+	MeshResource & data = resource->meshData;
+	data.indices.swap(mesh.indices);
+	data.vertices.swap(mesh.vertices);
+	data.uvs.swap(mesh.uvs);
+	data.normals.swap(mesh.normals);
+
+	// Filled through GL_ARRAY_BUFFER : GL_ELEMENT_ARRAY_BUFFER belongs to whatever VAO is bound
+	// (none, or some mesh's), and the mesh's own VAO binds it there when it's built
+	glGenBuffers(1, &data.elementbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, data.elementbuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.indices.size() * sizeof(unsigned int), &data.indices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &data.vertexbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, data.vertexbuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(glm::vec3), &data.vertices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &data.uvbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, data.uvbuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.uvs.size() * sizeof(glm::vec2), &data.uvs[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &data.normalbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, data.normalbuffer);
+	glBufferData(GL_ARRAY_BUFFER, data.normals.size() * sizeof(glm::vec3), &data.normals[0], GL_STATIC_DRAW);
+
+	resource->bytes = data.indices.size() * sizeof(unsigned int)
+		+ data.vertices.size() * (sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3));
+	resourcesByMesh[&data] = resource;
+	return &data;
+}
+
+void releaseMesh(const MeshResource * mesh){
+	std::map<const MeshResource *, Resource *>::iterator found = resourcesByMesh.find(mesh);
+	if (found == resourcesByMesh.end())
+		return;
+	Resource * resource = found->second;
+	if (--resource->references > 0)
+		return;
+	MeshResource & data = resource->meshData;
+	forgetBuffer(data.vertexbuffer);
+	forgetBuffer(data.uvbuffer);
+	forgetBuffer(data.normalbuffer);
+	glDeleteBuffers(1, &data.elementbuffer);
+	glDeleteBuffers(1, &data.vertexbuffer);
+	glDeleteBuffers(1, &data.uvbuffer);
+	glDeleteBuffers(1, &data.normalbuffer);
+	resourcesByMesh.erase(found);
+	removeResource(resource);
+}
+
+void printResources(){
+	// Several paths can lead to the same resource, print each once
+	std::map<Resource *, bool> printed;
+	size_t total = 0;
+	for (std::map<std::string, Resource *>::iterator it = resourcesByPath.begin(); it != resourcesByPath.end(); ++it){
+		Resource * resource = it->second;
+		if (printed[resource])
+			continue;
+		printed[resource] = true;
+		total += resource->bytes;
+		printf("%s %s : %u reference(s), %.1f KB", resourceKindNames[resource->kind], resource->paths[0].c_str(),
+			resource->references, resource->bytes / 1024.0);
+		for (size_t i = 1; i < resource->paths.size(); i++)
+			printf(", also %s", resource->paths[i].c_str());
+		printf("\n");
+	}
+	printf("%u resource(s), %.1f KB in total\n", (unsigned int)printed.size(), total / 1024.0);
+}
@@ -1,11 +1,19 @@
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <glad/glad.h>
 
 #include <GLFW/glfw3.h>
 
+#include <../include/common/mappedfile.hpp>
+#include <../include/common/texture.hpp>
+#include <../include/common/parallel.hpp>
+
 // Definir manualmente las constantes de compresión de texturas S3TC
 #ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
 #define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
@@ -19,7 +27,13 @@
 #define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
 #endif
 
-GLuint loadBMP_custom(const char * imagepath){
+// A BMP file in memory, waiting for uploadBMP
+struct BMPImage{
+	unsigned int width, height;
+	unsigned char * data;
+};
+
+BMPImage * readBMP(const char * imagepath){
 
 	printf("Reading image %s\n", imagepath);
 
@@ -28,15 +42,12 @@ GLuint loadBMP_custom(const char * imagepath){
 	unsigned int dataPos;
 	unsigned int imageSize;
 	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
 
 	// Open the file
 	FILE * file = fopen(imagepath,"rb");
 	if (!file){
 		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
-		getchar();
-		return 0;
+		return NULL;
 	}
 
 	// Read the header, i.e. the 54 first bytes
@@ -45,17 +56,17 @@ GLuint loadBMP_custom(const char * imagepath){
 	if ( fread(header, 1, 54, file)!=54 ){ 
 		printf("Not a correct BMP file\n");
 		fclose(file);
-		return 0;
+		return NULL;
 	}
 	// A BMP files always begins with "BM"
 	if ( header[0]!='B' || header[1]!='M' ){
 		printf("Not a correct BMP file\n");
 		fclose(file);
-		return 0;
+		return NULL;
 	}
 	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
+	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    fclose(file); return NULL;}
+	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    fclose(file); return NULL;}
 
 	// Read the information about the image
 	dataPos    = *(int*)&(header[0x0A]);
@@ -68,13 +79,23 @@ GLuint loadBMP_custom(const char * imagepath){
 	if (dataPos==0)      dataPos=54; // The BMP header is done that way
 
 	// Create a buffer
-	data = new unsigned char [imageSize];
+	BMPImage * image = new BMPImage;
+	image->width = width;
+	image->height = height;
+	image->data = new unsigned char [imageSize];
 
 	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
+	fread(image->data,1,imageSize,file);
 
 	// Everything is in memory now, the file can be closed.
 	fclose (file);
+	return image;
+}
+
+GLuint uploadBMP(BMPImage * image){
+
+	if (image == NULL)
+		return 0;
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -84,10 +105,10 @@ GLuint loadBMP_custom(const char * imagepath){
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
 	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
+	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, image->width, image->height, 0, GL_BGR, GL_UNSIGNED_BYTE, image->data);
 
 	// OpenGL has now copied the data. Free our own version
-	delete [] data;
+	freeBMP(image);
 
 	// Poor filtering, or ...
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -105,6 +126,28 @@ GLuint loadBMP_custom(const char * imagepath){
 	return textureID;
 }
 
+void freeBMP(BMPImage * image){
+	if (image == NULL)
+		return;
+	delete [] image->data;
+	delete image;
+}
+
+const unsigned char * bmpPixels(const BMPImage * image, unsigned int & width, unsigned int & height){
+	width = image->width;
+	height = image->height;
+	return image->data;
+}
+
+GLuint loadBMP_custom(const char * imagepath){
+	BMPImage * image = readBMP(imagepath);
+	if (image == NULL){
+		getchar();
+		return 0;
+	}
+	return uploadBMP(image);
+}
+
 // Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
 // or do it yourself (just like loadBMP_custom and loadDDS)
 //GLuint loadTGA_glfw(const char * imagepath){
@@ -135,96 +178,631 @@ GLuint loadBMP_custom(const char * imagepath){
 #define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+#define FOURCC_ATI1 0x31495441 // "ATI1", BC4
+#define FOURCC_BC4U 0x55344342 // "BC4U"
+#define FOURCC_ATI2 0x32495441 // "ATI2", BC5
+#define FOURCC_BC5U 0x55354342 // "BC5U"
+#define FOURCC_DX10 0x30315844 // "DX10" : the format is in the extra DDS_HEADER_DXT10
+
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#endif
 
-GLuint loadDDS(const char * imagepath){
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#endif
 
-	unsigned char header[124];
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
 
-	FILE *fp; 
- 
-	/* try to open the file */ 
-	fp = fopen(imagepath, "rb"); 
-	if (fp == NULL){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_DEPTH       0x800000
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDS_RESOURCE_MISC_TEXTURECUBE 0x4
+#define DDS_DIMENSION_TEXTURE2D 3
+
+// What follows the "DDS " magic
+struct DDSHeader{
+	unsigned int size;              // 124
+	unsigned int flags;
+	unsigned int height;
+	unsigned int width;
+	unsigned int pitchOrLinearSize;
+	unsigned int depth;
+	unsigned int mipMapCount;
+	unsigned int reserved1[11];
+	unsigned int pfSize;
+	unsigned int pfFlags;
+	unsigned int fourCC;
+	unsigned int rgbBitCount;
+	unsigned int rBitMask, gBitMask, bBitMask, aBitMask;
+	unsigned int caps, caps2, caps3, caps4;
+	unsigned int reserved2;
+};
+
+// Follows DDSHeader when fourCC == "DX10"
+struct DDSHeaderDX10{
+	unsigned int dxgiFormat;
+	unsigned int resourceDimension;
+	unsigned int miscFlag;
+	unsigned int arraySize;
+	unsigned int miscFlags2;
+};
+
+// GL format and bytes per 4x4 block of a fourCC, or of a DXGI_FORMAT when dx10 is true
+static bool ddsFormat(unsigned int code, bool dx10, GLenum & format, unsigned int & blockSize){
+	if (!dx10){
+		switch (code){
+			case FOURCC_DXT1: format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; blockSize = 8;  return true;
+			case FOURCC_DXT3: format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; blockSize = 16; return true;
+			case FOURCC_DXT5: format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; blockSize = 16; return true;
+			case FOURCC_ATI1:
+			case FOURCC_BC4U: format = GL_COMPRESSED_RED_RGTC1;          blockSize = 8;  return true;
+			case FOURCC_ATI2:
+			case FOURCC_BC5U: format = GL_COMPRESSED_RG_RGTC2;           blockSize = 16; return true;
+			default: return false;
+		}
+	}
+	switch (code){
+		case 71: format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;       blockSize = 8;  return true; // BC1_UNORM
+		case 72: format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; blockSize = 8;  return true; // BC1_UNORM_SRGB
+		case 74: format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;       blockSize = 16; return true; // BC2_UNORM
+		case 75: format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT; blockSize = 16; return true; // BC2_UNORM_SRGB
+		case 77: format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;       blockSize = 16; return true; // BC3_UNORM
+		case 78: format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; blockSize = 16; return true; // BC3_UNORM_SRGB
+		case 80: format = GL_COMPRESSED_RED_RGTC1;                blockSize = 8;  return true; // BC4_UNORM
+		case 81: format = GL_COMPRESSED_SIGNED_RED_RGTC1;         blockSize = 8;  return true; // BC4_SNORM
+		case 83: format = GL_COMPRESSED_RG_RGTC2;                 blockSize = 16; return true; // BC5_UNORM
+		case 84: format = GL_COMPRESSED_SIGNED_RG_RGTC2;          blockSize = 16; return true; // BC5_SNORM
+		default: return false;
+	}
+}
+
+// Bytes of one mip level of one face
+static size_t ddsMipSize(unsigned int width, unsigned int height, unsigned int blockSize){
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+// Staging buffer the mip levels go through on their way to the textures. With GL 4.4 it's
+// mapped once and for all (persistent, coherent) and used as a ring : each upload leaves a
+// fence behind, and a region is only written again once the GPU is done reading it.
+// Without GL 4.4 it's orphaned and mapped again for every upload.
+// Each thread has its own ring : fences are only flushed by the context that made them, and a
+// render thread and an upload thread (assetjobs) would otherwise write the same regions.
+struct StagingRegion{
+	GLsync fence;
+	size_t begin;
+};
+
+static const size_t STAGING_MIN_SIZE = 16 << 20;
+
+static thread_local GLuint stagingBuffer = 0;
+static thread_local unsigned char * stagingMemory = NULL; // Persistent mapping, NULL without GL 4.4
+static thread_local size_t stagingSize = 0;
+static thread_local size_t stagingHead = 0;
+static thread_local StagingRegion stagingRegions[256];    // Oldest first, a circular queue
+static thread_local unsigned int stagingFirstRegion = 0, stagingRegionCount = 0;
+
+static void retireOldestStagingRegion(){
+	StagingRegion & region = stagingRegions[stagingFirstRegion];
+	glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	glDeleteSync(region.fence);
+	stagingFirstRegion = (stagingFirstRegion + 1) % 256;
+	stagingRegionCount--;
+}
+
+// Returns where to write size bytes, in the bound GL_PIXEL_UNPACK_BUFFER
+static size_t beginStaging(size_t size, unsigned char * & memory){
+
+	if (!GLAD_GL_VERSION_4_4){
+		if (stagingBuffer == 0)
+			glGenBuffers(1, &stagingBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		memory = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
 		return 0;
 	}
-   
+
+	if (size > stagingSize){
+		// (Re)create the ring, big enough for this level
+		while (stagingRegionCount > 0)
+			retireOldestStagingRegion();
+		if (stagingBuffer != 0)
+			glDeleteBuffers(1, &stagingBuffer);
+		stagingSize = size > STAGING_MIN_SIZE ? size : STAGING_MIN_SIZE;
+		stagingHead = 0;
+		glGenBuffers(1, &stagingBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, stagingSize, NULL, flags);
+		stagingMemory = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, stagingSize, flags);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+
+	// Regions at or after the head are the oldest ones. Wrapping around retires them first.
+	if (stagingHead + size > stagingSize){
+		while (stagingRegionCount > 0 && stagingRegions[stagingFirstRegion].begin >= stagingHead)
+			retireOldestStagingRegion();
+		stagingHead = 0;
+	}
+	while (stagingRegionCount > 0 && stagingRegions[stagingFirstRegion].begin >= stagingHead
+		&& stagingRegions[stagingFirstRegion].begin < stagingHead + size)
+		retireOldestStagingRegion();
+	if (stagingRegionCount == 256)
+		retireOldestStagingRegion();
+
+	memory = stagingMemory + stagingHead;
+	return stagingHead;
+}
+
+// Call once the data is written, before the upload
+static void endStaging(){
+	if (!GLAD_GL_VERSION_4_4)
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+}
+
+// Call once the upload reading [offset, offset + size) has been issued
+static void fenceStaging(size_t offset, size_t size){
+	if (!GLAD_GL_VERSION_4_4)
+		return;
+	StagingRegion & region = stagingRegions[(stagingFirstRegion + stagingRegionCount) % 256];
+	region.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	region.begin = offset;
+	stagingRegionCount++;
+	stagingHead = offset + size;
+}
+
+void releaseDDSStaging(){
+	while (stagingRegionCount > 0)
+		retireOldestStagingRegion();
+	if (stagingBuffer != 0)
+		glDeleteBuffers(1, &stagingBuffer);
+	stagingBuffer = 0;
+	stagingMemory = NULL;
+	stagingSize = 0;
+	stagingHead = 0;
+}
+
+// A validated DDS file, still mapped, waiting for uploadDDS
+struct DDSImage{
+	MappedFile file;
+	size_t offset;                  // Where the first level starts
+	GLenum format;
+	unsigned int blockSize;
+	unsigned int width, height, mipMapCount;
+	bool cube;
+	unsigned int layers;
+};
+
+DDSImage * readDDS(const char * imagepath){
+
+	MappedFile file;
+	if (!mapFile(imagepath, file)){
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return NULL;
+	}
+
 	/* verify the type of file */ 
-	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
-		return 0; 
+	DDSHeader header;
+	if (file.size < 4 + sizeof(header) || strncmp(file.data, "DDS ", 4) != 0) { 
+		unmapFile(file);
+		return NULL; 
 	}
-	
+
 	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
-
-	unsigned int height      = *(unsigned int*)&(header[8 ]);
-	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	unsigned int fourCC      = *(unsigned int*)&(header[80]);
-
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
-
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
-	unsigned int format;
-	switch(fourCC) 
-	{ 
-	case FOURCC_DXT1: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
-		break; 
-	case FOURCC_DXT3: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
-		break; 
-	case FOURCC_DXT5: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
-		break; 
-	default: 
-		free(buffer); 
-		return 0; 
+	memcpy(&header, file.data + 4, sizeof(header));
+	size_t offset = 4 + sizeof(header);
+
+	bool dx10 = header.fourCC == FOURCC_DX10;
+	DDSHeaderDX10 headerDX10;
+	memset(&headerDX10, 0, sizeof(headerDX10));
+	if (dx10){
+		if (file.size < offset + sizeof(headerDX10)){
+			unmapFile(file);
+			return NULL;
+		}
+		memcpy(&headerDX10, file.data + offset, sizeof(headerDX10));
+		offset += sizeof(headerDX10);
+	}
+
+	GLenum format;
+	unsigned int blockSize;
+	if (!ddsFormat(dx10 ? headerDX10.dxgiFormat : header.fourCC, dx10, format, blockSize)
+		|| ((header.flags & DDSD_DEPTH) && header.depth > 1) || (dx10 && headerDX10.resourceDimension != DDS_DIMENSION_TEXTURE2D)){
+		printf("%s : only 2D, cube and array DDS textures in DXT1/3/5 or BC4/5 are supported\n", imagepath);
+		unmapFile(file);
+		return NULL;
 	}
 
+	// The file stores every array layer in turn, each face of it in turn, each with its full mip chain
+	unsigned int width = header.width, height = header.height;
+	unsigned int mipMapCount = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+	// No more levels than the full chain down to 1x1 (floor(log2(max(width, height))) + 1) : past 31,
+	// width >> level would be undefined
+	unsigned int fullChain = 1;
+	while (((width > height ? width : height) >> fullChain) > 0)
+		fullChain++;
+	if (mipMapCount > fullChain)
+		mipMapCount = fullChain;
+	bool cube = dx10 ? (headerDX10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) != 0 : (header.caps2 & DDSCAPS2_CUBEMAP) != 0;
+	unsigned int layers = dx10 && headerDX10.arraySize > 1 ? headerDX10.arraySize : 1;
+	unsigned int faces = cube ? 6 : 1;
+
+	size_t chainSize = 0;
+	for (unsigned int level = 0; level < mipMapCount; level++)
+		chainSize += ddsMipSize(width >> level ? width >> level : 1, height >> level ? height >> level : 1, blockSize);
+	if (width == 0 || height == 0 || file.size - offset < chainSize * faces * layers){
+		printf("%s is truncated\n", imagepath);
+		unmapFile(file);
+		return NULL;
+	}
+
+	// Fault every page in now, so uploadDDS doesn't wait on the disk
+	volatile unsigned char touched = 0;
+	for (size_t page = 0; page < file.size; page += 4096)
+		touched += (unsigned char)file.data[page];
+
+	DDSImage * image = new DDSImage;
+	image->file = file;
+	image->offset = offset;
+	image->format = format;
+	image->blockSize = blockSize;
+	image->width = width;
+	image->height = height;
+	image->mipMapCount = mipMapCount;
+	image->cube = cube;
+	image->layers = layers;
+	return image;
+}
+
+// ---- S3TC in software, for drivers without EXT_texture_compression_s3tc (some llvmpipe builds) ----
+
+static bool s3tcSupported(){
+	// Asked once, by whichever thread gets here first
+	static const bool supported = []{
+		bool found = false;
+		GLint count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (GLint i = 0; i < count; i++){
+			const char * name = (const char *)glGetStringi(GL_EXTENSIONS, i);
+			if (name != NULL && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+				found = true;
+		}
+		if (!found)
+			printf("No S3TC support : DXT textures will be decoded on the CPU\n");
+		return found;
+	}();
+	return supported;
+}
+
+static bool isS3TC(GLenum format){
+	return format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+		|| format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT
+		|| format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+}
+
+static inline unsigned int expand565(unsigned int color){
+	unsigned int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16);
+}
+
+// Texels are RGBA8 in one unsigned int : red in the low byte
+static inline unsigned int mixColors(unsigned int a, unsigned int b, unsigned int weightA, unsigned int weightB, unsigned int total){
+	unsigned int mixed = 0;
+	for (int shift = 0; shift < 24; shift += 8)
+		mixed |= ((((a >> shift) & 255) * weightA + ((b >> shift) & 255) * weightB) / total) << shift;
+	return mixed;
+}
+
+// Decodes the color half of a block into texels (alpha 255, or 0 for DXT1 transparent texels)
+static void decodeColorBlock(const unsigned char * block, bool dxt1, unsigned int texels[16]){
+	unsigned int color0 = block[0] | (block[1] << 8), color1 = block[2] | (block[3] << 8);
+	unsigned int bits = block[4] | (block[5] << 8) | (block[6] << 16) | ((unsigned int)block[7] << 24);
+	unsigned int palette[4];
+	palette[0] = expand565(color0) | 0xFF000000u;
+	palette[1] = expand565(color1) | 0xFF000000u;
+	if (color0 > color1 || !dxt1){
+		palette[2] = mixColors(palette[0], palette[1], 2, 1, 3) | 0xFF000000u;
+		palette[3] = mixColors(palette[0], palette[1], 1, 2, 3) | 0xFF000000u;
+	}else{
+		palette[2] = mixColors(palette[0], palette[1], 1, 1, 2) | 0xFF000000u;
+		palette[3] = 0;
+	}
+#ifdef __SSE2__
+	// A row of 4 texels at a time : each lane keeps the palette entry its index selects
+	for (int row = 0; row < 4; row++){
+		unsigned int rowBits = bits >> (8 * row);
+		__m128i index = _mm_set_epi32((rowBits >> 6) & 3, (rowBits >> 4) & 3, (rowBits >> 2) & 3, rowBits & 3);
+		__m128i result = _mm_setzero_si128();
+		for (int p = 0; p < 4; p++){
+			__m128i selected = _mm_cmpeq_epi32(index, _mm_set1_epi32(p));
+			result = _mm_or_si128(result, _mm_and_si128(selected, _mm_set1_epi32((int)palette[p])));
+		}
+		_mm_storeu_si128((__m128i *)(texels + 4 * row), result);
+	}
+#else
+	for (int i = 0; i < 16; i++)
+		texels[i] = palette[(bits >> (2 * i)) & 3];
+#endif
+}
+
+// DXT5 alpha : two endpoints and 3 bits per texel, like BC4
+static void decodeAlphaBlock(const unsigned char * block, unsigned int texels[16]){
+	unsigned int alpha[8];
+	alpha[0] = block[0];
+	alpha[1] = block[1];
+	if (alpha[0] > alpha[1]){
+		for (int i = 1; i < 7; i++)
+			alpha[i + 1] = ((7 - i) * alpha[0] + i * alpha[1]) / 7;
+	}else{
+		for (int i = 1; i < 5; i++)
+			alpha[i + 1] = ((5 - i) * alpha[0] + i * alpha[1]) / 5;
+		alpha[6] = 0;
+		alpha[7] = 255;
+	}
+	unsigned long long bits = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= (unsigned long long)block[2 + i] << (8 * i);
+	for (int i = 0; i < 16; i++)
+		texels[i] = (texels[i] & 0x00FFFFFFu) | (alpha[(bits >> (3 * i)) & 7] << 24);
+}
+
+static void decodeS3TCBlock(GLenum format, const unsigned char * block, unsigned int texels[16]){
+	if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT){
+		decodeColorBlock(block, true, texels);
+		return;
+	}
+	decodeColorBlock(block + 8, false, texels);
+	if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT){
+		decodeAlphaBlock(block, texels);
+		return;
+	}
+	// DXT3 : 4 bits of alpha per texel
+	for (int i = 0; i < 16; i++){
+		unsigned int alpha = (block[i / 2] >> (4 * (i & 1))) & 15;
+		texels[i] = (texels[i] & 0x00FFFFFFu) | ((alpha * 17) << 24);
+	}
+}
+
+// Decoded files, newest last, so a texture that's loaded again isn't decoded again.
+// One cache per thread, like the staging ring : what decodeS3TC returns stays valid until that
+// thread decodes again, whatever the others do.
+struct DecodedDDS{
+	unsigned long long hash;
+	size_t size;
+	std::vector<unsigned char> texels; // Level after level, each with every layer-face in turn
+};
+
+struct DecodedCache{
+	std::vector<DecodedDDS *> entries;
+	~DecodedCache(){
+		for (size_t i = 0; i < entries.size(); i++)
+			delete entries[i];
+	}
+};
+
+static const size_t DECODED_CACHE_SIZE = 64 << 20;
+static thread_local DecodedCache decodedCacheOfThread;
+
+// RGBA8 texels of every level of the image. Block rows of every level and layer are spread over the threads.
+static const std::vector<unsigned char> & decodeS3TC(const DDSImage & image){
+
+	std::vector<DecodedDDS *> & decodedCache = decodedCacheOfThread.entries;
+	unsigned long long hash = hashFile(image.file);
+	for (size_t i = 0; i < decodedCache.size(); i++){
+		if (decodedCache[i]->hash == hash && decodedCache[i]->size == image.file.size){
+			DecodedDDS * hit = decodedCache[i];
+			decodedCache.erase(decodedCache.begin() + i);
+			decodedCache.push_back(hit);
+			return hit->texels;
+		}
+	}
+
+	unsigned int slices = image.layers * (image.cube ? 6 : 1);
+	std::vector<size_t> levelOffsets(image.mipMapCount), chainOffsets(image.mipMapCount), rowStarts(image.mipMapCount + 1);
+	size_t decodedSize = 0, chainSize = 0;
+	rowStarts[0] = 0;
+	for (unsigned int level = 0; level < image.mipMapCount; level++){
+		unsigned int w = image.width >> level ? image.width >> level : 1;
+		unsigned int h = image.height >> level ? image.height >> level : 1;
+		levelOffsets[level] = decodedSize;
+		chainOffsets[level] = chainSize;
+		decodedSize += (size_t)w * h * 4 * slices;
+		chainSize += ddsMipSize(w, h, image.blockSize);
+		rowStarts[level + 1] = rowStarts[level] + (size_t)((h + 3) / 4) * slices;
+	}
+
+	DecodedDDS * decoded = new DecodedDDS;
+	decoded->hash = hash;
+	decoded->size = image.file.size;
+	decoded->texels.resize(decodedSize);
+	size_t rowCount = rowStarts[image.mipMapCount];
+	unsigned int count = workerCount(rowCount, 16);
+	runParallel(count, [&](unsigned int thread){
+		unsigned int level = 0;
+		for (size_t row = rowCount * thread / count; row < rowCount * (thread + 1) / count; row++){
+			while (row >= rowStarts[level + 1])
+				level++;
+			unsigned int w = image.width >> level ? image.width >> level : 1;
+			unsigned int h = image.height >> level ? image.height >> level : 1;
+			unsigned int blocksX = (w + 3) / 4, blocksY = (h + 3) / 4;
+			unsigned int slice = (unsigned int)((row - rowStarts[level]) / blocksY);
+			unsigned int by = (unsigned int)((row - rowStarts[level]) % blocksY);
+			const unsigned char * blocks = (const unsigned char *)image.file.data + image.offset + slice * chainSize + chainOffsets[level]
+				+ (size_t)by * blocksX * image.blockSize;
+			unsigned char * out = &decoded->texels[levelOffsets[level] + (size_t)slice * w * h * 4];
+			for (unsigned int bx = 0; bx < blocksX; bx++){
+				unsigned int texels[16];
+				decodeS3TCBlock(image.format, blocks + (size_t)bx * image.blockSize, texels);
+				for (unsigned int j = 0; j < 4 && by * 4 + j < h; j++){
+					unsigned int columns = w - bx * 4 < 4 ? w - bx * 4 : 4;
+					memcpy(out + ((size_t)(by * 4 + j) * w + bx * 4) * 4, texels + j * 4, columns * 4);
+				}
+			}
+		}
+	});
+
+	// Keep it, dropping the oldest ones beyond the budget (but never the one just decoded)
+	decodedCache.push_back(decoded);
+	size_t cached = 0;
+	for (size_t i = 0; i < decodedCache.size(); i++)
+		cached += decodedCache[i]->texels.size();
+	while (cached > DECODED_CACHE_SIZE && decodedCache.size() > 1){
+		cached -= decodedCache[0]->texels.size();
+		delete decodedCache[0];
+		decodedCache.erase(decodedCache.begin());
+	}
+	return decoded->texels;
+}
+
+// uploadDDS for S3TC files when the driver can't take them : RGBA8 (or sRGB) levels instead
+static void uploadDecodedDDS(const DDSImage & image, GLenum target){
+	const std::vector<unsigned char> & texels = decodeS3TC(image);
+	bool srgb = image.format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT || image.format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT
+		|| image.format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+	GLint internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	unsigned int slices = image.layers * (image.cube ? 6 : 1);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	size_t levelOffset = 0;
+	for (unsigned int level = 0; level < image.mipMapCount; level++){
+		unsigned int w = image.width >> level ? image.width >> level : 1;
+		unsigned int h = image.height >> level ? image.height >> level : 1;
+		size_t size = (size_t)w * h * 4;
+		if (target == GL_TEXTURE_2D || target == GL_TEXTURE_CUBE_MAP){
+			for (unsigned int face = 0; face < slices; face++){
+				GLenum faceTarget = image.cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+				glTexImage2D(faceTarget, level, internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[levelOffset + face * size]);
+			}
+		}else{
+			glTexImage3D(target, level, internalFormat, w, h, slices, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[levelOffset]);
+		}
+		levelOffset += size * slices;
+	}
+}
+
+GLuint uploadDDS(DDSImage * image){
+
+	if (image == NULL)
+		return 0;
+
+	const MappedFile & file = image->file;
+	size_t offset = image->offset;
+	GLenum format = image->format;
+	unsigned int blockSize = image->blockSize;
+	unsigned int width = image->width, height = image->height, mipMapCount = image->mipMapCount;
+	bool cube = image->cube;
+	unsigned int layers = image->layers;
+	unsigned int faces = cube ? 6 : 1;
+
+	size_t chainSize = 0;
+	for (unsigned int level = 0; level < mipMapCount; level++)
+		chainSize += ddsMipSize(width >> level ? width >> level : 1, height >> level ? height >> level : 1, blockSize);
+
+	GLenum target = ddsTarget(image);
+
 	// Create one OpenGL texture
 	GLuint textureID;
 	glGenTextures(1, &textureID);
 
 	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
+	glBindTexture(target, textureID);
 	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
-	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
-	unsigned int offset = 0;
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, mipMapCount - 1);
 
-	/* load the mipmaps */ 
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
-	{ 
-		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,  
-			0, size, buffer + offset); 
-	 
-		offset += size; 
-		width  /= 2; 
-		height /= 2; 
-
-		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-		if(width < 1) width = 1;
-		if(height < 1) height = 1;
+	if (isS3TC(format) && !s3tcSupported()){
+		uploadDecodedDDS(*image, target);
+		freeDDS(image);
+		return textureID;
+	}
 
+	/* load the mipmaps, straight from the mapped file into the staging buffer */ 
+	size_t levelOffset = 0;
+	for (unsigned int level = 0; level < mipMapCount; ++level) 
+	{ 
+		unsigned int w = width >> level ? width >> level : 1;
+		unsigned int h = height >> level ? height >> level : 1;
+		size_t size = ddsMipSize(w, h, blockSize);
+
+		if (target == GL_TEXTURE_2D || target == GL_TEXTURE_CUBE_MAP){
+			for (unsigned int face = 0; face < faces; face++){
+				unsigned char * memory;
+				size_t staging = beginStaging(size, memory);
+				memcpy(memory, file.data + offset + face * chainSize + levelOffset, size);
+				GLenum faceTarget = cube ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+				endStaging();
+				glCompressedTexImage2D(faceTarget, level, format, w, h, 0, (GLsizei)size, (void*)staging);
+				fenceStaging(staging, size);
+			}
+		}else{
+			// Arrays take every layer-face of a level in one call
+			unsigned int slices = layers * faces;
+			unsigned char * memory;
+			size_t staging = beginStaging(size * slices, memory);
+			for (unsigned int slice = 0; slice < slices; slice++)
+				memcpy(memory + slice * size, file.data + offset + slice * chainSize + levelOffset, size);
+			endStaging();
+			glCompressedTexImage3D(target, level, format, w, h, slices, 0, (GLsizei)(size * slices), (void*)staging);
+			fenceStaging(staging, size * slices);
+		}
+		levelOffset += size;
 	} 
 
-	free(buffer); 
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	freeDDS(image);
 
 	return textureID;
+}
 
+GLenum ddsTarget(const DDSImage * image){
+	if (image->cube)
+		return image->layers > 1 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+	return image->layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+}
+
+void freeDDS(DDSImage * image){
+	if (image == NULL)
+		return;
+	unmapFile(image->file);
+	delete image;
+}
+
+const unsigned char * ddsLevel(const DDSImage * image, unsigned int level, GLenum & format, unsigned int & blockSize,
+	unsigned int & width, unsigned int & height, unsigned int & mipMapCount){
+	format = image->format;
+	blockSize = image->blockSize;
+	width = image->width;
+	height = image->height;
+	mipMapCount = image->mipMapCount;
+	if (image->cube || image->layers > 1 || level >= image->mipMapCount)
+		return NULL;
+	size_t offset = image->offset;
+	for (unsigned int i = 0; i < level; i++)
+		offset += ddsMipSize(width >> i ? width >> i : 1, height >> i ? height >> i : 1, blockSize);
+	return (const unsigned char *)image->file.data + offset;
+}
+
+bool ddsBlocksSupported(const DDSImage * image){
+	return !isS3TC(image->format) || s3tcSupported();
+}
+
+const unsigned char * ddsDecodedLevel(const DDSImage * image, unsigned int level){
+	if (image->cube || image->layers > 1 || level >= image->mipMapCount || ddsBlocksSupported(image))
+		return NULL;
+	size_t offset = 0;
+	for (unsigned int i = 0; i < level; i++)
+		offset += (size_t)(image->width >> i ? image->width >> i : 1) * (image->height >> i ? image->height >> i : 1) * 4;
+	return &decodeS3TC(*image)[offset];
+}
+
+GLuint loadDDS(const char * imagepath){
+	DDSImage * image = readDDS(imagepath);
+	if (image == NULL){
+		getchar();
+		return 0;
+	}
+	return uploadDDS(image);
+}
 
-}
\ No newline at end of file
@@ -0,0 +1,421 @@
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <../include/common/texture.hpp>
+#include <../include/common/glstate.hpp>
+#include <../include/common/texturearray.hpp>
+
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT 0x83F2
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT 0x8C4D
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT 0x8C4E
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+// What follows the "DDS " magic (the same layout loadDDS reads)
+struct DDSFileHeader{
+	unsigned int size;
+	unsigned int flags;
+	unsigned int height;
+	unsigned int width;
+	unsigned int pitchOrLinearSize;
+	unsigned int depth;
+	unsigned int mipMapCount;
+	unsigned int reserved1[11];
+	unsigned int pfSize;
+	unsigned int pfFlags;
+	unsigned int fourCC;
+	unsigned int rgbBitCount;
+	unsigned int rBitMask, gBitMask, bBitMask, aBitMask;
+	unsigned int caps, caps2, caps3, caps4;
+	unsigned int reserved2;
+};
+
+struct DDSFileHeaderDX10{
+	unsigned int dxgiFormat;
+	unsigned int resourceDimension;
+	unsigned int miscFlag;
+	unsigned int arraySize;
+	unsigned int miscFlags2;
+};
+
+#define DDSD_CAPS        0x1
+#define DDSD_HEIGHT      0x2
+#define DDSD_WIDTH       0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE  0x80000
+#define DDPF_FOURCC      0x4
+#define DDSCAPS_COMPLEX  0x8
+#define DDSCAPS_TEXTURE  0x1000
+#define DDSCAPS_MIPMAP   0x400000
+#define DDS_DIMENSION_TEXTURE2D 3
+
+#define FOURCC_DX10 0x30315844 // "DX10"
+
+// One texture to pack, as read from its file
+struct PackSource{
+	DDSImage * dds;                     // NULL when it came through the BMP loader
+	std::vector<unsigned char> texels;  // BMPs and decoded DXT : BGRA rows, in file order
+	GLenum format;
+	unsigned int blockSize;             // Bytes per block
+	unsigned int blockDim;              // Texels per side of a block : 4 when compressed, 1 for GL_RGBA8
+	unsigned int width, height, mipMapCount;
+	bool mipmapped;                     // A full chain, from the file or from glGenerateMipmap
+};
+
+// The textures that share an array. Its layers are as big as the biggest of them.
+struct PackFamily{
+	GLenum format;
+	unsigned int blockSize, blockDim;
+	unsigned int width, height, mipMapCount;
+	bool mipmapped;
+	std::vector<unsigned int> sources;
+};
+
+static unsigned int fullChainLength(unsigned int width, unsigned int height){
+	unsigned int levels = 1;
+	while ((width | height) >> levels)
+		levels++;
+	return levels;
+}
+
+static bool isDDSPath(const char * path){
+	size_t length = strlen(path);
+	return length >= 4 && path[length - 4] == '.' && tolower((unsigned char)path[length - 3]) == 'd'
+		&& tolower((unsigned char)path[length - 2]) == 'd' && tolower((unsigned char)path[length - 1]) == 's';
+}
+
+static bool isSRGB(GLenum format){
+	return format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT || format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT
+		|| format == GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+}
+
+// decode : DXT files the driver can't take become RGBA8 (or sRGB) sources, like the BMPs
+static bool readSource(const char * path, PackSource & source, bool decode){
+	source.dds = NULL;
+	if (isDDSPath(path)){
+		source.dds = readDDS(path);
+		if (source.dds == NULL || ddsLevel(source.dds, 0, source.format, source.blockSize, source.width, source.height, source.mipMapCount) == NULL){
+			printf("%s : only plain 2D textures can be packed\n", path);
+			freeDDS(source.dds);
+			source.dds = NULL;
+			return false;
+		}
+		const unsigned char * decoded = decode ? ddsDecodedLevel(source.dds, 0) : NULL;
+		if (decoded != NULL){
+			source.texels.resize((size_t)source.width * source.height * 4);
+			for (size_t i = 0; i < source.texels.size(); i += 4){
+				source.texels[i] = decoded[i + 2];
+				source.texels[i + 1] = decoded[i + 1];
+				source.texels[i + 2] = decoded[i];
+				source.texels[i + 3] = decoded[i + 3];
+			}
+			freeDDS(source.dds);
+			source.dds = NULL;
+			source.format = isSRGB(source.format) ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+			source.blockSize = 4;
+			source.blockDim = 1;
+			source.mipMapCount = 1;
+			source.mipmapped = true;
+			return true;
+		}
+		source.blockDim = 4;
+		// A partial chain can't line up with the other layers' : only its first level is kept
+		source.mipmapped = source.mipMapCount == fullChainLength(source.width, source.height);
+		if (!source.mipmapped)
+			source.mipMapCount = 1;
+		return true;
+	}
+
+	BMPImage * image = readBMP(path);
+	if (image == NULL)
+		return false;
+	const unsigned char * pixels = bmpPixels(image, source.width, source.height);
+	size_t rowSize = ((size_t)source.width * 3 + 3) & ~(size_t)3;
+	source.texels.resize((size_t)source.width * source.height * 4);
+	for (unsigned int y = 0; y < source.height; y++){
+		for (unsigned int x = 0; x < source.width; x++){
+			memcpy(&source.texels[((size_t)y * source.width + x) * 4], pixels + y * rowSize + x * 3, 3);
+			source.texels[((size_t)y * source.width + x) * 4 + 3] = 255;
+		}
+	}
+	freeBMP(image);
+	source.format = GL_RGBA8;
+	source.blockSize = 4;
+	source.blockDim = 1;
+	source.mipMapCount = 1;
+	source.mipmapped = true;
+	return true;
+}
+
+static void freeSources(std::vector<PackSource> & sources){
+	for (size_t i = 0; i < sources.size(); i++)
+		freeDDS(sources[i].dds);
+	sources.clear();
+}
+
+static bool readSources(const std::vector<const char *> & paths, std::vector<PackSource> & sources, std::vector<PackFamily> & families,
+	std::vector<unsigned int> & familyOf, bool decode){
+	sources.resize(paths.size());
+	for (size_t i = 0; i < paths.size(); i++){
+		if (!readSource(paths[i], sources[i], decode)){
+			sources.resize(i);
+			freeSources(sources);
+			return false;
+		}
+	}
+
+	familyOf.resize(sources.size());
+	for (unsigned int i = 0; i < sources.size(); i++){
+		const PackSource & source = sources[i];
+		unsigned int family = 0;
+		while (family < families.size() && (families[family].format != source.format || families[family].mipmapped != source.mipmapped))
+			family++;
+		if (family == families.size()){
+			PackFamily created;
+			created.format = source.format;
+			created.blockSize = source.blockSize;
+			created.blockDim = source.blockDim;
+			created.width = 0;
+			created.height = 0;
+			created.mipMapCount = 1;
+			created.mipmapped = source.mipmapped;
+			families.push_back(created);
+		}
+		PackFamily & found = families[family];
+		found.width = source.width > found.width ? source.width : found.width;
+		found.height = source.height > found.height ? source.height : found.height;
+		found.sources.push_back(i);
+		familyOf[i] = family;
+	}
+
+	// Compressed families carry their chains ; uncompressed ones get theirs from glGenerateMipmap
+	for (size_t i = 0; i < families.size(); i++){
+		PackFamily & family = families[i];
+		family.mipMapCount = family.mipmapped && family.blockDim == 4 ? fullChainLength(family.width, family.height) : 1;
+	}
+	return true;
+}
+
+// Every layer of one level of a family, one after the other. The sources sit in the top left
+// corner of their layer ; the rest is their last column and row of blocks repeated.
+static void composeLevel(const std::vector<PackSource> & sources, const PackFamily & family, unsigned int level, std::vector<unsigned char> & out){
+	unsigned int width = family.width >> level ? family.width >> level : 1;
+	unsigned int height = family.height >> level ? family.height >> level : 1;
+	unsigned int blocksX = (width + family.blockDim - 1) / family.blockDim;
+	unsigned int blocksY = (height + family.blockDim - 1) / family.blockDim;
+	size_t rowSize = (size_t)blocksX * family.blockSize;
+	size_t layerSize = rowSize * blocksY;
+	out.resize(layerSize * family.sources.size());
+
+	for (size_t layer = 0; layer < family.sources.size(); layer++){
+		const PackSource & source = sources[family.sources[layer]];
+		// Past the end of its chain a source is down to 1x1, which is what its padding repeats anyway
+		unsigned int sourceLevel = level < source.mipMapCount ? level : source.mipMapCount - 1;
+		unsigned int sourceWidth = source.width >> sourceLevel ? source.width >> sourceLevel : 1;
+		unsigned int sourceHeight = source.height >> sourceLevel ? source.height >> sourceLevel : 1;
+		unsigned int sourceBlocksX = (sourceWidth + family.blockDim - 1) / family.blockDim;
+		unsigned int sourceBlocksY = (sourceHeight + family.blockDim - 1) / family.blockDim;
+		size_t sourceRowSize = (size_t)sourceBlocksX * family.blockSize;
+
+		const unsigned char * data;
+		if (source.dds != NULL){
+			GLenum format;
+			unsigned int blockSize, w, h, mipMapCount;
+			data = ddsLevel(source.dds, sourceLevel, format, blockSize, w, h, mipMapCount);
+		}else{
+			data = &source.texels[0];
+		}
+
+		unsigned char * layerData = &out[layer * layerSize];
+		for (unsigned int y = 0; y < blocksY; y++){
+			unsigned char * row = layerData + y * rowSize;
+			if (y >= sourceBlocksY){
+				memcpy(row, row - rowSize, rowSize);
+				continue;
+			}
+			memcpy(row, data + y * sourceRowSize, sourceRowSize);
+			for (unsigned int x = sourceBlocksX; x < blocksX; x++)
+				memcpy(row + x * family.blockSize, row + (sourceBlocksX - 1) * family.blockSize, family.blockSize);
+		}
+	}
+}
+
+bool packTextures(const std::vector<const char *> & paths, TexturePack & pack){
+
+	std::vector<PackSource> sources;
+	std::vector<PackFamily> families;
+	std::vector<unsigned int> familyOf;
+	if (!readSources(paths, sources, families, familyOf, true))
+		return false;
+
+	std::vector<GLuint> arrays(families.size());
+	glGenTextures((GLsizei)arrays.size(), &arrays[0]);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	std::vector<unsigned char> levelData;
+	for (size_t i = 0; i < families.size(); i++){
+		const PackFamily & family = families[i];
+		GLsizei layers = (GLsizei)family.sources.size();
+		bool padded = false;
+		for (size_t layer = 0; layer < family.sources.size(); layer++)
+			padded = padded || sources[family.sources[layer]].width != family.width || sources[family.sources[layer]].height != family.height;
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arrays[i]);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+		for (unsigned int level = 0; level < family.mipMapCount; level++){
+			composeLevel(sources, family, level, levelData);
+			unsigned int w = family.width >> level ? family.width >> level : 1;
+			unsigned int h = family.height >> level ? family.height >> level : 1;
+			if (family.blockDim == 4)
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, family.format, w, h, layers, 0, (GLsizei)levelData.size(), &levelData[0]);
+			else
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, level, family.format, w, h, layers, 0, GL_BGRA, GL_UNSIGNED_BYTE, &levelData[0]);
+		}
+		if (family.blockDim == 1)
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		else
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, family.mipMapCount - 1);
+
+		// Repeating would pull the padding in on the other side of the padded textures : their
+		// shaders wrap the UVs themselves, before the scale (see texturearray.hpp)
+		GLint wrap = padded ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, family.mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	}
+
+	pack.arrays.insert(pack.arrays.end(), arrays.begin(), arrays.end());
+	for (size_t i = 0; i < sources.size(); i++){
+		const PackFamily & family = families[familyOf[i]];
+		TextureLayer layer;
+		layer.array = arrays[familyOf[i]];
+		layer.layer = 0;
+		while (family.sources[layer.layer] != i)
+			layer.layer++;
+		layer.scale = glm::vec2((float)sources[i].width / family.width, (float)sources[i].height / family.height);
+		pack.layers.push_back(layer);
+	}
+	printf("Packed %u textures into %u arrays\n", (unsigned int)sources.size(), (unsigned int)arrays.size());
+
+	freeSources(sources);
+	return true;
+}
+
+void deleteTexturePack(TexturePack & pack){
+	for (size_t i = 0; i < pack.arrays.size(); i++)
+		forgetTexture(pack.arrays[i]);
+	if (!pack.arrays.empty())
+		glDeleteTextures((GLsizei)pack.arrays.size(), &pack.arrays[0]);
+	pack.arrays.clear();
+	pack.layers.clear();
+}
+
+void remapUVs(std::vector<glm::vec2> & uvs, const TextureLayer & layer){
+	if (uvs.empty())
+		return;
+	// Moved by whole tiles into [0,1] first : the OBJ loader flips V below 0
+	glm::vec2 lowest = uvs[0];
+	for (size_t i = 1; i < uvs.size(); i++)
+		lowest = glm::min(lowest, uvs[i]);
+	glm::vec2 shift = glm::floor(lowest);
+	for (size_t i = 0; i < uvs.size(); i++)
+		uvs[i] = (uvs[i] - shift) * layer.scale;
+}
+
+// DXGI_FORMAT of the compressed formats loadDDS reads
+static unsigned int dxgiFormat(GLenum format){
+	switch (format){
+		case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:       return 71;
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT: return 72;
+		case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:       return 74;
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT: return 75;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:       return 77;
+		case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: return 78;
+		case GL_COMPRESSED_RED_RGTC1:                return 80;
+		case GL_COMPRESSED_SIGNED_RED_RGTC1:         return 81;
+		case GL_COMPRESSED_RG_RGTC2:                 return 83;
+		case GL_COMPRESSED_SIGNED_RG_RGTC2:          return 84;
+		default:                                     return 0;
+	}
+}
+
+bool writeTextureArrayDDS(const std::vector<const char *> & paths, const char * outPath){
+
+	std::vector<PackSource> sources;
+	std::vector<PackFamily> families;
+	std::vector<unsigned int> familyOf;
+	if (!readSources(paths, sources, families, familyOf, false))
+		return false;
+	if (families.size() != 1 || families[0].blockDim != 4 || dxgiFormat(families[0].format) == 0){
+		printf("%s : the textures don't share a compressed format, they can't go in one array\n", outPath);
+		freeSources(sources);
+		return false;
+	}
+	const PackFamily & family = families[0];
+
+	// The file wants each layer with its whole chain, the levels come with every layer
+	std::vector<std::vector<unsigned char> > levels(family.mipMapCount);
+	for (unsigned int level = 0; level < family.mipMapCount; level++)
+		composeLevel(sources, family, level, levels[level]);
+	freeSources(sources);
+
+	DDSFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(header);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = family.height;
+	header.width = family.width;
+	header.pitchOrLinearSize = (unsigned int)(levels[0].size() / family.sources.size());
+	header.mipMapCount = family.mipMapCount;
+	header.pfSize = 32;
+	header.pfFlags = DDPF_FOURCC;
+	header.fourCC = FOURCC_DX10;
+	header.caps = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | (family.mipMapCount > 1 ? DDSCAPS_MIPMAP : 0);
+
+	DDSFileHeaderDX10 headerDX10;
+	memset(&headerDX10, 0, sizeof(headerDX10));
+	headerDX10.dxgiFormat = dxgiFormat(family.format);
+	headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	headerDX10.arraySize = (unsigned int)family.sources.size();
+
+	FILE * file = fopen(outPath, "wb");
+	if (file == NULL){
+		printf("Impossible to write %s\n", outPath);
+		return false;
+	}
+	bool written = fwrite("DDS ", 1, 4, file) == 4 && fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&headerDX10, sizeof(headerDX10), 1, file) == 1;
+	for (size_t layer = 0; layer < family.sources.size() && written; layer++){
+		for (unsigned int level = 0; level < family.mipMapCount && written; level++){
+			size_t size = levels[level].size() / family.sources.size();
+			written = fwrite(&levels[level][layer * size], 1, size, file) == size;
+		}
+	}
+	written = (fclose(file) == 0) && written;
+	if (!written){
+		printf("Impossible to write %s\n", outPath);
+		remove(outPath);
+	}
+	return written;
+}
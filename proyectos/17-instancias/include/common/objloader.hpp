@@ -1,6 +1,9 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+// true : every load prints its time and throughput (MB/s), and the indexed one its vertex count. Off by default
+extern bool printOBJLoadTime;
+
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
@@ -8,6 +11,28 @@ bool loadOBJ(
 	std::vector<glm::vec3> & out_normals
 );
 
+// Same output as loadOBJ, bit for bit, but the file is split at line boundaries and
+// parsed by several threads. threadCount == 0 uses one thread per core.
+bool loadOBJ_parallel(
+	const char * path, 
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 0
+);
+
+// Indexed version : every distinct v/vt/vn triple of the file becomes one vertex, in order of
+// first use, and out_indices gets 3 entries per triangle (draw with glDrawElements and GL_UNSIGNED_INT).
+// Appends to the vectors; the new indices already account for the vertices that were there.
+bool loadOBJ_indexed(
+	const char * path,
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 0
+);
+
 
 
 bool loadAssImp(
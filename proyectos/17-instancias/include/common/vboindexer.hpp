@@ -12,7 +12,43 @@ void indexVBO(
 	std::vector<glm::vec3> & out_normals
 );
 
+// Index buffer whose element type is picked from the number of vertices it addresses
+struct IndexBuffer{
+	bool wide = false;                     // false : GL_UNSIGNED_SHORT, true : GL_UNSIGNED_INT
+	std::vector<unsigned short> indices16; // Used when !wide
+	std::vector<unsigned int> indices32;   // Used when wide
 
+	unsigned int count() const { return (unsigned int)(wide ? indices32.size() : indices16.size()); }
+	unsigned int indexSize() const { return wide ? sizeof(unsigned int) : sizeof(unsigned short); }
+	const void * data() const { return count() == 0 ? NULL : wide ? (const void *)&indices32[0] : (const void *)&indices16[0]; }
+};
+
+// Same welding as indexVBO (vertices equal bit for bit, numbered in order of first use) with a hash
+// table instead of a std::map, and no 65535 vertices limit : the indices switch to 32 bits when needed.
+// Appends to the outputs like indexVBO. threadCount != 1 shards the table by hash across threads
+// (0 = one per core); the output doesn't change.
+void indexVBO_hash(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	unsigned int threadCount = 1
+);
+
+// Times indexVBO_slow (small inputs only), indexVBO and indexVBO_hash with one thread and with
+// one per core on the same vertices, checks that the hash versions give indexVBO's output, and prints it all
+void benchmarkIndexVBO(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals
+);
+
+// Welds the vertices whose position, uv and normal are all within 0.01 of each other and sums
+// their tangents and bitangents. Candidates come from a spatial hash of the positions.
 void indexVBO_TBN(
 	std::vector<glm::vec3> & in_vertices,
 	std::vector<glm::vec2> & in_uvs,
@@ -28,4 +64,20 @@ void indexVBO_TBN(
 	std::vector<glm::vec3> & out_bitangents
 );
 
+// Same as above, with 32-bit indices once there are more than 65536 vertices
+void indexVBO_TBN(
+	std::vector<glm::vec3> & in_vertices,
+	std::vector<glm::vec2> & in_uvs,
+	std::vector<glm::vec3> & in_normals,
+	std::vector<glm::vec3> & in_tangents,
+	std::vector<glm::vec3> & in_bitangents,
+
+	IndexBuffer & out_indices,
+	std::vector<glm::vec3> & out_vertices,
+	std::vector<glm::vec2> & out_uvs,
+	std::vector<glm::vec3> & out_normals,
+	std::vector<glm::vec3> & out_tangents,
+	std::vector<glm::vec3> & out_bitangents
+);
+
 #endif
\ No newline at end of file
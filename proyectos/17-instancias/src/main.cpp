@@ -191,7 +191,7 @@ int main(void) {
     glDeleteBuffers(1, &positionVBO);
     glDeleteBuffers(1, &colorVBO);
     glDeleteBuffers(1, &centerOffsetVBO);
-    glDeleteProgram(programID);
+    DeleteProgram(programID);
     glDeleteVertexArrays(1, &VAO);
 
     // Close OpenGL window and terminate GLFW
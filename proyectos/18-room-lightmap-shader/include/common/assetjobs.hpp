@@ -0,0 +1,52 @@
+#ifndef ASSETJOBS_HPP
+#define ASSETJOBS_HPP
+
+#include <future>
+
+// Worker threads read and decode assets while the render loop is already running.
+// What they produce is handed to GL by processAssetUploads on the thread that owns the context.
+
+// threadCount == 0 uses one thread per core (at least 2 : reading files is mostly waiting)
+void startAssetWorkers(unsigned int threadCount = 0);
+
+// Optional : does the GL side of loading on a thread of its own instead of in processAssetUploads,
+// so big uploads don't hitch the render loop. setCurrent(context, true) is called on that thread
+// first and must make current a context that shares objects with the render one (e.g. a hidden
+// GLFW window created with the main one as share); setCurrent(context, false) is called last.
+// Each asset is fenced there, and processAssetUploads hands it over once the fence has signaled.
+void startAssetUploadThread(void (*setCurrent)(void * context, bool current), void * context);
+
+// Joins the workers and the upload thread. Assets that didn't reach the GPU yet are dropped and their futures get false.
+void stopAssetWorkers();
+
+// A model on its way. Until it arrives the buffers hold a placeholder cube, so it can be drawn
+// with glDrawArrays(GL_TRIANGLES, 0, vertexCount) from the first frame.
+struct AsyncMesh{
+	GLuint vertexbuffer = 0;
+	GLuint uvbuffer = 0;
+	GLuint normalbuffer = 0;
+	unsigned int vertexCount = 0;
+	bool ready = false;            // false while the placeholder is showing
+};
+
+// Same for a texture : 1x1 grey until the file arrives
+struct AsyncTexture{
+	GLuint texture = 0;
+	bool ready = false;
+};
+
+// Queue a file for the workers. Call on the GL thread; the AsyncMesh / AsyncTexture must stay
+// where it is until the future is ready. The future is true once the asset is on the GPU,
+// false if it couldn't be loaded (the placeholder stays).
+std::shared_future<bool> loadOBJ_async(const char * path, AsyncMesh & mesh);
+std::shared_future<bool> loadTexture_async(const char * path, AsyncTexture & texture); // .dds or .bmp
+
+// Uploads the assets the workers are done with until budgetMilliseconds have gone by, but at least one
+// (with the upload thread, only hands over what it's done with). Call once a frame on the GL thread. Returns how many assets are still on their way.
+unsigned int processAssetUploads(double budgetMilliseconds);
+
+// Frees what was uploaded (placeholders are shared and freed by stopAssetWorkers)
+void deleteAsyncMesh(AsyncMesh & mesh);
+void deleteAsyncTexture(AsyncTexture & texture);
+
+#endif
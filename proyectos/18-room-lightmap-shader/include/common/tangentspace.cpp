@@ -1,73 +1,446 @@
 #include <vector>
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 
 #include <../include/common/tangentspace.hpp>
+#include <../include/common/parallel.hpp>
 
-void computeTangentBasis(
+// The kernel below reads the vertex streams as plain floats
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float) && sizeof(glm::vec2) == 2 * sizeof(float), "glm vectors must be packed");
+
+// Lanes : how many triangles one step of the kernel handles, and the arithmetic on them.
+// The kernel gathers x, y and z of the same vertex of LANES triangles into one register (SoA).
+
+struct ScalarLanes{
+	typedef float V;
+	enum { LANES = 1 };
+	static V load(const float * p, size_t){ return *p; }
+	static void store(float * p, size_t, V v){ *p = v; }
+	static V add(V a, V b){ return a + b; }
+	static V sub(V a, V b){ return a - b; }
+	static V mul(V a, V b){ return a * b; }
+	static V div(V a, V b){ return a / b; }
+	static V sqrt(V a){ return sqrtf(a); }
+	static V one(){ return 1.0f; }
+	// -v where test < 0, v elsewhere
+	static V negateIfNegative(V v, V test){ return test < 0.0f ? -v : v; }
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+struct SSELanes{
+	typedef __m128 V;
+	enum { LANES = 4 };
+	static V load(const float * p, size_t stride){ return _mm_setr_ps(p[0], p[stride], p[2*stride], p[3*stride]); }
+	static void store(float * p, size_t stride, V v){
+		float lanes[4];
+		_mm_storeu_ps(lanes, v);
+		for (int i = 0; i < 4; i++)
+			p[i*stride] = lanes[i];
+	}
+	static V add(V a, V b){ return _mm_add_ps(a, b); }
+	static V sub(V a, V b){ return _mm_sub_ps(a, b); }
+	static V mul(V a, V b){ return _mm_mul_ps(a, b); }
+	static V div(V a, V b){ return _mm_div_ps(a, b); }
+	static V sqrt(V a){ return _mm_sqrt_ps(a); }
+	static V one(){ return _mm_set1_ps(1.0f); }
+	static V negateIfNegative(V v, V test){
+		V sign = _mm_and_ps(_mm_cmplt_ps(test, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+		return _mm_xor_ps(v, sign);
+	}
+};
+#endif
+
+#if defined(__AVX__)
+struct AVXLanes{
+	typedef __m256 V;
+	enum { LANES = 8 };
+	static V load(const float * p, size_t stride){
+		return _mm256_setr_ps(p[0], p[stride], p[2*stride], p[3*stride], p[4*stride], p[5*stride], p[6*stride], p[7*stride]);
+	}
+	static void store(float * p, size_t stride, V v){
+		float lanes[8];
+		_mm256_storeu_ps(lanes, v);
+		for (int i = 0; i < 8; i++)
+			p[i*stride] = lanes[i];
+	}
+	static V add(V a, V b){ return _mm256_add_ps(a, b); }
+	static V sub(V a, V b){ return _mm256_sub_ps(a, b); }
+	static V mul(V a, V b){ return _mm256_mul_ps(a, b); }
+	static V div(V a, V b){ return _mm256_div_ps(a, b); }
+	static V sqrt(V a){ return _mm256_sqrt_ps(a); }
+	static V one(){ return _mm256_set1_ps(1.0f); }
+	static V negateIfNegative(V v, V test){
+		V sign = _mm256_and_ps(_mm256_cmp_ps(test, _mm256_setzero_ps(), _CMP_LT_OQ), _mm256_set1_ps(-0.0f));
+		return _mm256_xor_ps(v, sign);
+	}
+};
+typedef AVXLanes WideLanes;
+#elif defined(__SSE2__) || defined(_M_X64)
+typedef SSELanes WideLanes;
+#else
+typedef ScalarLanes WideLanes;
+#endif
+
+// Floats between two triangles in each stream
+static const size_t VEC3_STRIDE = 9;
+static const size_t VEC2_STRIDE = 6;
+
+// Tangents of triangles [first, last) in steps of L::LANES triangles, the same math as the
+// original two loops : per-triangle tangent and bitangent, then Gram-Schmidt against the normal
+// of each vertex and the handedness fix. Returns the first triangle it didn't get to.
+template <typename L>
+static size_t tangentKernel(
+	const float * vertices, const float * uvs, const float * normals,
+	float * tangents, float * bitangents,
+	size_t first, size_t last
+){
+	typedef typename L::V V;
+	size_t t = first;
+	for (; t + L::LANES <= last; t += L::LANES){
+		const float * p = vertices + t * VEC3_STRIDE;
+		const float * uv = uvs + t * VEC2_STRIDE;
+
+		// Edges of the triangles : position delta
+		V x0 = L::load(p + 0, VEC3_STRIDE), y0 = L::load(p + 1, VEC3_STRIDE), z0 = L::load(p + 2, VEC3_STRIDE);
+		V dx1 = L::sub(L::load(p + 3, VEC3_STRIDE), x0), dy1 = L::sub(L::load(p + 4, VEC3_STRIDE), y0), dz1 = L::sub(L::load(p + 5, VEC3_STRIDE), z0);
+		V dx2 = L::sub(L::load(p + 6, VEC3_STRIDE), x0), dy2 = L::sub(L::load(p + 7, VEC3_STRIDE), y0), dz2 = L::sub(L::load(p + 8, VEC3_STRIDE), z0);
+
+		// UV delta
+		V u0 = L::load(uv + 0, VEC2_STRIDE), v0 = L::load(uv + 1, VEC2_STRIDE);
+		V du1 = L::sub(L::load(uv + 2, VEC2_STRIDE), u0), dv1 = L::sub(L::load(uv + 3, VEC2_STRIDE), v0);
+		V du2 = L::sub(L::load(uv + 4, VEC2_STRIDE), u0), dv2 = L::sub(L::load(uv + 5, VEC2_STRIDE), v0);
+
+		V r = L::div(L::one(), L::sub(L::mul(du1, dv2), L::mul(dv1, du2)));
+		V tx = L::mul(L::sub(L::mul(dx1, dv2), L::mul(dx2, dv1)), r);
+		V ty = L::mul(L::sub(L::mul(dy1, dv2), L::mul(dy2, dv1)), r);
+		V tz = L::mul(L::sub(L::mul(dz1, dv2), L::mul(dz2, dv1)), r);
+		V bx = L::mul(L::sub(L::mul(dx2, du1), L::mul(dx1, du2)), r);
+		V by = L::mul(L::sub(L::mul(dy2, du1), L::mul(dy1, du2)), r);
+		V bz = L::mul(L::sub(L::mul(dz2, du1), L::mul(dz1, du2)), r);
+
+		for (size_t k = 0; k < 3; k++){
+			const float * n = normals + t * VEC3_STRIDE + k * 3;
+			V nx = L::load(n + 0, VEC3_STRIDE), ny = L::load(n + 1, VEC3_STRIDE), nz = L::load(n + 2, VEC3_STRIDE);
+
+			// Gram-Schmidt orthogonalize
+			V d = L::add(L::add(L::mul(nx, tx), L::mul(ny, ty)), L::mul(nz, tz));
+			V ox = L::sub(tx, L::mul(nx, d)), oy = L::sub(ty, L::mul(ny, d)), oz = L::sub(tz, L::mul(nz, d));
+			V inverseLength = L::div(L::one(), L::sqrt(L::add(L::add(L::mul(ox, ox), L::mul(oy, oy)), L::mul(oz, oz))));
+			ox = L::mul(ox, inverseLength);
+			oy = L::mul(oy, inverseLength);
+			oz = L::mul(oz, inverseLength);
+
+			// Calculate handedness : dot(cross(n, t), b)
+			V handedness = L::add(L::add(
+				L::mul(L::sub(L::mul(ny, oz), L::mul(nz, oy)), bx),
+				L::mul(L::sub(L::mul(nz, ox), L::mul(nx, oz)), by)),
+				L::mul(L::sub(L::mul(nx, oy), L::mul(ny, ox)), bz));
+
+			float * out = tangents + t * VEC3_STRIDE + k * 3;
+			L::store(out + 0, VEC3_STRIDE, L::negateIfNegative(ox, handedness));
+			L::store(out + 1, VEC3_STRIDE, L::negateIfNegative(oy, handedness));
+			L::store(out + 2, VEC3_STRIDE, L::negateIfNegative(oz, handedness));
+
+			// The bitangents stay as they are, all three vertices get the triangle's
+			out = bitangents + t * VEC3_STRIDE + k * 3;
+			L::store(out + 0, VEC3_STRIDE, bx);
+			L::store(out + 1, VEC3_STRIDE, by);
+			L::store(out + 2, VEC3_STRIDE, bz);
+		}
+	}
+	return t;
+}
+
+// Below this many triangles per thread, starting the threads costs more than it saves
+static const size_t MIN_TRIANGLES_PER_THREAD = 1 << 14;
+
+void computeTangentBasis_parallel(
 	// inputs
 	std::vector<glm::vec3> & vertices,
 	std::vector<glm::vec2> & uvs,
 	std::vector<glm::vec3> & normals,
 	// outputs
 	std::vector<glm::vec3> & tangents,
-	std::vector<glm::vec3> & bitangents
+	std::vector<glm::vec3> & bitangents,
+	unsigned int threadCount
 ){
+	size_t triangles = vertices.size() / 3;
+	size_t first = tangents.size();
+	tangents  .resize(first + triangles * 3);
+	bitangents.resize(first + triangles * 3);
+	if (triangles == 0)
+		return;
 
-	for (unsigned int i=0; i<vertices.size(); i+=3 ){
+	const float * in_vertices = &vertices[0].x;
+	const float * in_uvs = &uvs[0].x;
+	const float * in_normals = &normals[0].x;
+	float * out_tangents = &tangents[first].x;
+	float * out_bitangents = &bitangents[first].x;
 
-		// Shortcuts for vertices
-		glm::vec3 & v0 = vertices[i+0];
-		glm::vec3 & v1 = vertices[i+1];
-		glm::vec3 & v2 = vertices[i+2];
+	unsigned int threads = workerCount(triangles, MIN_TRIANGLES_PER_THREAD, threadCount);
+	runParallel(threads, [&](unsigned int i){
+		size_t begin = triangles / threads * i;
+		size_t end = i + 1 == threads ? triangles : triangles / threads * (i + 1);
+		begin = tangentKernel<WideLanes>(in_vertices, in_uvs, in_normals, out_tangents, out_bitangents, begin, end);
+		tangentKernel<ScalarLanes>(in_vertices, in_uvs, in_normals, out_tangents, out_bitangents, begin, end);
+	});
+}
 
-		// Shortcuts for UVs
-		glm::vec2 & uv0 = uvs[i+0];
-		glm::vec2 & uv1 = uvs[i+1];
-		glm::vec2 & uv2 = uvs[i+2];
+void computeTangentBasis(
+	// inputs
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents
+){
+	computeTangentBasis_parallel(vertices, uvs, normals, tangents, bitangents, 1);
+}
 
+// computeTangentBasis as it was before the SIMD kernel : what checkTangentBasis compares against
+static void computeTangentBasis_reference(
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents
+){
+	for (unsigned int i=0; i<vertices.size(); i+=3 ){
 		// Edges of the triangle : postion delta
-		glm::vec3 deltaPos1 = v1-v0;
-		glm::vec3 deltaPos2 = v2-v0;
+		glm::vec3 deltaPos1 = vertices[i+1]-vertices[i+0];
+		glm::vec3 deltaPos2 = vertices[i+2]-vertices[i+0];
 
 		// UV delta
-		glm::vec2 deltaUV1 = uv1-uv0;
-		glm::vec2 deltaUV2 = uv2-uv0;
+		glm::vec2 deltaUV1 = uvs[i+1]-uvs[i+0];
+		glm::vec2 deltaUV2 = uvs[i+2]-uvs[i+0];
 
 		float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
 		glm::vec3 tangent = (deltaPos1 * deltaUV2.y   - deltaPos2 * deltaUV1.y)*r;
 		glm::vec3 bitangent = (deltaPos2 * deltaUV1.x   - deltaPos1 * deltaUV2.x)*r;
 
-		// Set the same tangent for all three vertices of the triangle.
-		// They will be merged later, in vboindexer.cpp
-		tangents.push_back(tangent);
-		tangents.push_back(tangent);
-		tangents.push_back(tangent);
-
-		// Same thing for binormals
-		bitangents.push_back(bitangent);
-		bitangents.push_back(bitangent);
-		bitangents.push_back(bitangent);
-
+		for (int k = 0; k < 3; k++){
+			tangents.push_back(tangent);
+			bitangents.push_back(bitangent);
+		}
 	}
-
-	// See "Going Further"
 	for (unsigned int i=0; i<vertices.size(); i+=1 )
 	{
 		glm::vec3 & n = normals[i];
 		glm::vec3 & t = tangents[i];
 		glm::vec3 & b = bitangents[i];
-		
+
 		// Gram-Schmidt orthogonalize
 		t = glm::normalize(t - n * glm::dot(n, t));
-		
+
 		// Calculate handedness
 		if (glm::dot(glm::cross(n, t), b) < 0.0f){
 			t = t * -1.0f;
 		}
+	}
+}
+
+// Relative error of a against the reference b. Degenerate triangles give inf or NaN on both sides :
+// two non-finite values count as equal, a finite one against a non-finite one doesn't
+static float vectorError(const glm::vec3 & a, const glm::vec3 & b){
+	float error = 0.0f;
+	for (int i = 0; i < 3; i++){
+		if (!isfinite(a[i]) || !isfinite(b[i])){
+			if (isfinite(a[i]) != isfinite(b[i]))
+				return INFINITY;
+			continue;
+		}
+		error = fmaxf(error, fabsf(a[i] - b[i]) / fmaxf(1.0f, fabsf(b[i])));
+	}
+	return error;
+}
+
+bool checkTangentBasis(
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	float epsilon
+){
+	std::vector<glm::vec3> referenceTangents, referenceBitangents;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	computeTangentBasis_reference(vertices, uvs, normals, referenceTangents, referenceBitangents);
+	double referenceTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	bool ok = true;
+	for (int parallel = 0; parallel < 2; parallel++){
+		std::vector<glm::vec3> tangents, bitangents;
+		start = std::chrono::steady_clock::now();
+		computeTangentBasis_parallel(vertices, uvs, normals, tangents, bitangents, parallel ? 0 : 1);
+		double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		float worst = 0.0f;
+		size_t mismatches = 0;
+		for (size_t i = 0; i < vertices.size(); i++){
+			float error = fmaxf(vectorError(tangents[i], referenceTangents[i]), vectorError(bitangents[i], referenceBitangents[i]));
+			worst = fmaxf(worst, error);
+			mismatches += !(error <= epsilon);
+		}
+		printf("Tangent basis of %u vertices, %s : %.3f ms (%.3f ms before), largest error %g, %u vertices off by more than %g\n",
+			(unsigned int)vertices.size(), parallel ? "all cores" : "1 thread", time, referenceTime, worst, (unsigned int)mismatches, epsilon);
+		ok = ok && mismatches == 0;
+	}
+	return ok;
+}
+
+
+// Angle of the corner at a, between the edges towards b and c
+static float cornerAngle(const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c){
+	glm::vec3 e1 = b - a;
+	glm::vec3 e2 = c - a;
+	float lengths = sqrtf(glm::dot(e1, e1) * glm::dot(e2, e2));
+	if (!(lengths > 0.0f))
+		return 0.0f;
+	float cosine = glm::dot(e1, e2) / lengths;
+	return acosf(cosine < -1.0f ? -1.0f : cosine > 1.0f ? 1.0f : cosine);
+}
+
+// Any unit vector perpendicular to n, for vertices no usable triangle gave a tangent to
+static glm::vec3 anyTangent(const glm::vec3 & n){
+	glm::vec3 axis = fabsf(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(axis - n * glm::dot(n, axis));
+}
+
+void computeTangentBasis_indexed(
+	// inputs, and outputs when a vertex has to be split
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals,
+	// outputs
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents
+){
+	size_t vertexCount = vertices.size();
+
+	// Two accumulators per vertex : one for the triangles that see it right-handed, one for the mirrored ones
+	std::vector<glm::vec3> sumTangents(vertexCount * 2, glm::vec3(0.0f));
+	std::vector<unsigned char> used(vertexCount * 2, 0);
+	std::vector<unsigned char> mirrored(indices.size(), 0);
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3){
+		unsigned int corner[3] = { indices[i], indices[i+1], indices[i+2] };
+		const glm::vec3 & v0 = vertices[corner[0]];
+		const glm::vec3 & v1 = vertices[corner[1]];
+		const glm::vec3 & v2 = vertices[corner[2]];
+
+		// Same per-triangle tangent and bitangent as computeTangentBasis
+		glm::vec3 deltaPos1 = v1-v0;
+		glm::vec3 deltaPos2 = v2-v0;
+		glm::vec2 deltaUV1 = uvs[corner[1]]-uvs[corner[0]];
+		glm::vec2 deltaUV2 = uvs[corner[2]]-uvs[corner[0]];
+		float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+		glm::vec3 tangent = (deltaPos1 * deltaUV2.y   - deltaPos2 * deltaUV1.y)*r;
+		glm::vec3 bitangent = (deltaPos2 * deltaUV1.x   - deltaPos1 * deltaUV2.x)*r;
+
+		// Degenerate in space or in UV : doesn't say anything about the tangents
+		float tangentLength = glm::dot(tangent, tangent), bitangentLength = glm::dot(bitangent, bitangent);
+		if (!(tangentLength > 0.0f && tangentLength < INFINITY && bitangentLength > 0.0f && bitangentLength < INFINITY))
+			continue;
+		tangent = tangent / sqrtf(tangentLength);
+
+		// Each corner adds the triangle's tangent, weighted by its angle
+		float angles[3] = { cornerAngle(v0, v1, v2), cornerAngle(v1, v2, v0), cornerAngle(v2, v0, v1) };
+		for (int k = 0; k < 3; k++){
+			unsigned int v = corner[k];
+			int side = glm::dot(glm::cross(normals[v], tangent), bitangent) < 0.0f ? 1 : 0;
+			mirrored[i+k] = (unsigned char)side;
+			sumTangents  [v*2 + side] += tangent * angles[k];
+			used[v*2 + side] = 1;
+		}
+	}
+
+	// Vertices used by both kinds of triangles get a copy for the mirrored ones
+	std::vector<unsigned int> mirroredVertex(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++){
+		mirroredVertex[v] = (unsigned int)v;
+		if (used[v*2] && used[v*2 + 1]){
+			mirroredVertex[v] = (unsigned int)vertices.size();
+			vertices.push_back(vertices[v]);
+			uvs     .push_back(uvs[v]);
+			normals .push_back(normals[v]);
+		}
+	}
+	for (size_t i = 0; i < indices.size(); i++){
+		if (mirrored[i])
+			indices[i] = mirroredVertex[ indices[i] ];
+	}
 
+	// Orthonormalize once per vertex : Gram-Schmidt for the tangent, the bitangent follows from the normal.
+	// Mirrored vertices get their tangent flipped, as computeTangentBasis does, so the bitangent
+	// keeps pointing along the UVs' v and the basis stays right-handed.
+	size_t first = tangents.size();
+	tangents  .resize(first + vertices.size());
+	bitangents.resize(first + vertices.size());
+	for (size_t v = 0; v < vertexCount; v++){
+		for (int side = 0; side < 2; side++){
+			if (side == 1 && !used[v*2 + 1])
+				continue;
+			if (side == 0 && !used[v*2] && used[v*2 + 1])
+				continue;
+			size_t out = side == 0 ? v : mirroredVertex[v];
+			glm::vec3 n = glm::dot(normals[out], normals[out]) > 0.0f ? glm::normalize(normals[out]) : glm::vec3(0.0f, 0.0f, 1.0f);
+			glm::vec3 t = sumTangents[v*2 + side] - n * glm::dot(n, sumTangents[v*2 + side]);
+			t = glm::dot(t, t) > 0.0f ? glm::normalize(t) : anyTangent(n);
+			if (side == 1)
+				t = t * -1.0f;
+			glm::vec3 b = glm::cross(n, t);
+			tangents  [first + out] = t;
+			bitangents[first + out] = b;
+		}
 	}
+}
 
+// Smallest |w| that still has a sign once stored as a 16-bit snorm
+static const float QTANGENT_BIAS = 1.0f / 32767.0f;
 
+static short packSnorm16(float v){
+	v = v < -1.0f ? -1.0f : v > 1.0f ? 1.0f : v;
+	return (short)floorf(v * 32767.0f + 0.5f);
 }
 
+void computeQTangents(
+	// inputs
+	std::vector<glm::vec3> & normals,
+	std::vector<glm::vec3> & tangents,
+	std::vector<glm::vec3> & bitangents,
+	// output
+	std::vector<glm::i16vec4> & qtangents
+){
+	size_t first = qtangents.size();
+	qtangents.resize(first + normals.size());
+	for (size_t i = 0; i < normals.size(); i++){
+		// Rebuild an orthonormal, right-handed frame ; the bitangent only contributes its side
+		glm::vec3 n = glm::normalize(normals[i]);
+		glm::vec3 t = tangents[i] - n * glm::dot(n, tangents[i]);
+		t = glm::dot(t, t) > 0.0f ? glm::normalize(t) : anyTangent(n);
+		glm::vec3 b = glm::cross(n, t);
+		bool mirrored = glm::dot(b, bitangents[i]) < 0.0f;
+
+		glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, n)));
 
+		// q and -q are the same rotation : keep w positive, and away from 0 so that
+		// flipping the whole quaternion can carry the handedness
+		if (q.w < 0.0f)
+			q = -q;
+		if (q.w < QTANGENT_BIAS){
+			float scale = sqrtf(1.0f - QTANGENT_BIAS * QTANGENT_BIAS);
+			q = glm::quat(QTANGENT_BIAS, q.x * scale, q.y * scale, q.z * scale);
+		}
+		if (mirrored)
+			q = -q;
+
+		qtangents[first + i] = glm::i16vec4(packSnorm16(q.x), packSnorm16(q.y), packSnorm16(q.z), packSnorm16(q.w));
+	}
+}
@@ -9,6 +9,7 @@ using namespace glm;
 
 #include "shader.hpp"
 #include "texture.hpp"
+#include "glstate.hpp"
 
 #include "text2D.hpp"
 
@@ -73,38 +74,37 @@ void printText2D(const char * text, int x, int y, int size){
 		UVs.push_back(uv_up_right);
 		UVs.push_back(uv_down_left);
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
+	bindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
 	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
+	bindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
 	glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
 
 	// Bind shader
-	glUseProgram(Text2DShaderID);
+	bindProgram(Text2DShaderID);
 
 	// Bind texture
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
+	bindTexture(0, GL_TEXTURE_2D, Text2DTextureID);
 	// Set our "myTextureSampler" sampler to use Texture Unit 0
-	glUniform1i(Text2DUniformID, 0);
+	setSamplerUniform(Text2DShaderID, Text2DUniformID, 0);
 
 	// 1rst attribute buffer : vertices
 	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
+	bindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
 
 	// 2nd attribute buffer : UVs
 	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
+	bindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	// Blending stays on after the text : opaque draws ask for it off with setCapability, which
+	// costs nothing when it already is, and several lines of text in a row only enable it once
+	setCapability(GL_BLEND, true);
+	setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Draw call
 	glDrawArrays(GL_TRIANGLES, 0, vertices.size() );
 
-	glDisable(GL_BLEND);
-
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
 
@@ -0,0 +1,42 @@
+#ifndef VIRTUALTEXTURE_HPP
+#define VIRTUALTEXTURE_HPP
+
+// A big .DDS texture that's only in VRAM as far as it's seen. The file stays mapped ; its mip levels
+// are cut in pages of VIRTUAL_PAGE_SIZE texels, and only the pages a low resolution feedback pass
+// asked for are copied into a cache texture with room for a fixed number of them (least recently
+// seen pages make room for new ones). A page table texture, one mip level per level of the texture,
+// tells the shader where each page is, or where the closest coarser page that's there is.
+// The shader side is in TextureFragmentShaderVT.frag and VirtualTextureFeedback.frag.
+
+#define VIRTUAL_PAGE_SIZE 128
+#define VIRTUAL_PAGE_BORDER 4  // Texels copied from the neighbours around each page, for filtering
+
+struct VirtualTexture;
+
+// The .DDS must be 2D, with power of two sizes of at least a page and mipmaps down to a page.
+// The coarsest level is always resident, so cachePages has to hold it plus what's seen.
+// lodBias is added to the level of detail, as the bias parameter of texture() would.
+// NULL if the file can't be used, or is DXT and the driver has no S3TC for the page cache.
+VirtualTexture * createVirtualTexture(const char * path, unsigned int cachePages = 64, float lodBias = 0.0f);
+void deleteVirtualTexture(VirtualTexture * texture);
+
+// Feedback pass : between begin and end, draw what uses the texture with feedbackProgramID
+// (VirtualTextureFeedback.frag), setting the other uniforms it needs yourself. begin makes it
+// current and renders to a small framebuffer ; it returns false when the last feedback hasn't been
+// read back yet, in which case skip the pass. end starts reading it back and restores the framebuffer and viewport.
+bool beginVirtualTextureFeedback(VirtualTexture * texture, GLuint feedbackProgramID);
+void endVirtualTextureFeedback(VirtualTexture * texture);
+
+// Takes the feedback of an earlier frame if the GPU is done with it, then streams in up to maxPages
+// of the pages it asked for, coarse levels first. Call once a frame.
+void updateVirtualTexture(VirtualTexture * texture, unsigned int maxPages);
+
+// Binds the page cache to texture unit firstUnit and the page table to firstUnit + 1,
+// and sets the uniforms of programID (in use) that sample the texture. Their locations are looked up
+// the first time, and again only if another program comes.
+void bindVirtualTexture(VirtualTexture * texture, GLuint programID, GLuint firstUnit);
+
+// Resident pages, page loads, and VRAM used next to what the whole texture would take
+void printVirtualTexture(const VirtualTexture * texture);
+
+#endif
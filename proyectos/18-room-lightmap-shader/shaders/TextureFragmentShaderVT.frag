@@ -0,0 +1,39 @@
+#version 330 core
+
+// Interpolated values from the vertex shaders
+in vec2 UV;
+
+// Output data
+out vec3 color;
+
+// Values that stay constant for the whole mesh.
+uniform sampler2D PageCache;    // The resident pages, each with a border around it
+uniform sampler2D PageTable;    // Level L : slot (x, y) and level (z) of the page that stands in for UV at level L
+uniform vec4 VirtualSize;       // Texels of level 0 (xy), texels per page (z), coarsest level with pages (w)
+uniform vec3 CacheLayout;       // Texels per slot, border, texels per side of the cache
+uniform float LodBias;
+
+// Bilinear sample of a level, from whichever page is resident for it
+vec3 sampleLevel(vec2 uv, int level){
+	vec2 pages = VirtualSize.xy / (VirtualSize.z * exp2(float(level)));
+	vec3 entry = floor(texelFetch(PageTable, ivec2(uv * pages), level).xyz * 255.0 + 0.5);
+
+	// The page can be from a coarser level than the one asked for
+	vec2 inPage = fract(uv * VirtualSize.xy / (VirtualSize.z * exp2(entry.z)));
+	vec2 texel = entry.xy * CacheLayout.x + CacheLayout.y + inPage * VirtualSize.z;
+	return textureLod(PageCache, texel / CacheLayout.z, 0.0).rgb;
+}
+
+void main(){
+
+	// Wrapped like GL_REPEAT : the .obj loader flips V for .DDS, so V comes in as (-1, 0]
+	vec2 uv = min(fract(UV), 0.99999);
+
+	// Level of detail as the hardware would pick it, blended between the two closest levels
+	vec2 dx = dFdx(UV * VirtualSize.xy);
+	vec2 dy = dFdy(UV * VirtualSize.xy);
+	float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + LodBias, 0.0, VirtualSize.w);
+	int level = int(lod);
+
+	color = mix(sampleLevel(uv, level), sampleLevel(uv, min(level + 1, int(VirtualSize.w))), lod - float(level));
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+// Interpolated values from the vertex shaders
+in vec2 UV;
+
+// Output data : the page this fragment needs (x, y, level), alpha 1 where something was drawn
+out vec4 color;
+
+// Values that stay constant for the whole mesh.
+uniform vec4 VirtualSize;       // Texels of level 0 (xy), texels per page (z), coarsest level with pages (w)
+uniform float LodBias;          // Includes the lower resolution of the feedback pass
+
+void main(){
+
+	vec2 uv = min(fract(UV), 0.99999);
+
+	vec2 dx = dFdx(UV * VirtualSize.xy);
+	vec2 dy = dFdy(UV * VirtualSize.xy);
+	float level = floor(clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + LodBias, 0.0, VirtualSize.w));
+
+	vec2 page = floor(uv * VirtualSize.xy / (VirtualSize.z * exp2(level)));
+	color = vec4(page, level, 255.0) / 255.0;
+}
@@ -0,0 +1,478 @@
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <../include/common/objloader.hpp>
+#include <../include/common/texture.hpp>
+#include <../include/common/glstate.hpp>
+#include <../include/common/assetjobs.hpp>
+
+// Both queues hold steps that get true to do their work, or false when they're dropped
+// and should only release what they hold.
+typedef std::function<void(bool)> AssetStep;
+
+static std::vector<std::thread> workers;
+static std::deque<AssetStep> jobs;          // Waiting for a worker
+static std::deque<AssetStep> uploads;       // Waiting for the GL thread
+static std::mutex jobsMutex, uploadsMutex;
+static std::condition_variable jobsReady;
+static bool stopping = false;
+static std::atomic<unsigned int> inFlight(0);
+
+// With startAssetUploadThread, uploads are done on that thread and reach the render thread
+// through published : each one waits there for its fence before the asset is handed over.
+struct PublishedAsset{
+	GLsync fence;
+	AssetStep finish;
+};
+
+static std::thread uploader;
+static std::condition_variable uploadsReady;
+static bool uploaderStopping = false;
+static std::deque<PublishedAsset> published; // Guarded by uploadsMutex
+static thread_local bool isUploadThread = false;
+
+static GLuint placeholderVertices = 0, placeholderUVs = 0, placeholderNormals = 0, placeholderTexture = 0;
+static const unsigned int PLACEHOLDER_VERTEX_COUNT = 36;
+
+static void workerLoop(){
+	for (;;){
+		AssetStep job;
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsReady.wait(lock, []{ return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job(true);
+	}
+}
+
+void startAssetWorkers(unsigned int threadCount){
+	if (!workers.empty())
+		return;
+	if (threadCount == 0){
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount < 2)
+			threadCount = 2;
+	}
+	stopping = false;
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back(workerLoop);
+}
+
+void stopAssetWorkers(){
+	std::deque<AssetStep> dropped;
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = true;
+		dropped.swap(jobs);
+	}
+	jobsReady.notify_all();
+	for (size_t i = 0; i < dropped.size(); i++)
+		dropped[i](false);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	workers.clear();
+
+	if (uploader.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(uploadsMutex);
+			uploaderStopping = true;
+		}
+		uploadsReady.notify_all();
+		uploader.join();
+	}
+
+	std::deque<PublishedAsset> droppedAssets;
+	{
+		std::lock_guard<std::mutex> lock(uploadsMutex);
+		dropped.swap(uploads);
+		droppedAssets.swap(published);
+	}
+	for (size_t i = 0; i < dropped.size(); i++)
+		dropped[i](false);
+	for (size_t i = 0; i < droppedAssets.size(); i++){
+		glDeleteSync(droppedAssets[i].fence);
+		droppedAssets[i].finish(false);
+	}
+
+	forgetBuffer(placeholderVertices);
+	forgetBuffer(placeholderUVs);
+	forgetBuffer(placeholderNormals);
+	forgetTexture(placeholderTexture);
+	glDeleteBuffers(1, &placeholderVertices);
+	glDeleteBuffers(1, &placeholderUVs);
+	glDeleteBuffers(1, &placeholderNormals);
+	glDeleteTextures(1, &placeholderTexture);
+	placeholderVertices = placeholderUVs = placeholderNormals = placeholderTexture = 0;
+}
+
+static void queueJob(AssetStep job){
+	inFlight++;
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		if (!workers.empty() && !stopping){
+			jobs.push_back(std::move(job));
+			job = AssetStep();
+		}
+	}
+	if (job){
+		// No workers : do it right here
+		job(true);
+		return;
+	}
+	jobsReady.notify_one();
+}
+
+static void queueUpload(AssetStep upload){
+	{
+		std::lock_guard<std::mutex> lock(uploadsMutex);
+		uploads.push_back(std::move(upload));
+	}
+	uploadsReady.notify_one();
+}
+
+// Hands a freshly uploaded asset to the render thread. finish gets true to publish it there,
+// or false to delete it. Off the upload thread that happens right away.
+static void publishAsset(AssetStep finish){
+	if (!isUploadThread){
+		finish(true);
+		return;
+	}
+	PublishedAsset asset;
+	asset.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	asset.finish = std::move(finish);
+	// Without the flush the fence might never reach the GPU, and never signal for the render thread
+	glFlush();
+	std::lock_guard<std::mutex> lock(uploadsMutex);
+	published.push_back(std::move(asset));
+}
+
+static void uploaderLoop(void (*setCurrent)(void * context, bool current), void * context){
+	isUploadThread = true;
+	setCurrent(context, true);
+	for (;;){
+		AssetStep upload;
+		{
+			std::unique_lock<std::mutex> lock(uploadsMutex);
+			uploadsReady.wait(lock, []{ return uploaderStopping || !uploads.empty(); });
+			if (uploaderStopping)
+				break;
+			upload = std::move(uploads.front());
+			uploads.pop_front();
+		}
+		upload(true);
+	}
+	releaseDDSStaging();
+	setCurrent(context, false);
+}
+
+void startAssetUploadThread(void (*setCurrent)(void * context, bool current), void * context){
+	if (uploader.joinable())
+		return;
+	uploaderStopping = false;
+	uploader = std::thread(uploaderLoop, setCurrent, context);
+}
+
+// A unit cube : 6 faces, 2 counter-clockwise triangles each
+static void createPlaceholders(){
+	if (placeholderVertices != 0)
+		return;
+
+	std::vector<glm::vec3> vertices, normals;
+	std::vector<glm::vec2> uvs;
+	const glm::vec2 corners[6] = { glm::vec2(-1,-1), glm::vec2(1,-1), glm::vec2(1,1), glm::vec2(-1,-1), glm::vec2(1,1), glm::vec2(-1,1) };
+	for (int axis = 0; axis < 3; axis++){
+		for (int sign = -1; sign <= 1; sign += 2){
+			glm::vec3 n(0.0f), u(0.0f), v(0.0f);
+			n[axis] = (float)sign;
+			u[(axis + 1) % 3] = 1.0f;
+			v[(axis + 2) % 3] = (float)sign; // u x v == n
+			for (int i = 0; i < 6; i++){
+				vertices.push_back(0.5f * (n + corners[i].x * u + corners[i].y * v));
+				uvs.push_back(corners[i] * 0.5f + 0.5f);
+				normals.push_back(n);
+			}
+		}
+	}
+
+	glGenBuffers(1, &placeholderVertices);
+	glBindBuffer(GL_ARRAY_BUFFER, placeholderVertices);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
+	glGenBuffers(1, &placeholderUVs);
+	glBindBuffer(GL_ARRAY_BUFFER, placeholderUVs);
+	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
+	glGenBuffers(1, &placeholderNormals);
+	glBindBuffer(GL_ARRAY_BUFFER, placeholderNormals);
+	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
+
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	glGenTextures(1, &placeholderTexture);
+	glBindTexture(GL_TEXTURE_2D, placeholderTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0;
+}
+
+// Big buffers go up a slice at a time, so one model can't blow the frame budget on its own
+static const size_t UPLOAD_SLICE_SIZE = 1 << 20;
+
+struct MeshUpload{
+	GLuint buffers[3] = { 0, 0, 0 };     // vertices, uvs, normals
+	unsigned int stream = 0;             // The one being uploaded
+	size_t offset = 0;                   // Bytes of it already uploaded
+	std::shared_ptr<AssetStep> self;     // The step to put back in the queue, until it's done
+};
+
+// Uploads the next slice. True once all the streams are on the GPU.
+static bool uploadMeshSlice(MeshUpload & state, const std::vector<glm::vec3> & vertices, const std::vector<glm::vec2> & uvs, const std::vector<glm::vec3> & normals){
+	const void * data[3] = { vertices.data(), uvs.data(), normals.data() };
+	size_t sizes[3] = { vertices.size() * sizeof(glm::vec3), uvs.size() * sizeof(glm::vec2), normals.size() * sizeof(glm::vec3) };
+	while (state.stream < 3 && sizes[state.stream] == 0)
+		state.stream++;
+	if (state.stream == 3)
+		return true;
+
+	GLuint & buffer = state.buffers[state.stream];
+	if (buffer == 0){
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizes[state.stream], NULL, GL_STATIC_DRAW);
+	}
+	size_t size = sizes[state.stream] - state.offset;
+	if (size > UPLOAD_SLICE_SIZE)
+		size = UPLOAD_SLICE_SIZE;
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, state.offset, size, (const char *)data[state.stream] + state.offset);
+	state.offset += size;
+	if (state.offset == sizes[state.stream]){
+		state.stream++;
+		state.offset = 0;
+	}
+	return state.stream == 3;
+}
+
+static void deleteMeshUpload(MeshUpload & state){
+	for (int i = 0; i < 3; i++){
+		if (state.buffers[i] != 0)
+			glDeleteBuffers(1, &state.buffers[i]);
+	}
+	state.self.reset();
+}
+
+std::shared_future<bool> loadOBJ_async(const char * path, AsyncMesh & mesh){
+
+	createPlaceholders();
+	mesh.vertexbuffer = placeholderVertices;
+	mesh.uvbuffer = placeholderUVs;
+	mesh.normalbuffer = placeholderNormals;
+	mesh.vertexCount = PLACEHOLDER_VERTEX_COUNT;
+	mesh.ready = false;
+
+	std::shared_ptr<std::promise<bool> > done = std::make_shared<std::promise<bool> >();
+	std::shared_future<bool> future = done->get_future().share();
+	std::string file(path);
+	AsyncMesh * target = &mesh;
+	std::chrono::steady_clock::time_point requested = std::chrono::steady_clock::now();
+
+	queueJob([=](bool run){
+		if (!run){
+			inFlight--;
+			done->set_value(false);
+			return;
+		}
+		// Shared so the upload step stays copyable
+		std::shared_ptr<std::vector<glm::vec3> > vertices = std::make_shared<std::vector<glm::vec3> >();
+		std::shared_ptr<std::vector<glm::vec2> > uvs = std::make_shared<std::vector<glm::vec2> >();
+		std::shared_ptr<std::vector<glm::vec3> > normals = std::make_shared<std::vector<glm::vec3> >();
+		// loadOBJ waits for a key when the file is missing, which would hang stopAssetWorkers
+		FILE * exists = fopen(file.c_str(), "rb");
+		bool loaded = exists != NULL;
+		if (exists)
+			fclose(exists);
+		else
+			printf("%s could not be opened. Are you in the right directory ?\n", file.c_str());
+		loaded = loaded && loadOBJ_parallel(file.c_str(), *vertices, *uvs, *normals, 1) && !vertices->empty();
+
+		std::shared_ptr<MeshUpload> state = std::make_shared<MeshUpload>();
+		AssetStep step = [=](bool upload){
+			if (!upload || !loaded){
+				inFlight--;
+				deleteMeshUpload(*state);
+				done->set_value(false);
+				return;
+			}
+			while (!uploadMeshSlice(*state, *vertices, *uvs, *normals)){
+				if (isUploadThread)
+					continue; // Frames don't wait for it, no need to stop
+				// More next time, before anything else
+				std::lock_guard<std::mutex> lock(uploadsMutex);
+				uploads.push_front(*state->self);
+				return;
+			}
+			state->self.reset();
+			publishAsset([=](bool publish){
+				inFlight--;
+				if (!publish){
+					deleteMeshUpload(*state);
+					done->set_value(false);
+					return;
+				}
+				target->vertexbuffer = state->buffers[0];
+				target->uvbuffer = state->buffers[1];
+				target->normalbuffer = state->buffers[2];
+				target->vertexCount = (unsigned int)vertices->size();
+				target->ready = true;
+				printf("%s is on the GPU, %.2f ms after it was asked for\n", file.c_str(), millisecondsSince(requested));
+				done->set_value(true);
+			});
+		};
+		state->self = std::make_shared<AssetStep>(step);
+		queueUpload(step);
+	});
+	return future;
+}
+
+static bool isDDS(const std::string & path){
+	return path.size() >= 4 && tolower((unsigned char)path[path.size() - 3]) == 'd'
+		&& tolower((unsigned char)path[path.size() - 2]) == 'd' && tolower((unsigned char)path[path.size() - 1]) == 's'
+		&& path[path.size() - 4] == '.';
+}
+
+std::shared_future<bool> loadTexture_async(const char * path, AsyncTexture & texture){
+
+	createPlaceholders();
+	texture.texture = placeholderTexture;
+	texture.ready = false;
+
+	std::shared_ptr<std::promise<bool> > done = std::make_shared<std::promise<bool> >();
+	std::shared_future<bool> future = done->get_future().share();
+	std::string file(path);
+	AsyncTexture * target = &texture;
+	std::chrono::steady_clock::time_point requested = std::chrono::steady_clock::now();
+
+	queueJob([=](bool run){
+		if (!run){
+			inFlight--;
+			done->set_value(false);
+			return;
+		}
+		DDSImage * dds = isDDS(file) ? readDDS(file.c_str()) : NULL;
+		BMPImage * bmp = isDDS(file) ? NULL : readBMP(file.c_str());
+
+		queueUpload([=](bool upload){
+			GLuint uploaded = 0;
+			if (upload)
+				uploaded = dds != NULL ? uploadDDS(dds) : uploadBMP(bmp);
+			else{
+				freeDDS(dds);
+				freeBMP(bmp);
+			}
+			if (uploaded == 0){
+				inFlight--;
+				done->set_value(false);
+				return;
+			}
+			publishAsset([=](bool publish){
+				inFlight--;
+				GLuint texture = uploaded;
+				if (!publish){
+					glDeleteTextures(1, &texture);
+					done->set_value(false);
+					return;
+				}
+				target->texture = texture;
+				target->ready = true;
+				printf("%s is on the GPU, %.2f ms after it was asked for\n", file.c_str(), millisecondsSince(requested));
+				done->set_value(true);
+			});
+		});
+	});
+	return future;
+}
+
+// Hands over the assets of the upload thread whose fence has signaled, without waiting for the others
+static void finishPublishedAssets(){
+	std::deque<PublishedAsset> pending;
+	{
+		std::lock_guard<std::mutex> lock(uploadsMutex);
+		pending.swap(published);
+	}
+	std::deque<PublishedAsset> notYet;
+	for (size_t i = 0; i < pending.size(); i++){
+		GLenum status = glClientWaitSync(pending[i].fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED){
+			notYet.push_back(std::move(pending[i]));
+			continue;
+		}
+		glDeleteSync(pending[i].fence);
+		pending[i].finish(true);
+	}
+	if (!notYet.empty()){
+		std::lock_guard<std::mutex> lock(uploadsMutex);
+		published.insert(published.begin(), notYet.begin(), notYet.end());
+	}
+}
+
+unsigned int processAssetUploads(double budgetMilliseconds){
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	finishPublishedAssets();
+	if (uploader.joinable())
+		return inFlight;
+	for (;;){
+		AssetStep upload;
+		{
+			std::lock_guard<std::mutex> lock(uploadsMutex);
+			if (uploads.empty())
+				break;
+			upload = std::move(uploads.front());
+			uploads.pop_front();
+		}
+		upload(true);
+		if (millisecondsSince(start) >= budgetMilliseconds)
+			break;
+	}
+	return inFlight;
+}
+
+void deleteAsyncMesh(AsyncMesh & mesh){
+	if (mesh.ready){
+		forgetBuffer(mesh.vertexbuffer);
+		forgetBuffer(mesh.uvbuffer);
+		forgetBuffer(mesh.normalbuffer);
+		glDeleteBuffers(1, &mesh.vertexbuffer);
+		glDeleteBuffers(1, &mesh.uvbuffer);
+		glDeleteBuffers(1, &mesh.normalbuffer);
+	}
+	mesh = AsyncMesh();
+}
+
+void deleteAsyncTexture(AsyncTexture & texture){
+	if (texture.ready){
+		forgetTexture(texture.texture);
+		glDeleteTextures(1, &texture.texture);
+	}
+	texture = AsyncTexture();
+}
@@ -19,6 +19,19 @@ using namespace glm;
 #include <../include/common/texture.hpp>
 #include <../include/common/controls.hpp>
 #include <../include/common/objloader.hpp>
+#include <../include/common/assetjobs.hpp>
+#include <../include/common/virtualtexture.hpp>
+#include <../include/common/mesh.hpp>
+
+// Subir los assets desde otro hilo, con un segundo contexto que comparte objetos con la ventana
+const bool usarHiloDeSubida = true;
+
+// El lightmap como textura virtual : en VRAM solo estan las paginas que la pasada de feedback vio
+const bool usarTexturaVirtual = true;
+
+static void setUploadContext(void * uploadWindow, bool current){
+	glfwMakeContextCurrent(current ? (GLFWwindow*)uploadWindow : NULL);
+}
 
 int main( void )
 {
@@ -46,6 +59,15 @@ int main( void )
 	}
 	glfwMakeContextCurrent(window);
 
+	// Ventana oculta solo por su contexto, compartido con el de la ventana principal
+	GLFWwindow* uploadWindow = NULL;
+	if (usarHiloDeSubida) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		uploadWindow = glfwCreateWindow(1, 1, "", NULL, window);
+		if (uploadWindow == NULL)
+			fprintf(stderr, "No shared context, uploading on the render thread\n");
+	}
+
 	// Initialize GLAD
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
 		fprintf(stderr, "Failed to initialize GLAD\n");
@@ -72,49 +94,72 @@ int main( void )
 	// Cull triangles which normal is not towards the camera
 	glEnable(GL_CULL_FACE);
 
-	GLuint VertexArrayID;
-	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
+	// Los modelos y texturas se leen en otros hilos mientras ya se dibuja
+	startAssetWorkers();
+	if (uploadWindow != NULL)
+		startAssetUploadThread(setUploadContext, uploadWindow);
+
+	// Load the texture : hasta que llegue se usa una gris de 1x1
+	// (la textura virtual se abre aqui mismo y trae sus paginas a medida que se ven)
+	AsyncTexture Texture;
+	VirtualTexture * lightmap = NULL;
+	if (usarTexturaVirtual)
+		lightmap = createVirtualTexture("../shaders/lightmap.DDS", 64, -2.0f);
+	if (lightmap == NULL)
+		loadTexture_async("../shaders/lightmap.DDS", Texture);
+
+	// Read our .obj file : hasta que llegue se dibuja un cubo
+	AsyncMesh room;
+	loadOBJ_async("../models/room.obj", room);
+
+	// El VAO de la sala lee el cubo provisional ; se vuelve a armar cuando llega el modelo
+	Mesh meshRoom;
+	meshRoom.count = room.vertexCount;
+	// 1rst attribute buffer : vertices
+	addMeshAttribute(meshRoom, 0, room.vertexbuffer, 3);
+	// 2nd attribute buffer : UVs
+	addMeshAttribute(meshRoom, 1, room.uvbuffer, 2);
+	buildMesh(meshRoom);
+	bool roomEnVAO = room.ready;
 
 	// Create and compile our GLSL program from the shaders
-	GLuint programID = LoadShaders( "../shaders/TransformVertexShader.vert", "../shaders/TextureFragmentShaderLOD.frag" );
+	GLuint programID = LoadShaders( "../shaders/TransformVertexShader.vert",
+		lightmap != NULL ? "../shaders/TextureFragmentShaderVT.frag" : "../shaders/TextureFragmentShaderLOD.frag" );
 
 	// Get a handle for our "MVP" uniform
 	GLuint MatrixID = glGetUniformLocation(programID, "MVP");
 
-	// Load the texture
-	GLuint Texture = loadDDS("../shaders/lightmap.DDS");
-	
+	// La pasada de feedback escribe que pagina del lightmap necesita cada pixel
+	GLuint feedbackProgramID = 0;
+	GLuint FeedbackMatrixID = 0;
+	if (lightmap != NULL) {
+		feedbackProgramID = LoadShaders( "../shaders/TransformVertexShader.vert", "../shaders/VirtualTextureFeedback.frag" );
+		FeedbackMatrixID = glGetUniformLocation(feedbackProgramID, "MVP");
+	}
+
 	// Get a handle for our "myTextureSampler" uniform
 	GLuint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
 
-	// Read our .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec2> uvs;
-	std::vector<glm::vec3> normals; // Won't be used at the moment.
-	bool res = loadOBJ("../models/room.obj", vertices, uvs, normals);
-
-	// Load it into a VBO
-
-	GLuint vertexbuffer;
-	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-	GLuint uvbuffer;
-	glGenBuffers(1, &uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-
 	while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
 		   glfwWindowShouldClose(window) == 0 )
 	{
 
-		// Clear the screen
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// Subir a la GPU lo que ya esta leido, sin pasar de 2 ms por frame
+		// (con el hilo de subida solo se recoge lo que ya termino)
+		processAssetUploads(2.0);
 
-		// Use our shader
-		glUseProgram(programID);
+		// Traer las paginas que pidio el feedback de un frame anterior, como mucho 16 por frame
+		if (lightmap != NULL)
+			updateVirtualTexture(lightmap, 16);
+
+		// Llego el modelo : sus buffers reemplazan a los del cubo
+		if (room.ready && !roomEnVAO) {
+			meshRoom.attributes[0].buffer = room.vertexbuffer;
+			meshRoom.attributes[1].buffer = room.uvbuffer;
+			meshRoom.count = room.vertexCount;
+			buildMesh(meshRoom);
+			roomEnVAO = true;
+		}
 
 		// Compute the MVP matrix from keyboard and mouse input
 		computeMatricesFromInputs();
@@ -123,45 +168,36 @@ int main( void )
 		glm::mat4 ModelMatrix = glm::mat4(1.0);
 		glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
 
+		// Pasada de feedback, a baja resolucion (se salta mientras la anterior no se haya leido)
+		if (lightmap != NULL && beginVirtualTextureFeedback(lightmap, feedbackProgramID)) {
+			glUniformMatrix4fv(FeedbackMatrixID, 1, GL_FALSE, &MVP[0][0]);
+			drawMesh(meshRoom);
+			endVirtualTextureFeedback(lightmap);
+		}
+
+		// Clear the screen
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// Use our shader
+		glUseProgram(programID);
+
 		// Send our transformation to the currently bound shader, 
 		// in the "MVP" uniform
 		glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-		// Bind our texture in Texture Unit 0
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, Texture);
-		// Set our "myTextureSampler" sampler to use Texture Unit 0
-		glUniform1i(TextureID, 0);
-
-		// 1rst attribute buffer : vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(
-			0,                  // attribute
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-
-		// 2nd attribute buffer : UVs
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-		glVertexAttribPointer(
-			1,                                // attribute
-			2,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
+		if (lightmap != NULL) {
+			// Cache de paginas en la unidad 0 y tabla de paginas en la 1
+			bindVirtualTexture(lightmap, programID, 0);
+		} else {
+			// Bind our texture in Texture Unit 0
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, Texture.texture);
+			// Set our "myTextureSampler" sampler to use Texture Unit 0
+			glUniform1i(TextureID, 0);
+		}
 
 		// Draw the triangles !
-		glDrawArrays(GL_TRIANGLES, 0, vertices.size() );
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
+		drawMesh(meshRoom);
 
 		// Swap buffers
 		glfwSwapBuffers(window);
@@ -169,11 +205,18 @@ int main( void )
 
 	} // Check if the ESC key was pressed or the window was closed
 	// Cleanup VBO and shader
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteProgram(programID);
-	glDeleteTextures(1, &Texture);
-	glDeleteVertexArrays(1, &VertexArrayID);
+	deleteMesh(meshRoom);
+	deleteAsyncMesh(room);
+	deleteAsyncTexture(Texture);
+	if (lightmap != NULL) {
+		printVirtualTexture(lightmap);
+		deleteVirtualTexture(lightmap);
+		DeleteProgram(feedbackProgramID);
+	}
+	stopAssetWorkers();
+	if (uploadWindow != NULL)
+		glfwDestroyWindow(uploadWindow);
+	DeleteProgram(programID);
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
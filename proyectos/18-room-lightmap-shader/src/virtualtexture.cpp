@@ -0,0 +1,467 @@
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <glad/glad.h>
+
+#include <../include/common/texture.hpp>
+#include <../include/common/virtualtexture.hpp>
+
+#if VIRTUAL_PAGE_SIZE % 4 != 0 || VIRTUAL_PAGE_BORDER % 4 != 0
+#error Pages and their borders are copied as whole 4x4 blocks
+#endif
+
+// The feedback is rendered at 1/FEEDBACK_DIVISOR of the viewport, in each direction
+#define FEEDBACK_DIVISOR 8
+
+struct CacheSlot{
+	int level;                     // -1 while the slot is free
+	unsigned int page;             // Within its level : y * pagesX + x
+	unsigned long long lastSeen;   // Frame of the last feedback that asked for it
+	bool pinned;                   // The coarsest level never leaves
+};
+
+// A missing page, with how many feedback texels asked for it or for its finer pages
+struct PageRequest{
+	unsigned int level;
+	unsigned int page;
+	unsigned int count;
+};
+
+// Where a program keeps the uniforms the texture sets, looked up the first time it's used with it
+struct VirtualTextureUniforms{
+	GLuint program;                 // 0 : not looked up yet
+	GLint virtualSize, lodBias;
+	GLint pageCache, pageTable, cacheLayout;
+};
+
+struct VirtualTexture{
+	DDSImage * image;
+	GLenum format;
+	unsigned int blockSize;
+	unsigned int width, height;
+	unsigned int levels;                        // Levels cut in pages
+	float lodBias;
+
+	GLuint cache;
+	unsigned int slotsPerSide, slotSize, cacheSize;
+	std::vector<CacheSlot> slots;
+	std::vector<std::vector<int> > slotOfPage;  // Per level ; -1 when the page isn't resident
+
+	GLuint table;
+	std::vector<std::vector<unsigned char> > tableLevels; // RGBA8 : slot x, slot y, level of the page, 255
+
+	GLuint framebuffer, colorbuffer, depthbuffer;
+	unsigned int feedbackWidth, feedbackHeight;
+	GLint viewport[4];              // What the feedback pass replaces, put back by its end
+	GLint previousFramebuffer;
+	GLuint readback;
+	GLsync readbackFence;
+	std::vector<unsigned int> requests;         // Per page of every level, level after level
+	std::vector<PageRequest> pending;           // What the last feedback asked for that isn't resident, most wanted first
+
+	unsigned long long frame, feedbackFrame;
+	unsigned long long pageLoads, pageEvictions;
+	std::vector<unsigned char> pageData;
+
+	VirtualTextureUniforms drawUniforms, feedbackUniforms;
+};
+
+static unsigned int pagesX(const VirtualTexture * texture, unsigned int level){
+	return (texture->width >> level) / VIRTUAL_PAGE_SIZE;
+}
+
+static unsigned int pagesY(const VirtualTexture * texture, unsigned int level){
+	return (texture->height >> level) / VIRTUAL_PAGE_SIZE;
+}
+
+// Copies a page and its border out of the mapped file into a slot of the cache.
+// At the edges of the texture the border repeats the last blocks.
+static void loadPage(VirtualTexture * texture, unsigned int level, unsigned int page, unsigned int slot){
+	GLenum format;
+	unsigned int blockSize, width, height, mipMapCount;
+	const unsigned char * blocks = ddsLevel(texture->image, level, format, blockSize, width, height, mipMapCount);
+
+	int levelBlocksX = (int)(texture->width >> level) / 4, levelBlocksY = (int)(texture->height >> level) / 4;
+	int pageBlocks = VIRTUAL_PAGE_SIZE / 4, borderBlocks = VIRTUAL_PAGE_BORDER / 4;
+	int slotBlocks = pageBlocks + 2 * borderBlocks;
+	int firstX = (int)(page % pagesX(texture, level)) * pageBlocks - borderBlocks;
+	int firstY = (int)(page / pagesX(texture, level)) * pageBlocks - borderBlocks;
+
+	texture->pageData.resize((size_t)slotBlocks * slotBlocks * blockSize);
+	unsigned char * out = &texture->pageData[0];
+	for (int y = 0; y < slotBlocks; y++){
+		int sourceY = std::min(std::max(firstY + y, 0), levelBlocksY - 1);
+		for (int x = 0; x < slotBlocks; x++){
+			int sourceX = std::min(std::max(firstX + x, 0), levelBlocksX - 1);
+			memcpy(out, blocks + ((size_t)sourceY * levelBlocksX + sourceX) * blockSize, blockSize);
+			out += blockSize;
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture->cache);
+	glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, (slot % texture->slotsPerSide) * texture->slotSize, (slot / texture->slotsPerSide) * texture->slotSize,
+		texture->slotSize, texture->slotSize, texture->format, (GLsizei)texture->pageData.size(), &texture->pageData[0]);
+
+	texture->slots[slot].level = (int)level;
+	texture->slots[slot].page = page;
+	texture->slotOfPage[level][page] = (int)slot;
+	texture->pageLoads++;
+}
+
+// Every page points at its own slot, or at the one its parent points at
+static void updatePageTable(VirtualTexture * texture){
+	for (int level = (int)texture->levels - 1; level >= 0; level--){
+		unsigned int countX = pagesX(texture, level), countY = pagesY(texture, level);
+		std::vector<unsigned char> & entries = texture->tableLevels[level];
+		for (unsigned int y = 0; y < countY; y++){
+			for (unsigned int x = 0; x < countX; x++){
+				unsigned char * entry = &entries[(y * countX + x) * 4];
+				int slot = texture->slotOfPage[level][y * countX + x];
+				if (slot >= 0){
+					entry[0] = (unsigned char)(slot % texture->slotsPerSide);
+					entry[1] = (unsigned char)(slot / texture->slotsPerSide);
+					entry[2] = (unsigned char)level;
+					entry[3] = 255;
+				}else{
+					memcpy(entry, &texture->tableLevels[level + 1][((y / 2) * pagesX(texture, level + 1) + x / 2) * 4], 4);
+				}
+			}
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, texture->table);
+	for (unsigned int level = 0; level < texture->levels; level++)
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pagesX(texture, level), pagesY(texture, level), GL_RGBA, GL_UNSIGNED_BYTE, &texture->tableLevels[level][0]);
+}
+
+VirtualTexture * createVirtualTexture(const char * path, unsigned int cachePages, float lodBias){
+
+	DDSImage * image = readDDS(path);
+	if (image == NULL)
+		return NULL;
+
+	GLenum format;
+	unsigned int blockSize, width, height, mipMapCount;
+	bool plain = ddsLevel(image, 0, format, blockSize, width, height, mipMapCount) != NULL;
+	unsigned int levels = 1;
+	while ((width >> levels) >= VIRTUAL_PAGE_SIZE && (height >> levels) >= VIRTUAL_PAGE_SIZE)
+		levels++;
+	if (!plain || (width & (width - 1)) != 0 || (height & (height - 1)) != 0 || width < VIRTUAL_PAGE_SIZE || height < VIRTUAL_PAGE_SIZE
+		|| mipMapCount < levels){
+		printf("%s : a virtual texture needs a 2D texture with power of two sizes and mipmaps down to %d texels\n", path, VIRTUAL_PAGE_SIZE);
+		freeDDS(image);
+		return NULL;
+	}
+	// The page cache takes the blocks as they are : without S3TC the caller loads a plain texture instead
+	if (!ddsBlocksSupported(image)){
+		printf("%s : no S3TC support for the page cache\n", path);
+		freeDDS(image);
+		return NULL;
+	}
+
+	VirtualTexture * texture = new VirtualTexture;
+	texture->image = image;
+	texture->format = format;
+	texture->blockSize = blockSize;
+	texture->width = width;
+	texture->height = height;
+	texture->levels = levels;
+	texture->lodBias = lodBias;
+
+	unsigned int pageCount = 0;
+	texture->slotOfPage.resize(levels);
+	texture->tableLevels.resize(levels);
+	for (unsigned int level = 0; level < levels; level++){
+		unsigned int count = pagesX(texture, level) * pagesY(texture, level);
+		texture->slotOfPage[level].assign(count, -1);
+		texture->tableLevels[level].assign(count * 4, 0);
+		pageCount += count;
+	}
+	texture->requests.assign(pageCount, 0);
+
+	// A square of slots ; the coarsest level takes some of them for good
+	unsigned int pinnedPages = pagesX(texture, levels - 1) * pagesY(texture, levels - 1);
+	if (cachePages <= pinnedPages)
+		cachePages = pinnedPages + 1;
+	texture->slotsPerSide = 1;
+	while (texture->slotsPerSide * texture->slotsPerSide < cachePages)
+		texture->slotsPerSide++;
+	texture->slotSize = VIRTUAL_PAGE_SIZE + 2 * VIRTUAL_PAGE_BORDER;
+	texture->cacheSize = texture->slotsPerSide * texture->slotSize;
+	CacheSlot freeSlot = { -1, 0, 0, false };
+	texture->slots.assign(texture->slotsPerSide * texture->slotsPerSide, freeSlot);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	glGenTextures(1, &texture->cache);
+	glBindTexture(GL_TEXTURE_2D, texture->cache);
+	glCompressedTexImage2D(GL_TEXTURE_2D, 0, format, texture->cacheSize, texture->cacheSize, 0,
+		(GLsizei)((size_t)(texture->cacheSize / 4) * (texture->cacheSize / 4) * blockSize), NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &texture->table);
+	glBindTexture(GL_TEXTURE_2D, texture->table);
+	for (unsigned int level = 0; level < levels; level++)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, pagesX(texture, level), pagesY(texture, level), 0, GL_RGBA, GL_UNSIGNED_BYTE, &texture->tableLevels[level][0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+
+	texture->framebuffer = 0;
+	texture->colorbuffer = 0;
+	texture->depthbuffer = 0;
+	texture->feedbackWidth = 0;
+	texture->feedbackHeight = 0;
+	texture->readback = 0;
+	texture->readbackFence = NULL;
+	texture->frame = 0;
+	texture->feedbackFrame = 0;
+	texture->pageLoads = 0;
+	texture->pageEvictions = 0;
+	VirtualTextureUniforms noUniforms = { 0, -1, -1, -1, -1, -1 };
+	texture->drawUniforms = noUniforms;
+	texture->feedbackUniforms = noUniforms;
+
+	for (unsigned int page = 0; page < pinnedPages; page++){
+		loadPage(texture, levels - 1, page, page);
+		texture->slots[page].pinned = true;
+	}
+	updatePageTable(texture);
+	return texture;
+}
+
+void deleteVirtualTexture(VirtualTexture * texture){
+	if (texture == NULL)
+		return;
+	glDeleteTextures(1, &texture->cache);
+	glDeleteTextures(1, &texture->table);
+	if (texture->framebuffer != 0){
+		glDeleteFramebuffers(1, &texture->framebuffer);
+		glDeleteRenderbuffers(1, &texture->colorbuffer);
+		glDeleteRenderbuffers(1, &texture->depthbuffer);
+		glDeleteBuffers(1, &texture->readback);
+	}
+	if (texture->readbackFence != NULL)
+		glDeleteSync(texture->readbackFence);
+	freeDDS(texture->image);
+	delete texture;
+}
+
+static const VirtualTextureUniforms & findUniforms(VirtualTextureUniforms & uniforms, GLuint programID){
+	if (uniforms.program != programID){
+		uniforms.program = programID;
+		uniforms.virtualSize = glGetUniformLocation(programID, "VirtualSize");
+		uniforms.lodBias = glGetUniformLocation(programID, "LodBias");
+		uniforms.pageCache = glGetUniformLocation(programID, "PageCache");
+		uniforms.pageTable = glGetUniformLocation(programID, "PageTable");
+		uniforms.cacheLayout = glGetUniformLocation(programID, "CacheLayout");
+	}
+	return uniforms;
+}
+
+static void setUniforms(const VirtualTexture * texture, const VirtualTextureUniforms & uniforms, float lodBias){
+	glUniform4f(uniforms.virtualSize, (float)texture->width, (float)texture->height,
+		(float)VIRTUAL_PAGE_SIZE, (float)(texture->levels - 1));
+	glUniform1f(uniforms.lodBias, lodBias);
+}
+
+bool beginVirtualTextureFeedback(VirtualTexture * texture, GLuint feedbackProgramID){
+
+	if (texture->readbackFence != NULL)
+		return false;
+
+	glGetIntegerv(GL_VIEWPORT, texture->viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &texture->previousFramebuffer);
+	unsigned int width = std::max(texture->viewport[2] / FEEDBACK_DIVISOR, 1);
+	unsigned int height = std::max(texture->viewport[3] / FEEDBACK_DIVISOR, 1);
+	if (width != texture->feedbackWidth || height != texture->feedbackHeight){
+		if (texture->framebuffer == 0){
+			glGenFramebuffers(1, &texture->framebuffer);
+			glGenRenderbuffers(1, &texture->colorbuffer);
+			glGenRenderbuffers(1, &texture->depthbuffer);
+			glGenBuffers(1, &texture->readback);
+		}
+		glBindRenderbuffer(GL_RENDERBUFFER, texture->colorbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, texture->depthbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindFramebuffer(GL_FRAMEBUFFER, texture->framebuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, texture->colorbuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, texture->depthbuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, texture->readback);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		texture->feedbackWidth = width;
+		texture->feedbackHeight = height;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, texture->framebuffer);
+	glViewport(0, 0, width, height);
+	// Alpha 0 : nothing asked for here
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	// Derivatives are FEEDBACK_DIVISOR times bigger at this resolution
+	glUseProgram(feedbackProgramID);
+	setUniforms(texture, findUniforms(texture->feedbackUniforms, feedbackProgramID), texture->lodBias - log2f((float)FEEDBACK_DIVISOR));
+	return true;
+}
+
+void endVirtualTextureFeedback(VirtualTexture * texture){
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, texture->readback);
+	glReadPixels(0, 0, texture->feedbackWidth, texture->feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	texture->readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, texture->previousFramebuffer);
+	glViewport(texture->viewport[0], texture->viewport[1], texture->viewport[2], texture->viewport[3]);
+}
+
+// Counts the texels that asked for each page, adds them to every coarser page above it,
+// and lists the pages that aren't resident
+static void analyzeFeedback(VirtualTexture * texture, const unsigned char * texels, size_t count){
+
+	std::fill(texture->requests.begin(), texture->requests.end(), 0);
+	std::vector<unsigned int> levelOffsets(texture->levels);
+	for (unsigned int level = 0, offset = 0; level < texture->levels; level++){
+		levelOffsets[level] = offset;
+		offset += pagesX(texture, level) * pagesY(texture, level);
+	}
+
+	for (size_t i = 0; i < count; i++){
+		const unsigned char * texel = texels + i * 4;
+		if (texel[3] == 0 || texel[2] >= texture->levels || texel[0] >= pagesX(texture, texel[2]) || texel[1] >= pagesY(texture, texel[2]))
+			continue;
+		texture->requests[levelOffsets[texel[2]] + texel[1] * pagesX(texture, texel[2]) + texel[0]]++;
+	}
+	for (unsigned int level = 0; level + 1 < texture->levels; level++){
+		unsigned int countX = pagesX(texture, level), countY = pagesY(texture, level);
+		for (unsigned int y = 0; y < countY; y++){
+			for (unsigned int x = 0; x < countX; x++){
+				unsigned int requests = texture->requests[levelOffsets[level] + y * countX + x];
+				texture->requests[levelOffsets[level + 1] + (y / 2) * pagesX(texture, level + 1) + x / 2] += requests;
+			}
+		}
+	}
+
+	texture->feedbackFrame = texture->frame;
+	texture->pending.clear();
+	for (unsigned int level = 0; level < texture->levels; level++){
+		for (unsigned int page = 0; page < texture->slotOfPage[level].size(); page++){
+			unsigned int requests = texture->requests[levelOffsets[level] + page];
+			if (requests == 0)
+				continue;
+			int slot = texture->slotOfPage[level][page];
+			if (slot >= 0){
+				texture->slots[slot].lastSeen = texture->frame;
+			}else{
+				PageRequest request = { level, page, requests };
+				texture->pending.push_back(request);
+			}
+		}
+	}
+	// Coarse pages first : they stand in for everything below them
+	std::sort(texture->pending.begin(), texture->pending.end(), [](const PageRequest & a, const PageRequest & b){
+		return a.level != b.level ? a.level > b.level : a.count > b.count;
+	});
+}
+
+// A free slot, or the one seen the longest ago. -1 if every slot is in use by the last feedback.
+static int findSlot(VirtualTexture * texture){
+	int oldest = -1;
+	for (size_t i = 0; i < texture->slots.size(); i++){
+		const CacheSlot & slot = texture->slots[i];
+		if (slot.level < 0)
+			return (int)i;
+		if (!slot.pinned && slot.lastSeen < texture->feedbackFrame && (oldest < 0 || slot.lastSeen < texture->slots[oldest].lastSeen))
+			oldest = (int)i;
+	}
+	if (oldest >= 0){
+		CacheSlot & slot = texture->slots[oldest];
+		texture->slotOfPage[slot.level][slot.page] = -1;
+		slot.level = -1;
+		texture->pageEvictions++;
+	}
+	return oldest;
+}
+
+void updateVirtualTexture(VirtualTexture * texture, unsigned int maxPages){
+
+	texture->frame++;
+	if (texture->readbackFence != NULL){
+		GLenum status = glClientWaitSync(texture->readbackFence, 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED){
+			glDeleteSync(texture->readbackFence);
+			texture->readbackFence = NULL;
+			size_t count = (size_t)texture->feedbackWidth * texture->feedbackHeight;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, texture->readback);
+			const unsigned char * texels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 4, GL_MAP_READ_BIT);
+			if (texels != NULL)
+				analyzeFeedback(texture, texels, count);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+	}
+
+	unsigned int loaded = 0;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	while (loaded < maxPages && !texture->pending.empty()){
+		PageRequest request = texture->pending.front();
+		if (texture->slotOfPage[request.level][request.page] < 0){
+			int slot = findSlot(texture);
+			if (slot < 0)
+				break; // The cache is too small for what's on screen : the rest keeps its coarser pages
+			loadPage(texture, request.level, request.page, slot);
+			texture->slots[slot].lastSeen = texture->feedbackFrame;
+			loaded++;
+		}
+		texture->pending.erase(texture->pending.begin());
+	}
+	if (loaded > 0)
+		updatePageTable(texture);
+}
+
+void bindVirtualTexture(VirtualTexture * texture, GLuint programID, GLuint firstUnit){
+	glActiveTexture(GL_TEXTURE0 + firstUnit);
+	glBindTexture(GL_TEXTURE_2D, texture->cache);
+	glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+	glBindTexture(GL_TEXTURE_2D, texture->table);
+	glActiveTexture(GL_TEXTURE0);
+
+	const VirtualTextureUniforms & uniforms = findUniforms(texture->drawUniforms, programID);
+	glUniform1i(uniforms.pageCache, firstUnit);
+	glUniform1i(uniforms.pageTable, firstUnit + 1);
+	glUniform3f(uniforms.cacheLayout, (float)texture->slotSize, (float)VIRTUAL_PAGE_BORDER, (float)texture->cacheSize);
+	setUniforms(texture, uniforms, texture->lodBias);
+}
+
+void printVirtualTexture(const VirtualTexture * texture){
+	unsigned int resident = 0;
+	for (size_t i = 0; i < texture->slots.size(); i++)
+		resident += texture->slots[i].level >= 0;
+
+	size_t cacheBytes = (size_t)(texture->cacheSize / 4) * (texture->cacheSize / 4) * texture->blockSize;
+	size_t tableBytes = 0;
+	for (unsigned int level = 0; level < texture->levels; level++)
+		tableBytes += texture->tableLevels[level].size();
+	size_t fullBytes = 0;
+	for (unsigned int level = 0; (texture->width >> level) > 0 || (texture->height >> level) > 0; level++){
+		unsigned int width = std::max(texture->width >> level, 1u), height = std::max(texture->height >> level, 1u);
+		fullBytes += (size_t)((width + 3) / 4) * ((height + 3) / 4) * texture->blockSize;
+	}
+
+	printf("Virtual texture %ux%u : %u of %u pages resident, %llu loads, %llu evictions, %.2f MB of VRAM instead of %.2f MB\n",
+		texture->width, texture->height, resident, (unsigned int)texture->slots.size(), texture->pageLoads, texture->pageEvictions,
+		(cacheBytes + tableBytes) / (1024.0 * 1024.0), fullBytes / (1024.0 * 1024.0));
+}
@@ -1,8 +1,10 @@
 #version 330 core
 
 out vec4 color;
-uniform vec3 inputColor;
+
+// El color del eje va en material.rgb
+#include "drawblock.glsl"
 
 void main(){
-    color = vec4(inputColor, 1.0);
+    color = vec4(material.rgb, 1.0);
 }
@@ -2,7 +2,8 @@
 
 layout(location = 0) in vec3 vertexPosition_modelspace;
 
-uniform mat4 MVP;
+// MVP del eje que se dibuja
+#include "drawblock.glsl"
 
 void main(){
     gl_Position = MVP * vec4(vertexPosition_modelspace, 1.0);
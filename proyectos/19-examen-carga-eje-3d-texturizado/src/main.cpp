@@ -19,6 +19,9 @@ using namespace glm;
 #include <../include/common/texture.hpp>
 #include <../include/common/controls.hpp>
 #include <../include/common/objloader.hpp>
+#include <../include/common/drawring.hpp>
+#include <../include/common/mesh.hpp>
+#include <../include/common/glstate.hpp>
 
 int main(void) {
     // inicializar GLFW
@@ -59,16 +62,11 @@ int main(void) {
     // dibujamos solo los triangulos visibles.
     glEnable(GL_CULL_FACE);
 
-    GLuint VertexArrayID;
-    glGenVertexArrays(1, &VertexArrayID);
-    glBindVertexArray(VertexArrayID);
+    // creamos y compilamos el shader para los colores (QueueShaders para que resuelva el #include)
+    GLuint programID = QueueShaders("../shaders/Eje.vert", "../shaders/Eje.frag");
 
-    // creamos y compilamos el shader para los colores
-    GLuint programID = LoadShaders("../shaders/Eje.vert", "../shaders/Eje.frag");
-
-    // creamos los uniforms para el color y modelo
-    GLuint MatrixID = glGetUniformLocation(programID, "MVP");
-    GLuint colorID = glGetUniformLocation(programID, "inputColor");
+    // la MVP y el color de cada eje van en su DrawBlock : uno por eje y frame, subidos juntos
+    DrawRing * draws = createDrawRing();
 
     // Cargar los OBJ de los ejes x, y, z
     std::vector<glm::vec3> verticesX, verticesY, verticesZ;
@@ -94,6 +92,18 @@ int main(void) {
     glBindBuffer(GL_ARRAY_BUFFER, vertexbufferZ);
     glBufferData(GL_ARRAY_BUFFER, verticesZ.size() * sizeof(glm::vec3), &verticesZ[0], GL_STATIC_DRAW);
 
+    // un VAO por eje, armado una vez : cada dibujo solo lo enlaza
+    Mesh ejeX, ejeY, ejeZ;
+    ejeX.count = verticesX.size();
+    addMeshAttribute(ejeX, 0, vertexbufferX, 3);
+    buildMesh(ejeX);
+    ejeY.count = verticesY.size();
+    addMeshAttribute(ejeY, 0, vertexbufferY, 3);
+    buildMesh(ejeY);
+    ejeZ.count = verticesZ.size();
+    addMeshAttribute(ejeZ, 0, vertexbufferZ, 3);
+    buildMesh(ejeZ);
+
     // activamos el dibujado de aristas ( desactivar para dibujar normal)
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
@@ -107,49 +117,50 @@ int main(void) {
         glm::mat4 ProjectionMatrix = getProjectionMatrix();
         glm::mat4 ViewMatrix = getViewMatrix();
         glm::mat4 ModelMatrix = glm::mat4(1.0);
-        glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
+        glm::mat4 ViewProjectionMatrix = ProjectionMatrix * ViewMatrix;
 
-        glUseProgram(programID);
+        // Los bloques de los tres ejes, en una sola subida
+        unsigned int drawX = addDraw(draws, ModelMatrix, ViewProjectionMatrix, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f)); // Color rojo
+        unsigned int drawY = addDraw(draws, ModelMatrix, ViewProjectionMatrix, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f)); // Color verde
+        unsigned int drawZ = addDraw(draws, ModelMatrix, ViewProjectionMatrix, glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)); // Color azul
+        uploadDraws(draws);
 
-        // Enviar la matriz MVP
-        glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+        // Desde el segundo frame el programa ya esta en uso y no se vuelve a mandar
+        bindProgram(programID);
 
         // Dibujar el eje X (Rojo)
-        glUniform3f(colorID, 1.0f, 0.0f, 0.0f); // Color rojo
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbufferX);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glDrawArrays(GL_TRIANGLES, 0, verticesX.size());
-        glDisableVertexAttribArray(0);
+        bindDraw(draws, drawX);
+        drawMesh(ejeX);
 
         // Dibujar el eje Y (Verde)
-        glUniform3f(colorID, 0.0f, 1.0f, 0.0f); // Color verde
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbufferY);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glDrawArrays(GL_TRIANGLES, 0, verticesY.size());
-        glDisableVertexAttribArray(0);
+        bindDraw(draws, drawY);
+        drawMesh(ejeY);
 
         // Dibujar el eje Z (Azul)
-        glUniform3f(colorID, 0.0f, 0.0f, 1.0f); // Color azul
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexbufferZ);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-        glDrawArrays(GL_TRIANGLES, 0, verticesZ.size());
-        glDisableVertexAttribArray(0);
+        bindDraw(draws, drawZ);
+        drawMesh(ejeZ);
+
+        // los bloques de este frame no se reescriben hasta que la GPU los haya usado
+        endDrawFrame(draws);
+        endGLStateFrame();
 
         // Intercambiar buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    // Llamadas de estado por frame, y cuantas se ahorraron (solo con printGLStateCalls = true)
+    printGLStateCounters();
+
     // limpiar
     glDeleteBuffers(1, &vertexbufferX);
     glDeleteBuffers(1, &vertexbufferY);
     glDeleteBuffers(1, &vertexbufferZ);
-    glDeleteProgram(programID);
-    glDeleteVertexArrays(1, &VertexArrayID);
+    deleteMesh(ejeX);
+    deleteMesh(ejeY);
+    deleteMesh(ejeZ);
+    DeleteProgram(programID);
+    deleteDrawRing(draws);
 
     glfwTerminate();
 
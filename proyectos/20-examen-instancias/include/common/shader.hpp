@@ -1,8 +1,55 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+// Linked programs are kept as driver binaries in "<last shader path>.<hash>.programcache", the hash
+// being that of all the shader paths and defines, and reused while the sources and the driver stay
+// the same ; anything else compiles them again and rewrites the file.
+
+// Bump whenever the layout of .programcache files changes
+#define PROGRAM_CACHE_VERSION 1
+
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
 GLuint Load3Shaders(const char * vertex_file_path, const char * fragment_file_path, const char * geometry_file_path);
 
+// Batch version : QueueShaders hands a program to the driver and returns at once, without asking
+// whether it compiled, so the programs of a scene (and whatever is loaded meanwhile) overlap.
+// The logs and the binary cache are dealt with the first time UseProgram binds it.
+GLuint QueueShaders(const char * vertex_file_path, const char * fragment_file_path);
+
+GLuint Queue3Shaders(const char * vertex_file_path, const char * fragment_file_path, const char * geometry_file_path);
+
+// QueueShaders for one variant of a pair of shaders : defines ("TEXTURA NORMAL_MAP", "LUCES=4")
+// go in as #define lines after #version (or first, without one), and #include "file" lines are
+// replaced by the file.
+// The same variant asked for twice is the same program, only compiled the first time.
+GLuint QueueShaderVariant(const char * vertex_file_path, const char * fragment_file_path, const char * defines);
+
+// Whether UseProgram can bind it without waiting for the driver (KHR_parallel_shader_compile).
+// Always true without the extension.
+bool ProgramReady(GLuint ProgramID);
+
+// glUseProgram, that collects the result of a queued program the first time
+void UseProgram(GLuint ProgramID);
+
+// Location of a uniform from the table made when the program was linked, so no driver call and
+// no string search in the driver ; -1 if the program doesn't use it. Still a hash lookup :
+// keep the result out of the render loop.
+GLint UniformLocation(GLuint ProgramID, const char * name);
+
+// glDeleteProgram, that also drops the uniform table, the variant and the queued compile of the
+// program, so a later program that gets the same name doesn't inherit them
+void DeleteProgram(GLuint ProgramID);
+
+// Camera matrices shared by every program that declares
+//   layout(std140) uniform CameraBlock { mat4 view; mat4 projection; mat4 viewProjection; };
+// Programs get the block bound to CAMERA_BLOCK_BINDING when they're linked ; UpdateCameraBlock,
+// once a frame, uploads the matrices to one uniform buffer and binds it there.
+#define CAMERA_BLOCK_BINDING 0
+void UpdateCameraBlock(const glm::mat4 & view, const glm::mat4 & projection);
+void DeleteCameraBlock();
+
+// Binding point of the per-draw block (drawring.hpp), bound the same way when a program is linked
+#define DRAW_BLOCK_BINDING 1
+
 #endif
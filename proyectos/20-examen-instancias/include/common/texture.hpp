@@ -9,8 +9,39 @@ GLuint loadBMP_custom(const char * imagepath);
 //// Load a .TGA file using GLFW's own loader
 //GLuint loadTGA_glfw(const char * imagepath);
 
-// Load a .DDS file using GLFW's own loader
+// Load a .DDS file (DXT1/3/5, BC4/5 ; 2D, cube map or array) with all the mipmaps it contains.
+// The file is mapped and each level goes through a pixel unpack buffer, so it's copied only once.
+// Without EXT_texture_compression_s3tc, DXT files are decoded to RGBA8 on the CPU (and kept for the next load).
 GLuint loadDDS(const char * imagepath);
 
+// The loaders above in two halves : read* does the file work and can run on any thread,
+// upload* needs the GL context and frees the image. free* drops an image that won't be uploaded.
+// NULL images upload to 0.
+struct BMPImage;
+BMPImage * readBMP(const char * imagepath);
+GLuint uploadBMP(BMPImage * image);
+void freeBMP(BMPImage * image);
+// The texels as they are in the file : BGR, bottom row first, rows padded to 4 bytes
+const unsigned char * bmpPixels(const BMPImage * image, unsigned int & width, unsigned int & height);
+
+struct DDSImage;
+DDSImage * readDDS(const char * imagepath);
+GLuint uploadDDS(DDSImage * image);
+void freeDDS(DDSImage * image);
+// Each thread that uploads DDS files has a staging buffer of its own. Frees the calling thread's,
+// while its context is still current (the next upload makes a new one).
+void releaseDDSStaging();
+// What uploadDDS binds it to : GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP or their _ARRAY versions
+GLenum ddsTarget(const DDSImage * image);
+// The blocks of one level of a plain 2D texture, as they are in the file (NULL for cube maps, arrays
+// or a level past the end). The other values describe the whole texture ; blockSize is per 4x4 texels.
+const unsigned char * ddsLevel(const DDSImage * image, unsigned int level, GLenum & format, unsigned int & blockSize,
+	unsigned int & width, unsigned int & height, unsigned int & mipMapCount);
+// False for DXT files when the driver has no S3TC : their blocks can't go to GL as they are
+bool ddsBlocksSupported(const DDSImage * image);
+// The same level as RGBA8 texels, when ddsBlocksSupported is false (NULL otherwise, or like
+// ddsLevel). Decoded like uploadDDS does it ; valid until the same thread decodes the next DXT file.
+const unsigned char * ddsDecodedLevel(const DDSImage * image, unsigned int level);
+
 
 #endif
\ No newline at end of file